@@ -55,6 +55,9 @@
 #define MAX_CPU_THRESHOLD		20
 #define CPU_SLOPE_SIZE			7
 
+#define CPU_BUS_FREQ_BANDS		4
+#define CPU_BUS_UTIL_BANDS		4
+
 static unsigned int dmc_max_threshold;
 static bool mif_locking;
 static bool int_locking;
@@ -75,6 +78,48 @@ enum busfreq_level_idx {
 
 static struct busfreq_table *exynos4_busfreq_table;
 
+/*
+ * Lowest bus level for a given ARM clock and DMC utilization, so that
+ * MIF/INT follow the CPU at once instead of a sampling period later.
+ * Rows are ARM clock bands, columns are bands of the DMC load seen by
+ * PPMU in the last sample (percent of the maximum bus frequency).
+ * The monitor may still pick a higher level from PPMU alone.
+ */
+static const unsigned int cpu_freq_bands[CPU_BUS_FREQ_BANDS - 1] = {
+	400000, 900000, 1200000,
+};
+
+static const unsigned int dmc_util_bands[CPU_BUS_UTIL_BANDS - 1] = {
+	IDLE_THRESHOLD, 15, UP_THRESHOLD,
+};
+
+static const enum busfreq_level_idx
+cpu_bus_table[CPU_BUS_FREQ_BANDS][CPU_BUS_UTIL_BANDS] = {
+	/* util:  idle	   low	   mid	   high */
+	{	LV_6,	LV_6,	LV_5,	LV_4 },	/*  ~  400MHz */
+	{	LV_6,	LV_5,	LV_4,	LV_3 },	/*  ~  900MHz */
+	{	LV_4,	LV_4,	LV_3,	LV_1 },	/*  ~ 1200MHz */
+	{	LV_4,	LV_3,	LV_1,	LV_1 },	/* 1200MHz ~  */
+};
+
+static unsigned int cpu_freq_cur;
+static unsigned int last_dmc_load;
+
+static unsigned long cpu_bus_freq(unsigned int cpufreq, unsigned int dmc_load)
+{
+	unsigned int f, u;
+
+	for (f = 0; f < CPU_BUS_FREQ_BANDS - 1; f++)
+		if (cpufreq <= cpu_freq_bands[f])
+			break;
+
+	for (u = 0; u < CPU_BUS_UTIL_BANDS - 1; u++)
+		if (dmc_load < dmc_util_bands[u])
+			break;
+
+	return exynos4_busfreq_table[cpu_bus_table[f][u]].mem_clk;
+}
+
 static struct busfreq_table exynos4_busfreq_table_orig[] = {
 	{LV_0, 400266, 1100000, 0, 0, 0}, /* MIF : 400MHz INT : 200MHz */
 	{LV_1, 400200, 1100000, 0, 0, 0}, /* MIF : 400MHz INT : 200MHz */
@@ -610,6 +655,7 @@ struct opp *exynos4x12_monitor(struct busfreq_data *data)
 	unsigned int dmc1_load_average = 0;
 	unsigned int dmc_load_average;
 	unsigned long cpufreq = 0;
+	unsigned long jointfreq;
 	unsigned long lockfreq;
 	unsigned long dmcfreq;
 	unsigned long newfreq;
@@ -686,32 +732,42 @@ struct opp *exynos4x12_monitor(struct busfreq_data *data)
 		dmcfreq = div64_u64(maxfreq * dmc_load * 1000, dmc_max_threshold);
 	}
 
+	last_dmc_load = dmc_load;
+	jointfreq = cpu_bus_freq(cpu_freq_cur, dmc_load);
+
 	lockfreq = dev_max_freq(data->dev);
 
-	newfreq = max3(lockfreq, dmcfreq, cpufreq);
+	newfreq = max(max3(lockfreq, dmcfreq, cpufreq), jointfreq);
 
 	opp = opp_find_freq_ceil(data->dev, &newfreq);
 
 	return opp;
 }
 
-#define ARM_INT_CORRECTION 160160
-
 static int exynos4x12_busfreq_cpufreq_transition(struct notifier_block *nb,
 					    unsigned long val, void *data)
 {
 	struct cpufreq_freqs *freqs = (struct cpufreq_freqs *)data;
-	struct busfreq_data *bus_data = container_of(nb, struct busfreq_data,
-			exynos_cpufreq_notifier);
+	unsigned long freq;
+
+	/* All cores share one clock, the first notification is enough */
+	if (freqs->cpu)
+		return NOTIFY_DONE;
 
 	switch (val) {
 	case CPUFREQ_PRECHANGE:
-		if (freqs->new > 900000 && freqs->old < 1000000)
-			dev_lock(bus_data->dev, bus_data->dev, ARM_INT_CORRECTION);
+		if (freqs->new <= freqs->old)
+			break;
+		/*
+		 * Raise MIF/INT before the ARM clock goes up, instead of a
+		 * sampling period later.  exynos_request_apply() only ever
+		 * raises the level, the monitor brings it back down.
+		 */
+		freq = cpu_bus_freq(freqs->new, last_dmc_load);
+		exynos_request_apply(freq, false, false);
 		break;
 	case CPUFREQ_POSTCHANGE:
-		if (freqs->old > 900000 && freqs->new < 1000000)
-			dev_unlock(bus_data->dev, bus_data->dev);
+		cpu_freq_cur = freqs->new;
 		break;
 	}
 	return NOTIFY_DONE;
@@ -838,6 +894,8 @@ int exynos4x12_init(struct device *dev, struct busfreq_data *data, bool pop)
 	}
 	#endif
 
+	cpu_freq_cur = cpufreq_quick_get(0);
+
 	data->exynos_cpufreq_notifier.notifier_call =
 				exynos4x12_busfreq_cpufreq_transition;
 
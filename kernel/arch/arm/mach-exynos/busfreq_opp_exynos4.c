@@ -53,6 +53,7 @@ static DEFINE_MUTEX(busfreq_lock);
 
 struct busfreq_control {
 	struct opp *opp_lock;
+	struct opp *opp_ceiling;
 	struct device *dev;
 	struct busfreq_data *data;
 	bool init_done;
@@ -69,6 +70,18 @@ void update_busfreq_stat(struct busfreq_data *data, unsigned int index)
 #endif
 }
 
+static void update_busfreq_trans_stat(struct busfreq_data *data,
+		unsigned int index, ktime_t start)
+{
+	struct busfreq_trans_stat *stat = &data->trans_stat[index];
+	unsigned int us = ktime_to_us(ktime_sub(ktime_get(), start));
+
+	stat->count++;
+	stat->total_us += us;
+	if (us > stat->max_us)
+		stat->max_us = us;
+}
+
 static struct opp __maybe_unused *step_up(struct busfreq_data *data, int step)
 {
 	int i;
@@ -115,6 +128,7 @@ static unsigned int _target(struct busfreq_data *data, struct opp *new)
 	unsigned int voltage;
 	unsigned long newfreq;
 	unsigned long currfreq;
+	ktime_t start;
 
 	newfreq = opp_get_freq(new);
 	currfreq = opp_get_freq(data->curr_opp);
@@ -124,6 +138,7 @@ static unsigned int _target(struct busfreq_data *data, struct opp *new)
 	if (newfreq == 0 || newfreq == currfreq || data->use == false)
 		return data->get_table_index(data->curr_opp);
 
+	start = ktime_get();
 	voltage = opp_get_voltage(new);
 	if (newfreq > currfreq) {
 		//hqf 20121031
@@ -153,6 +168,8 @@ static unsigned int _target(struct busfreq_data *data, struct opp *new)
 	}
 	data->curr_opp = new;
 
+	update_busfreq_trans_stat(data, index, start);
+
 	return index;
 }
 
@@ -170,6 +187,10 @@ static void exynos_busfreq_timer(struct work_struct *work)
 
 	mutex_lock(&busfreq_lock);
 
+	if (bus_ctrl.opp_ceiling &&
+	    opp_get_freq(opp) > opp_get_freq(bus_ctrl.opp_ceiling))
+		opp = bus_ctrl.opp_ceiling;
+
 	if (data->force_opp)
 		opp = data->force_opp;
 
@@ -299,14 +320,43 @@ static ssize_t show_time_in_state(struct device *device,
 	return len;
 }
 
+/*
+ * One line per level: number of transitions into it, then the average
+ * and the worst time in usec from the start of the switch until the
+ * new dividers were settled.
+ */
+static ssize_t show_trans_latency(struct device *device,
+		struct device_attribute *attr, char *buf)
+{
+	struct platform_device *pdev = to_platform_device(bus_ctrl.dev);
+	struct busfreq_data *data = (struct busfreq_data *)platform_get_drvdata(pdev);
+	struct busfreq_trans_stat *stat;
+	ssize_t len = 0;
+	int i;
+
+	mutex_lock(&busfreq_lock);
+	for (i = 0; i < data->table_size; i++) {
+		stat = &data->trans_stat[i];
+		len += sprintf(buf + len, "%u %u %llu %u\n",
+				data->table[i].mem_clk, stat->count,
+				stat->count ? div_u64(stat->total_us, stat->count) : 0,
+				stat->max_us);
+	}
+	mutex_unlock(&busfreq_lock);
+
+	return len;
+}
+
 static DEVICE_ATTR(curr_freq, 0666, show_level_lock, store_level_lock);
 static DEVICE_ATTR(lock_list, 0666, show_locklist, NULL);
 static DEVICE_ATTR(time_in_state, 0666, show_time_in_state, NULL);
+static DEVICE_ATTR(trans_latency, 0444, show_trans_latency, NULL);
 
 static struct attribute *busfreq_attributes[] = {
 	&dev_attr_curr_freq.attr,
 	&dev_attr_lock_list.attr,
 	&dev_attr_time_in_state.attr,
+	&dev_attr_trans_latency.attr,
 	NULL
 };
 
@@ -343,6 +393,9 @@ void exynos_request_apply(unsigned long freq, bool fix, bool disable)
 		}
 	} else {
 		opp = opp_find_freq_ceil(bus_ctrl.data->dev, &freq);
+		if (bus_ctrl.opp_ceiling &&
+		    opp_get_freq(opp) > opp_get_freq(bus_ctrl.opp_ceiling))
+			opp = bus_ctrl.opp_ceiling;
 	}
 
 	if (bus_ctrl.data->force_opp)
@@ -362,6 +415,54 @@ out:
 	mutex_unlock(&busfreq_lock);
 }
 
+/**
+ * exynos_busfreq_set_ceiling - cap the bus level for thermal throttling
+ * @steps: number of levels below the maximum to cap at, 0 removes the cap
+ *
+ * The cap applies to the level picked from PPMU load and dev_lock()
+ * requests; fixed locks and the user lock in curr_freq still win.
+ */
+void exynos_busfreq_set_ceiling(unsigned int steps)
+{
+	struct busfreq_data *data;
+	struct opp *opp, *next;
+	unsigned long freq;
+	unsigned int i, index;
+
+	mutex_lock(&busfreq_lock);
+
+	if (!bus_ctrl.init_done)
+		goto out;
+
+	data = bus_ctrl.data;
+
+	if (!steps) {
+		bus_ctrl.opp_ceiling = NULL;
+		goto out;
+	}
+
+	opp = data->max_opp;
+	for (i = 0; i < steps && opp != data->min_opp; i++) {
+		freq = opp_get_freq(opp) - 1;
+		next = opp_find_freq_floor(data->dev, &freq);
+		if (IS_ERR(next))
+			break;
+		opp = next;
+	}
+	bus_ctrl.opp_ceiling = opp;
+
+	if (data->force_opp || bus_ctrl.opp_lock)
+		goto out;
+
+	if (opp_get_freq(data->curr_opp) > opp_get_freq(opp)) {
+		index = _target(data, opp);
+		update_busfreq_stat(data, index);
+	}
+
+out:
+	mutex_unlock(&busfreq_lock);
+}
+
 static __devinit int exynos_busfreq_probe(struct platform_device *pdev)
 {
 	struct busfreq_data *data;
@@ -427,6 +528,12 @@ static __devinit int exynos_busfreq_probe(struct platform_device *pdev)
 		goto err_busfreq;
 	}
 
+	data->trans_stat = kzalloc(sizeof(struct busfreq_trans_stat) *
+				   data->table_size, GFP_KERNEL);
+	if (!data->trans_stat) {
+		pr_err("Unable to create trans_stat.\n");
+		goto err_trans_stat;
+	}
 
 	data->last_time = get_jiffies_64();
 
@@ -455,6 +562,9 @@ static __devinit int exynos_busfreq_probe(struct platform_device *pdev)
 	return 0;
 
 err_pm_notifier:
+	kfree(data->trans_stat);
+
+err_trans_stat:
 	kfree(data->time_in_state);
 
 err_busfreq:
@@ -483,6 +593,7 @@ static __devexit int exynos_busfreq_remove(struct platform_device *pdev)
 	regulator_put(data->vdd_mif);
 	#endif
 	sysfs_remove_group(data->busfreq_kobject, &data->busfreq_attr_group);
+	kfree(data->trans_stat);
 	kfree(data->time_in_state);
 	kfree(data);
 
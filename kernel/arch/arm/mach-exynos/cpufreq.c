@@ -20,6 +20,11 @@
 #include <linux/cpufreq.h>
 #include <linux/suspend.h>
 #include <linux/reboot.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/math64.h>
 
 #include <mach/map.h>
 #include <mach/regs-clock.h>
@@ -39,15 +44,48 @@ static bool exynos_cpufreq_disable;
 static bool exynos_cpufreq_lock_disable;
 static bool exynos_cpufreq_init_done;
 static DEFINE_MUTEX(set_freq_lock);
-static DEFINE_MUTEX(set_cpu_freq_lock);
 
-unsigned int g_cpufreq_limit_id;
-unsigned int g_cpufreq_limit_val[DVFS_LOCK_ID_END];
-unsigned int g_cpufreq_limit_level;
+/*
+ * Frequency floors (exynos_cpufreq_lock) and ceilings
+ * (exynos_cpufreq_upper_limit) requested by each DVFS_LOCK_ID client are
+ * aggregated in a constraint, pm_qos style.  Each level keeps a count of
+ * the clients requesting it and a bit in @levels while that count is not
+ * zero, so adding, updating and removing a request are O(1) and the
+ * aggregate is the first (floor) or last (ceiling) bit set.
+ *
+ * Only the bookkeeping is done in the caller's context, under a
+ * spinlock.  The frequency change itself, if one is needed, is left to
+ * exynos_cpufreq_wq so that media drivers do not wait for a DVFS
+ * transition; exynos_target() reads the aggregate levels without any
+ * lock.
+ */
+struct exynos_cpufreq_constraint {
+	const char *name;
+	bool floor;
+	spinlock_t lock;
+	unsigned int level;		/* aggregate, read locklessly */
+	unsigned int none;		/* level with no request */
+	unsigned long levels;
+	unsigned char count[L20 + 1];
+	unsigned int active;		/* mask of DVFS_LOCK_ID */
+	unsigned int val[DVFS_LOCK_ID_END];
+	/* Accounting, for debugfs */
+	unsigned int requests[DVFS_LOCK_ID_END];
+	unsigned long since[DVFS_LOCK_ID_END];
+	u64 total[DVFS_LOCK_ID_END];	/* jiffies */
+};
 
-unsigned int g_cpufreq_lock_id;
-unsigned int g_cpufreq_lock_val[DVFS_LOCK_ID_END];
-unsigned int g_cpufreq_lock_level;
+static struct exynos_cpufreq_constraint cpufreq_floor = {
+	.name	= "lock",
+	.floor	= true,
+	.lock	= __SPIN_LOCK_UNLOCKED(cpufreq_floor.lock),
+};
+
+static struct exynos_cpufreq_constraint cpufreq_ceiling = {
+	.name	= "upper_limit",
+	.floor	= false,
+	.lock	= __SPIN_LOCK_UNLOCKED(cpufreq_ceiling.lock),
+};
 
 int exynos_verify_speed(struct cpufreq_policy *policy)
 {
@@ -88,7 +126,7 @@ static int exynos_target(struct cpufreq_policy *policy,
 			  unsigned int target_freq,
 			  unsigned int relation)
 {
-	unsigned int index, old_index;
+	unsigned int index, old_index, lock_level, limit_level;
 	unsigned int arm_volt, safe_arm_volt = 0;
 	int ret = 0;
 	struct cpufreq_frequency_table *freq_table = exynos_info->freq_table;
@@ -114,11 +152,13 @@ static int exynos_target(struct cpufreq_policy *policy,
 	}
 
 	/* Need to set performance limitation */
-	if (!exynos_cpufreq_lock_disable && (index > g_cpufreq_lock_level))
-		index = g_cpufreq_lock_level;
+	lock_level = ACCESS_ONCE(cpufreq_floor.level);
+	if (!exynos_cpufreq_lock_disable && (index > lock_level))
+		index = lock_level;
 
-	if (index < g_cpufreq_limit_level)
-		index = g_cpufreq_limit_level;
+	limit_level = ACCESS_ONCE(cpufreq_ceiling.level);
+	if (index < limit_level)
+		index = limit_level;
 
 	freqs.new = freq_table[index].frequency;
 	freqs.cpu = policy->cpu;
@@ -240,245 +280,356 @@ int exynos_cpufreq_get_level(unsigned int freq, unsigned int *level)
 }
 EXPORT_SYMBOL_GPL(exynos_cpufreq_get_level);
 
-atomic_t exynos_cpufreq_lock_count;
+static const char * const dvfs_lock_id_name[DVFS_LOCK_ID_END] = {
+	[DVFS_LOCK_ID_G2D]	= "G2D",
+	[DVFS_LOCK_ID_TV]	= "TV",
+	[DVFS_LOCK_ID_MFC]	= "MFC",
+	[DVFS_LOCK_ID_USB]	= "USB",
+	[DVFS_LOCK_ID_CAM]	= "CAM",
+	[DVFS_LOCK_ID_PM]	= "PM",
+	[DVFS_LOCK_ID_USER]	= "USER",
+	[DVFS_LOCK_ID_TMU]	= "TMU",
+	[DVFS_LOCK_ID_LPA]	= "LPA",
+	[DVFS_LOCK_ID_DRM]	= "DRM",
+	[DVFS_LOCK_ID_G3D]	= "G3D",
+};
 
-int exynos_cpufreq_lock(unsigned int nId,
-			 enum cpufreq_level_index cpufreq_level)
+static struct workqueue_struct *exynos_cpufreq_wq;
+static struct work_struct exynos_cpufreq_apply_work;
+static unsigned int exynos_cpufreq_applied;
+
+static void exynos_cpufreq_constraint_init(struct exynos_cpufreq_constraint *c,
+					   unsigned int none)
 {
-	int ret = 0, i, old_idx = 0;
-	unsigned int freq_old, freq_new, arm_volt, safe_arm_volt;
-	unsigned int *volt_table;
-	struct cpufreq_policy *policy;
-	struct cpufreq_frequency_table *freq_table;
+	c->none = none;
+	c->level = none;
+}
 
-	if (!exynos_cpufreq_init_done)
-		return -EPERM;
+static void __constraint_aggregate(struct exynos_cpufreq_constraint *c)
+{
+	if (!c->levels)
+		c->level = c->none;
+	else if (c->floor)
+		c->level = __ffs(c->levels);
+	else
+		c->level = __fls(c->levels);
+}
 
-	if (!exynos_info)
-		return -EPERM;
+static void __constraint_drop(struct exynos_cpufreq_constraint *c,
+			      unsigned int nId)
+{
+	unsigned int level = c->val[nId];
 
-	if (exynos_cpufreq_disable && (nId != DVFS_LOCK_ID_TMU)) {
-		pr_info("CPUFreq is already fixed\n");
-		return -EPERM;
+	if (!--c->count[level])
+		c->levels &= ~(1UL << level);
+	c->active &= ~(1 << nId);
+	c->total[nId] += jiffies - c->since[nId];
+}
+
+/* Adds or updates the request of @nId, returns true if the aggregate moved */
+static bool exynos_cpufreq_constraint_update(struct exynos_cpufreq_constraint *c,
+					     unsigned int nId, unsigned int level)
+{
+	unsigned long flags;
+	bool moved;
+	unsigned int old;
+
+	spin_lock_irqsave(&c->lock, flags);
+	old = c->level;
+	if (c->active & (1 << nId))
+		__constraint_drop(c, nId);
+	c->val[nId] = level;
+	c->count[level]++;
+	c->levels |= 1UL << level;
+	c->active |= 1 << nId;
+	c->since[nId] = jiffies;
+	c->requests[nId]++;
+	__constraint_aggregate(c);
+	moved = c->level != old;
+	spin_unlock_irqrestore(&c->lock, flags);
+
+	return moved;
+}
+
+/* Removes the request of @nId, returns true if the aggregate moved */
+static bool exynos_cpufreq_constraint_remove(struct exynos_cpufreq_constraint *c,
+					     unsigned int nId)
+{
+	unsigned long flags;
+	bool moved;
+	unsigned int old;
+
+	spin_lock_irqsave(&c->lock, flags);
+	old = c->level;
+	if (c->active & (1 << nId)) {
+		__constraint_drop(c, nId);
+		__constraint_aggregate(c);
 	}
+	moved = c->level != old;
+	spin_unlock_irqrestore(&c->lock, flags);
 
-	policy = cpufreq_cpu_get(0);
-	if (!policy)
-		return -EPERM;
+	return moved;
+}
 
-	volt_table = exynos_info->volt_table;
-	freq_table = exynos_info->freq_table;
+static bool exynos_cpufreq_constraint_active(struct exynos_cpufreq_constraint *c,
+					     unsigned int nId)
+{
+	return ACCESS_ONCE(c->active) & (1 << nId);
+}
 
-	if (g_cpufreq_lock_id & (1 << nId)) {
-		printk(KERN_ERR "%s:Device [%d] already locked cpufreq\n",
-				__func__,  nId);
-		return 0;
+/* Called with set_freq_lock held */
+static int exynos_cpufreq_set_level(unsigned int new_idx)
+{
+	struct cpufreq_frequency_table *freq_table = exynos_info->freq_table;
+	unsigned int *volt_table = exynos_info->volt_table;
+	unsigned int arm_volt, safe_arm_volt, i, old_idx = 0;
+	unsigned int freq_old = cpufreq_quick_get(0);
+
+	/* Find out current level index */
+	for (i = 0; i <= exynos_info->min_support_idx; i++) {
+		if (freq_old == freq_table[i].frequency) {
+			old_idx = freq_table[i].index;
+			break;
+		} else if (i == exynos_info->min_support_idx) {
+			printk(KERN_ERR "%s: Level not found\n", __func__);
+			return -EINVAL;
+		}
 	}
-	mutex_lock(&set_cpu_freq_lock);
-	g_cpufreq_lock_id |= (1 << nId);
-	g_cpufreq_lock_val[nId] = cpufreq_level;
 
-	/* If the requested cpufreq is higher than current min frequency */
-	if (cpufreq_level < g_cpufreq_lock_level)
-		g_cpufreq_lock_level = cpufreq_level;
+	freqs.old = freq_old;
+	freqs.new = freq_table[new_idx].frequency;
+	freqs.cpu = 0;
+	cpufreq_notify_transition(&freqs, CPUFREQ_PRECHANGE);
 
-	mutex_unlock(&set_cpu_freq_lock);
+	/* get the voltage value */
+	safe_arm_volt = exynos_get_safe_armvolt(old_idx, new_idx);
+	arm_volt = volt_table[new_idx];
 
-	if ((g_cpufreq_lock_level < g_cpufreq_limit_level)
-				&& (nId != DVFS_LOCK_ID_PM))
-		return 0;
+	if (freqs.new > freqs.old || safe_arm_volt) {
+		//hqf 20121031
+		#if 0
+		regulator_set_voltage(arm_regulator,
+				safe_arm_volt ? safe_arm_volt : arm_volt,
+				(safe_arm_volt ? safe_arm_volt : arm_volt) + 25000);
+		#endif
+	}
 
-	/* Do not setting cpufreq lock frequency
-	 * because current governor doesn't support dvfs level lock
-	 * except DVFS_LOCK_ID_PM */
-	if (exynos_cpufreq_lock_disable && (nId != DVFS_LOCK_ID_PM))
-		return 0;
+	exynos_info->set_freq(old_idx, new_idx);
 
-	/* If current frequency is lower than requested freq,
-	 * it needs to update
-	 */
-	mutex_lock(&set_freq_lock);
-	freq_old = policy->cur;
-	freq_new = freq_table[cpufreq_level].frequency;
-	if (freq_old < freq_new) {
-		/* Find out current level index */
-		for (i = 0 ; i <= exynos_info->min_support_idx;  i++) {
-			if (freq_old == freq_table[i].frequency) {
-				old_idx = freq_table[i].index;
-				break;
-			} else if (i == exynos_info->min_support_idx) {
-				printk(KERN_ERR "%s: Level not found\n",
-					__func__);
-				mutex_unlock(&set_freq_lock);
-				return -EINVAL;
-			} else {
-				continue;
-			}
-		}
-		freqs.old = freq_old;
-		freqs.new = freq_new;
-		cpufreq_notify_transition(&freqs, CPUFREQ_PRECHANGE);
-
-		/* get the voltage value */
-		safe_arm_volt = exynos_get_safe_armvolt(old_idx, cpufreq_level);
-		if (safe_arm_volt)
-		{
-			//hqf 20121031
-			#if 0
-			regulator_set_voltage(arm_regulator, safe_arm_volt,
-					     safe_arm_volt + 25000);
-			#endif
-		}
-
-		arm_volt = volt_table[cpufreq_level];
+	if (freqs.new < freqs.old || safe_arm_volt) {
 		//hqf 20121031
 		#if 0
 		regulator_set_voltage(arm_regulator, arm_volt,
 				     arm_volt + 25000);
 		#endif
-
-		exynos_info->set_freq(old_idx, cpufreq_level);
-		cpufreq_notify_transition(&freqs, CPUFREQ_POSTCHANGE);
 	}
-	mutex_unlock(&set_freq_lock);
 
-	return ret;
+	cpufreq_notify_transition(&freqs, CPUFREQ_POSTCHANGE);
+
+	exynos_cpufreq_applied++;
+
+	return 0;
 }
-EXPORT_SYMBOL_GPL(exynos_cpufreq_lock);
 
-void exynos_cpufreq_lock_free(unsigned int nId)
+/*
+ * Moves the current frequency inside the aggregate floor and ceiling.
+ * The ceiling wins over every floor but the PM one, which is also the
+ * only floor applied while a governor that does not support level
+ * locks is in use.
+ */
+static void exynos_cpufreq_apply(struct work_struct *work)
 {
-	unsigned int i;
+	struct cpufreq_frequency_table *freq_table = exynos_info->freq_table;
+	unsigned int floor, ceiling, cur;
+	bool pm;
 
-	if (!exynos_cpufreq_init_done)
-		return;
+	mutex_lock(&set_freq_lock);
 
-	mutex_lock(&set_cpu_freq_lock);
-	g_cpufreq_lock_id &= ~(1 << nId);
-	g_cpufreq_lock_val[nId] = exynos_info->min_support_idx;
-	g_cpufreq_lock_level = exynos_info->min_support_idx;
-	if (g_cpufreq_lock_id) {
-		for (i = 0; i < DVFS_LOCK_ID_END; i++) {
-			if (g_cpufreq_lock_val[i] < g_cpufreq_lock_level)
-				g_cpufreq_lock_level = g_cpufreq_lock_val[i];
-		}
+	cur = cpufreq_quick_get(0);
+	if (!cur)
+		goto out;
+
+	floor = ACCESS_ONCE(cpufreq_floor.level);
+	ceiling = ACCESS_ONCE(cpufreq_ceiling.level);
+	pm = exynos_cpufreq_constraint_active(&cpufreq_floor, DVFS_LOCK_ID_PM);
+
+	if (!pm) {
+		if (floor < ceiling)
+			floor = ceiling;
+		if (exynos_cpufreq_lock_disable)
+			floor = exynos_info->min_support_idx;
 	}
-	mutex_unlock(&set_cpu_freq_lock);
+
+	if (cur < freq_table[floor].frequency)
+		exynos_cpufreq_set_level(floor);
+	else if (cur > freq_table[ceiling].frequency)
+		exynos_cpufreq_set_level(ceiling);
+out:
+	mutex_unlock(&set_freq_lock);
 }
-EXPORT_SYMBOL_GPL(exynos_cpufreq_lock_free);
 
-int exynos_cpufreq_upper_limit(unsigned int nId,
-				enum cpufreq_level_index cpufreq_level)
+static void exynos_cpufreq_kick(unsigned int nId)
 {
-	int ret = 0, old_idx = 0, i;
-	unsigned int freq_old, freq_new, arm_volt, safe_arm_volt;
-	unsigned int *volt_table;
-	struct cpufreq_policy *policy;
-	struct cpufreq_frequency_table *freq_table;
+	queue_work(exynos_cpufreq_wq, &exynos_cpufreq_apply_work);
 
+	/* Suspend and reboot need the PM level before they go on */
+	if (nId == DVFS_LOCK_ID_PM)
+		flush_work(&exynos_cpufreq_apply_work);
+}
+
+int exynos_cpufreq_lock(unsigned int nId,
+			 enum cpufreq_level_index cpufreq_level)
+{
 	if (!exynos_cpufreq_init_done)
 		return -EPERM;
 
 	if (!exynos_info)
 		return -EPERM;
 
-	if (exynos_cpufreq_disable) {
+	if (exynos_cpufreq_disable && (nId != DVFS_LOCK_ID_TMU)) {
 		pr_info("CPUFreq is already fixed\n");
 		return -EPERM;
 	}
 
-	policy = cpufreq_cpu_get(0);
-	if (!policy)
-		return -EPERM;
+	if (nId >= DVFS_LOCK_ID_END ||
+	    cpufreq_level > exynos_info->min_support_idx)
+		return -EINVAL;
 
-	volt_table = exynos_info->volt_table;
-	freq_table = exynos_info->freq_table;
+	if (exynos_cpufreq_constraint_update(&cpufreq_floor, nId,
+					     cpufreq_level) ||
+	    nId == DVFS_LOCK_ID_PM)
+		exynos_cpufreq_kick(nId);
 
-	if (g_cpufreq_limit_id & (1 << nId)) {
-		pr_err("[CPUFREQ]This device [%d] already limited cpufreq\n", nId);
-		return 0;
-	}
+	return 0;
+}
+EXPORT_SYMBOL_GPL(exynos_cpufreq_lock);
 
-	mutex_lock(&set_cpu_freq_lock);
-	g_cpufreq_limit_id |= (1 << nId);
-	g_cpufreq_limit_val[nId] = cpufreq_level;
+void exynos_cpufreq_lock_free(unsigned int nId)
+{
+	if (!exynos_cpufreq_init_done || nId >= DVFS_LOCK_ID_END)
+		return;
 
-	/* If the requested limit level is lower than current value */
-	if (cpufreq_level > g_cpufreq_limit_level)
-		g_cpufreq_limit_level = cpufreq_level;
+	/* Nothing to apply: a lower floor lets the governor go down itself */
+	exynos_cpufreq_constraint_remove(&cpufreq_floor, nId);
+}
+EXPORT_SYMBOL_GPL(exynos_cpufreq_lock_free);
 
-	mutex_unlock(&set_cpu_freq_lock);
+int exynos_cpufreq_upper_limit(unsigned int nId,
+				enum cpufreq_level_index cpufreq_level)
+{
+	if (!exynos_cpufreq_init_done)
+		return -EPERM;
 
-	mutex_lock(&set_freq_lock);
-	/* If cur frequency is higher than limit freq, it needs to update */
-	freq_old = policy->cur;
-	freq_new = freq_table[cpufreq_level].frequency;
-	if (freq_old > freq_new) {
-		/* Find out current level index */
-		for (i = 0; i <= exynos_info->min_support_idx; i++) {
-			if (freq_old == freq_table[i].frequency) {
-				old_idx = freq_table[i].index;
-				break;
-			} else if (i == exynos_info->min_support_idx) {
-				printk(KERN_ERR "%s: Level is not found\n", __func__);
-				mutex_unlock(&set_freq_lock);
-
-				return -EINVAL;
-			} else {
-				continue;
-			}
-		}
-		freqs.old = freq_old;
-		freqs.new = freq_new;
+	if (!exynos_info)
+		return -EPERM;
 
-		cpufreq_notify_transition(&freqs, CPUFREQ_PRECHANGE);
+	if (exynos_cpufreq_disable) {
+		pr_info("CPUFreq is already fixed\n");
+		return -EPERM;
+	}
 
-		exynos_info->set_freq(old_idx, cpufreq_level);
+	if (nId >= DVFS_LOCK_ID_END ||
+	    cpufreq_level > exynos_info->min_support_idx)
+		return -EINVAL;
 
-		safe_arm_volt = exynos_get_safe_armvolt(old_idx, cpufreq_level);
-		if (safe_arm_volt)
-		{
-			//hqf 20121031
-			#if 0
-			regulator_set_voltage(arm_regulator, safe_arm_volt,
-					     safe_arm_volt + 25000);
-			#endif
-		}
+	if (exynos_cpufreq_constraint_update(&cpufreq_ceiling, nId,
+					     cpufreq_level))
+		exynos_cpufreq_kick(nId);
 
-		arm_volt = volt_table[cpufreq_level];
-		//hqf 20121031
-		#if 0
-		regulator_set_voltage(arm_regulator, arm_volt, arm_volt + 25000);
-		#endif
+	return 0;
+}
 
-		cpufreq_notify_transition(&freqs, CPUFREQ_POSTCHANGE);
+void exynos_cpufreq_upper_limit_free(unsigned int nId)
+{
+	if (!exynos_cpufreq_init_done || nId >= DVFS_LOCK_ID_END)
+		return;
+
+	/* A floor the ceiling was holding back may apply now */
+	if (exynos_cpufreq_constraint_remove(&cpufreq_ceiling, nId) &&
+	    cpufreq_floor.levels)
+		exynos_cpufreq_kick(nId);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static void exynos_cpufreq_constraint_show(struct seq_file *s,
+					   struct exynos_cpufreq_constraint *c)
+{
+	struct cpufreq_frequency_table *freq_table = exynos_info->freq_table;
+	unsigned int active, val[DVFS_LOCK_ID_END], requests[DVFS_LOCK_ID_END];
+	unsigned long since[DVFS_LOCK_ID_END], flags, now;
+	u64 total[DVFS_LOCK_ID_END];
+	unsigned int i, level;
+
+	spin_lock_irqsave(&c->lock, flags);
+	active = c->active;
+	level = c->level;
+	memcpy(val, c->val, sizeof(val));
+	memcpy(requests, c->requests, sizeof(requests));
+	memcpy(since, c->since, sizeof(since));
+	memcpy(total, c->total, sizeof(total));
+	spin_unlock_irqrestore(&c->lock, flags);
+	now = jiffies;
+
+	seq_printf(s, "%s: L%u (%u kHz)%s\n", c->name, level,
+		   freq_table[level].frequency,
+		   active ? "" : ", no request");
+	seq_printf(s, "  %-6s %-12s %10s %14s\n",
+		   "client", "request", "requests", "active_ms");
+	for (i = 0; i < DVFS_LOCK_ID_END; i++) {
+		u64 held = total[i];
+
+		if (active & (1 << i))
+			held += now - since[i];
+		if (!requests[i])
+			continue;
+
+		seq_printf(s, "  %-6s ", dvfs_lock_id_name[i]);
+		if (active & (1 << i))
+			seq_printf(s, "L%-2u %7u ", val[i],
+				   freq_table[val[i]].frequency);
+		else
+			seq_printf(s, "%-12s ", "-");
+		seq_printf(s, "%10u %14llu\n", requests[i],
+			   (unsigned long long)div_u64(held * MSEC_PER_SEC, HZ));
 	}
+}
 
-	mutex_unlock(&set_freq_lock);
+static int exynos_cpufreq_requests_show(struct seq_file *s, void *unused)
+{
+	exynos_cpufreq_constraint_show(s, &cpufreq_floor);
+	seq_printf(s, "\n");
+	exynos_cpufreq_constraint_show(s, &cpufreq_ceiling);
+	seq_printf(s, "\napplied transitions: %u\n", exynos_cpufreq_applied);
 
-	return ret;
+	return 0;
 }
 
-void exynos_cpufreq_upper_limit_free(unsigned int nId)
+static int exynos_cpufreq_requests_open(struct inode *inode, struct file *file)
 {
-	unsigned int i;
+	return single_open(file, exynos_cpufreq_requests_show, NULL);
+}
 
-	if (!exynos_cpufreq_init_done)
-		return;
+static const struct file_operations exynos_cpufreq_requests_fops = {
+	.open		= exynos_cpufreq_requests_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
 
-	mutex_lock(&set_cpu_freq_lock);
-	g_cpufreq_limit_id &= ~(1 << nId);
-	g_cpufreq_limit_val[nId] = exynos_info->max_support_idx;
-	g_cpufreq_limit_level = exynos_info->max_support_idx;
+static void __init exynos_cpufreq_debugfs_init(void)
+{
+	struct dentry *root;
 
-	if (g_cpufreq_limit_id) {
-		for (i = 0; i < DVFS_LOCK_ID_END; i++) {
-			if (g_cpufreq_limit_val[i] > g_cpufreq_limit_level)
-				g_cpufreq_limit_level = g_cpufreq_limit_val[i];
-		}
+	root = debugfs_create_dir("exynos_cpufreq", NULL);
+	if (IS_ERR_OR_NULL(root)) {
+		pr_err("%s: error creating debugfs root\n", __func__);
+		return;
 	}
-	mutex_unlock(&set_cpu_freq_lock);
+
+	debugfs_create_file("requests", S_IRUGO, root, NULL,
+			    &exynos_cpufreq_requests_fops);
 }
+#endif
 
 /* This API serve highest priority level locking */
 int exynos_cpufreq_level_fix(unsigned int freq)
@@ -686,7 +837,6 @@ static struct cpufreq_driver exynos_driver = {
 static int __init exynos_cpufreq_init(void)
 {
 	int ret = -EINVAL;
-	int i;
 
 	exynos_info = kzalloc(sizeof(struct exynos_dvfs_info), GFP_KERNEL);
 	if (!exynos_info)
@@ -719,6 +869,18 @@ static int __init exynos_cpufreq_init(void)
 	}
 	#endif
 
+	exynos_cpufreq_wq = alloc_ordered_workqueue("exynos_cpufreq", 0);
+	if (!exynos_cpufreq_wq) {
+		pr_err("%s: failed to create workqueue\n", __func__);
+		goto err_vdd_arm;
+	}
+	INIT_WORK(&exynos_cpufreq_apply_work, exynos_cpufreq_apply);
+
+	exynos_cpufreq_constraint_init(&cpufreq_floor,
+				       exynos_info->min_support_idx);
+	exynos_cpufreq_constraint_init(&cpufreq_ceiling,
+				       exynos_info->max_support_idx);
+
 	exynos_cpufreq_disable = false;
 
 	register_pm_notifier(&exynos_cpufreq_notifier);
@@ -728,23 +890,23 @@ static int __init exynos_cpufreq_init(void)
 
 	exynos_cpufreq_init_done = true;
 
-	for (i = 0; i < DVFS_LOCK_ID_END; i++) {
-		g_cpufreq_lock_val[i] = exynos_info->min_support_idx;
-		g_cpufreq_limit_val[i] = exynos_info->max_support_idx;
-	}
-
-	g_cpufreq_lock_level = exynos_info->min_support_idx;
-	g_cpufreq_limit_level = exynos_info->max_support_idx;
-
 	if (cpufreq_register_driver(&exynos_driver)) {
 		pr_err("failed to register cpufreq driver\n");
 		goto err_cpufreq;
 	}
 
+#ifdef CONFIG_DEBUG_FS
+	exynos_cpufreq_debugfs_init();
+#endif
+
 	return 0;
 err_cpufreq:
+	exynos_cpufreq_init_done = false;
+	cpufreq_unregister_notifier(&exynos_cpufreq_policy_notifier,
+						CPUFREQ_POLICY_NOTIFIER);
 	unregister_reboot_notifier(&exynos_cpufreq_reboot_notifier);
 	unregister_pm_notifier(&exynos_cpufreq_notifier);
+	destroy_workqueue(exynos_cpufreq_wq);
 
 	//hqf 20121031
 	#if 0
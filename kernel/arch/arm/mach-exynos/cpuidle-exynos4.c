@@ -11,10 +11,16 @@
 #include <linux/kernel.h>
 #include <linux/init.h>
 #include <linux/cpuidle.h>
+#include <linux/cpu.h>
 #include <linux/io.h>
+#include <linux/jiffies.h>
+#include <linux/kobject.h>
+#include <linux/percpu.h>
 #include <linux/suspend.h>
 #include <linux/platform_device.h>
 #include <linux/gpio.h>
+#include <linux/sysfs.h>
+#include <linux/tick.h>
 
 #include <asm/proc-fns.h>
 #include <asm/tlbflush.h>
@@ -292,6 +298,37 @@ static int exynos4_check_operation(void)
 	return 0;
 }
 
+/*
+ * A device found busy is very likely still busy on the next idle entry,
+ * so remember a busy verdict for busy_cache_ms instead of polling every
+ * controller again.  Only "busy" is cached: an idle verdict is always
+ * re-checked, so a stale cache can cost power but never lets LPA cut
+ * off a device in use.  PM transitions drop the cache.
+ */
+static unsigned int busy_cache_ms = 20;
+static unsigned long busy_until;
+static unsigned int busy_cache_hits;
+
+static void exynos4_busy_cache_invalidate(void)
+{
+	busy_until = jiffies;
+}
+
+static int exynos4_check_operation_cached(void)
+{
+	if (busy_cache_ms && time_before(jiffies, busy_until)) {
+		busy_cache_hits++;
+		return 1;
+	}
+
+	if (exynos4_check_operation()) {
+		busy_until = jiffies + msecs_to_jiffies(busy_cache_ms);
+		return 1;
+	}
+
+	return 0;
+}
+
 static struct sleep_save exynos4_lpa_save[] = {
 	/* CMU side */
 	SAVE_ITEM(EXYNOS4_CLKSRC_MASK_TOP),
@@ -364,9 +401,10 @@ static void vfp_enable(void *unused)
 }
 
 static int exynos4_enter_core0_aftr(struct cpuidle_device *dev,
-				    struct cpuidle_state *state)
+				    struct cpuidle_state *state,
+				    unsigned int *exit_us)
 {
-	struct timeval before, after;
+	struct timeval before, wake, after;
 	int idle_time;
 	unsigned long tmp, abb_val;
 
@@ -389,6 +427,7 @@ static int exynos4_enter_core0_aftr(struct cpuidle_device *dev,
 		exynos4x12_set_abb_member(ABB_ARM, ABB_MODE_085V);
 	}
 	if (exynos4_enter_lp(0, PLAT_PHYS_OFFSET - PAGE_OFFSET) == 0) {
+		do_gettimeofday(&wake);
 
 		/*
 		 * Clear Central Sequence Register in exiting early wakeup
@@ -403,6 +442,8 @@ static int exynos4_enter_core0_aftr(struct cpuidle_device *dev,
 
 	cpu_init();
 
+	do_gettimeofday(&wake);
+
 	vfp_enable(NULL);
 
 early_wakeup:
@@ -421,14 +462,17 @@ early_wakeup:
 	local_irq_enable();
 	idle_time = (after.tv_sec - before.tv_sec) * USEC_PER_SEC +
 		    (after.tv_usec - before.tv_usec);
+	*exit_us = (after.tv_sec - wake.tv_sec) * USEC_PER_SEC +
+		   (after.tv_usec - wake.tv_usec);
 
 	return idle_time;
 }
 
 static int exynos4_enter_core0_lpa(struct cpuidle_device *dev,
-				   struct cpuidle_state *state)
+				   struct cpuidle_state *state,
+				   unsigned int *exit_us)
 {
-	struct timeval before, after;
+	struct timeval before, wake, after;
 	int idle_time;
 	unsigned long tmp, abb_val;
 
@@ -478,6 +522,7 @@ static int exynos4_enter_core0_lpa(struct cpuidle_device *dev,
 	}
 
 	if (exynos4_enter_lp(0, PLAT_PHYS_OFFSET - PAGE_OFFSET) == 0) {
+		do_gettimeofday(&wake);
 
 		/*
 		 * Clear Central Sequence Register in exiting early wakeup
@@ -492,6 +537,8 @@ static int exynos4_enter_core0_lpa(struct cpuidle_device *dev,
 
 	cpu_init();
 
+	do_gettimeofday(&wake);
+
 	vfp_enable(NULL);
 
 	s3c_pm_do_restore_core(exynos4_lpa_save,
@@ -523,10 +570,114 @@ early_wakeup:
 	local_irq_enable();
 	idle_time = (after.tv_sec - before.tv_sec) * USEC_PER_SEC +
 		    (after.tv_usec - before.tv_usec);
+	*exit_us = (after.tv_sec - wake.tv_sec) * USEC_PER_SEC +
+		   (after.tv_usec - wake.tv_usec);
 
 	return idle_time;
 }
 
+/*
+ * Per-mode statistics.  LOW_POWER is split into AFTR and LPA, which the
+ * cpuidle core cannot tell apart.  The exit latency is the software
+ * part only: from the return of exynos4_enter_lp() until interrupts
+ * are enabled again.  A deep entry is mispredicted when it slept less
+ * than the LOW_POWER target residency; a WFI entry the predictor
+ * demoted to is mispredicted when it slept longer than that.
+ */
+enum exynos4_idle_mode {
+	IDLE_MODE_WFI,
+	IDLE_MODE_AFTR,
+	IDLE_MODE_LPA,
+	IDLE_MODE_END,
+};
+
+static const char *exynos4_idle_mode_name[IDLE_MODE_END] = {
+	"WFI", "AFTR", "LPA",
+};
+
+struct exynos4_idle_stat {
+	unsigned int usage;
+	unsigned int mispredict;
+	unsigned int exit_max_us;
+	unsigned long long time_us;
+	unsigned long long exit_us;
+};
+
+#define IDLE_HISTORY_SIZE	8
+
+struct exynos4_idle_info {
+	struct exynos4_idle_stat stat[IDLE_MODE_END];
+	unsigned int history[IDLE_HISTORY_SIZE];
+	unsigned int history_index;
+	bool demoted;
+};
+
+static DEFINE_PER_CPU(struct exynos4_idle_info, exynos4_idle_info);
+
+/* Tunables of the LOW_POWER predictor */
+static unsigned int predict_enable = 1;
+static unsigned int predict_short_max = IDLE_HISTORY_SIZE / 2;
+
+static unsigned int exynos4_deep_residency(struct cpuidle_device *dev)
+{
+	return dev->state_count > 1 ? dev->states[1].target_residency : 0;
+}
+
+static void exynos4_idle_account(struct cpuidle_device *dev,
+				 enum exynos4_idle_mode mode,
+				 int idle_time, unsigned int exit_us)
+{
+	struct exynos4_idle_info *info = &per_cpu(exynos4_idle_info, dev->cpu);
+	struct exynos4_idle_stat *stat = &info->stat[mode];
+	unsigned int target = exynos4_deep_residency(dev);
+
+	if (idle_time < 0)
+		idle_time = 0;
+
+	stat->usage++;
+	stat->time_us += idle_time;
+	stat->exit_us += exit_us;
+	if (exit_us > stat->exit_max_us)
+		stat->exit_max_us = exit_us;
+
+	if (mode == IDLE_MODE_WFI) {
+		if (info->demoted && idle_time >= target)
+			stat->mispredict++;
+	} else if (idle_time < target) {
+		stat->mispredict++;
+	}
+	info->demoted = false;
+
+	info->history[info->history_index] = idle_time;
+	info->history_index = (info->history_index + 1) % IDLE_HISTORY_SIZE;
+}
+
+/*
+ * Whether LOW_POWER is worth entering: the next timer must be further
+ * away than its target residency, and no more than predict_short_max
+ * of the recent idle periods may have ended (by an interrupt) before
+ * that.  The governor only sees the timer and its own averages.
+ */
+static bool exynos4_predict_deep(struct cpuidle_device *dev,
+				 struct cpuidle_state *state)
+{
+	struct exynos4_idle_info *info = &per_cpu(exynos4_idle_info, dev->cpu);
+	unsigned int next_us = ktime_to_us(tick_nohz_get_sleep_length());
+	unsigned int i, nshort = 0;
+
+	if (!predict_enable)
+		return true;
+
+	if (next_us < state->target_residency)
+		return false;
+
+	for (i = 0; i < IDLE_HISTORY_SIZE; i++)
+		if (info->history[i] < state->target_residency)
+			nshort++;
+
+	return nshort <= predict_short_max;
+}
+
 static int exynos4_enter_idle(struct cpuidle_device *dev,
 			      struct cpuidle_state *state);
 
@@ -622,6 +773,8 @@ static int exynos4_enter_idle(struct cpuidle_device *dev,
 	idle_time = (after.tv_sec - before.tv_sec) * USEC_PER_SEC +
 		    (after.tv_usec - before.tv_usec);
 
+	exynos4_idle_account(dev, IDLE_MODE_WFI, idle_time, 0);
+
 	return idle_time;
 }
 
@@ -629,7 +782,7 @@ static int exynos4_check_entermode(void)
 {
 	unsigned int ret;
 
-	if (exynos4_check_operation())
+	if (exynos4_check_operation_cached())
 		ret = S5P_CHECK_DIDLE;
 	else
 		ret = S5P_CHECK_LPA;
@@ -642,12 +795,17 @@ static int exynos4_enter_lowpower(struct cpuidle_device *dev,
 {
 	struct cpuidle_state *new_state = state;
 	unsigned int enter_mode;
+	unsigned int exit_us;
 	unsigned int tmp;
+	int idle_time;
 
 	/* This mode only can be entered when only Core0 is online */
 	if (num_online_cpus() != 1) {
 		BUG_ON(!dev->safe_state);
 		new_state = dev->safe_state;
+	} else if (!exynos4_predict_deep(dev, state)) {
+		new_state = dev->safe_state;
+		per_cpu(exynos4_idle_info, dev->cpu).demoted = true;
 	}
 	dev->last_state = new_state;
 
@@ -661,9 +819,14 @@ static int exynos4_enter_lowpower(struct cpuidle_device *dev,
 
 	enter_mode = exynos4_check_entermode();
 	if (enter_mode == S5P_CHECK_DIDLE) {
-		return exynos4_enter_core0_aftr(dev, new_state);
-	} else
-		return exynos4_enter_core0_lpa(dev, new_state);
+		idle_time = exynos4_enter_core0_aftr(dev, new_state, &exit_us);
+		exynos4_idle_account(dev, IDLE_MODE_AFTR, idle_time, exit_us);
+	} else {
+		idle_time = exynos4_enter_core0_lpa(dev, new_state, &exit_us);
+		exynos4_idle_account(dev, IDLE_MODE_LPA, idle_time, exit_us);
+	}
+
+	return idle_time;
 }
 
 static int exynos4_cpuidle_notifier_event(struct notifier_block *this,
@@ -672,11 +835,13 @@ static int exynos4_cpuidle_notifier_event(struct notifier_block *this,
 {
 	switch (event) {
 	case PM_SUSPEND_PREPARE:
+		exynos4_busy_cache_invalidate();
 		disable_hlt();
 		pr_debug("PM_SUSPEND_PREPARE for CPUIDLE\n");
 		return NOTIFY_OK;
 	case PM_POST_RESTORE:
 	case PM_POST_SUSPEND:
+		exynos4_busy_cache_invalidate();
 		enable_hlt();
 		pr_debug("PM_POST_SUSPEND for CPUIDLE\n");
 		return NOTIFY_OK;
@@ -688,6 +853,112 @@ static struct notifier_block exynos4_cpuidle_notifier = {
 	.notifier_call = exynos4_cpuidle_notifier_event,
 };
 
+/* sysfs interface: /sys/devices/system/cpu/exynos4_idle/ */
+
+static ssize_t show_stats(struct kobject *kobj, struct kobj_attribute *attr,
+			  char *buf)
+{
+	struct exynos4_idle_stat sum;
+	struct exynos4_idle_stat *stat;
+	ssize_t len = 0;
+	int mode, cpu;
+
+	len += sprintf(buf + len, "%-5s %10s %14s %8s %8s %10s\n", "mode",
+		       "usage", "time_us", "exit_avg", "exit_max",
+		       "mispredict");
+
+	for (mode = 0; mode < IDLE_MODE_END; mode++) {
+		memset(&sum, 0, sizeof(sum));
+		for_each_possible_cpu(cpu) {
+			stat = &per_cpu(exynos4_idle_info, cpu).stat[mode];
+			sum.usage += stat->usage;
+			sum.mispredict += stat->mispredict;
+			sum.time_us += stat->time_us;
+			sum.exit_us += stat->exit_us;
+			sum.exit_max_us = max(sum.exit_max_us,
+					      stat->exit_max_us);
+		}
+
+		len += sprintf(buf + len, "%-5s %10u %14llu %8llu %8u %10u\n",
+			       exynos4_idle_mode_name[mode], sum.usage,
+			       sum.time_us,
+			       sum.usage ? div_u64(sum.exit_us, sum.usage) : 0,
+			       sum.exit_max_us, sum.mispredict);
+	}
+
+	return len;
+}
+
+#define show_one(file_name, object)					\
+static ssize_t show_##file_name						\
+(struct kobject *kobj, struct kobj_attribute *attr, char *buf)		\
+{									\
+	return sprintf(buf, "%u\n", object);				\
+}
+
+#define store_one(file_name, object, max)				\
+static ssize_t store_##file_name					\
+(struct kobject *kobj, struct kobj_attribute *attr,			\
+ const char *buf, size_t count)						\
+{									\
+	unsigned int input;						\
+									\
+	if (sscanf(buf, "%u", &input) != 1 || input > (max))		\
+		return -EINVAL;						\
+									\
+	object = input;							\
+	return count;							\
+}
+
+show_one(predict, predict_enable);
+show_one(predict_short_max, predict_short_max);
+show_one(busy_cache_ms, busy_cache_ms);
+show_one(busy_cache_hits, busy_cache_hits);
+
+store_one(predict, predict_enable, 1);
+store_one(predict_short_max, predict_short_max, IDLE_HISTORY_SIZE);
+store_one(busy_cache_ms, busy_cache_ms, 1000);
+
+static struct kobj_attribute stats_attr = __ATTR(stats, 0444,
+		show_stats, NULL);
+static struct kobj_attribute predict_attr = __ATTR(predict, 0644,
+		show_predict, store_predict);
+static struct kobj_attribute predict_short_max_attr =
+	__ATTR(predict_short_max, 0644,
+	       show_predict_short_max, store_predict_short_max);
+static struct kobj_attribute busy_cache_ms_attr = __ATTR(busy_cache_ms, 0644,
+		show_busy_cache_ms, store_busy_cache_ms);
+static struct kobj_attribute busy_cache_hits_attr =
+	__ATTR(busy_cache_hits, 0444, show_busy_cache_hits, NULL);
+
+static struct attribute *exynos4_idle_attributes[] = {
+	&stats_attr.attr,
+	&predict_attr.attr,
+	&predict_short_max_attr.attr,
+	&busy_cache_ms_attr.attr,
+	&busy_cache_hits_attr.attr,
+	NULL
+};
+
+static struct attribute_group exynos4_idle_attr_group = {
+	.attrs = exynos4_idle_attributes,
+};
+
+static void __init exynos4_idle_sysfs_init(void)
+{
+	struct kobject *kobj;
+
+	kobj = kobject_create_and_add("exynos4_idle",
+				      &cpu_sysdev_class.kset.kobj);
+	if (!kobj) {
+		pr_err("%s: failed to create kobject\n", __func__);
+		return;
+	}
+
+	if (sysfs_create_group(kobj, &exynos4_idle_attr_group))
+		pr_err("%s: failed to create attributes group\n", __func__);
+}
+
 #ifdef CONFIG_EXYNOS4_ENABLE_CLOCK_DOWN
 static void __init exynos4_core_down_clk(void)
 {
@@ -826,6 +1097,7 @@ static int __init exynos4_init_cpuidle(void)
 	}
 #endif
 	register_pm_notifier(&exynos4_cpuidle_notifier);
+	exynos4_idle_sysfs_init();
 	sys_pwr_conf_addr = (unsigned long)S5P_CENTRAL_SEQ_CONFIGURATION;
 
 	/* Save register value for L2X0 */
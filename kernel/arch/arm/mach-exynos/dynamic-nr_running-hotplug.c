@@ -14,134 +14,156 @@
 #include <linux/cpufreq.h>
 #include <linux/cpu.h>
 #include <linux/err.h>
+#include <linux/jiffies.h>
+#include <linux/kernel_stat.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
 #include <linux/notifier.h>
 #include <linux/reboot.h>
 #include <linux/suspend.h>
+#include <linux/tick.h>
+#include <linux/workqueue.h>
 #include <plat/cpu.h>
 
-static unsigned int total_num_target_freq;
-static unsigned int ctn_highestlevel_cnt;		/* continuous the highest level count */
-static unsigned int ctn_lowestlevel_cnt;
-static unsigned int ctn_nr_running_over2;
-static unsigned int ctn_nr_running_over3;
-static unsigned int ctn_nr_running_over4;
-static unsigned int ctn_nr_running_under2;
-static unsigned int ctn_nr_running_under3;
-static unsigned int ctn_nr_running_under4;
-static unsigned int freq_max;
-static unsigned int freq_in_trg;
-static unsigned int freq_min;
+#include <mach/hotplug-policy.h>
+
+/*
+ * Every sampling_ms the averaged runqueue depth and the load of each
+ * online CPU are fed to hotplug_policy_decide(), which is shared with
+ * the replay tool in tools/exynos-hotplug.  Sampling runs from its own
+ * workqueue, so CPUs are never brought up or down from within a cpufreq
+ * transition.
+ */
+
+static DEFINE_MUTEX(hotplug_lock);
+static struct hotplug_tunables tunables = HOTPLUG_DEFAULT_TUNABLES;
+static struct hotplug_state state;
+static unsigned int hotplug_sampling_ms = 100;
 static unsigned int can_hotplug;
 
-static void exynos4_integrated_dvfs_hotplug(unsigned int freq_old,
-					unsigned int freq_new)
+static struct workqueue_struct *hotplug_wq;
+static struct delayed_work hotplug_work;
+static u64 last_sample_us;
+
+struct hotplug_cpu_time {
+	u64 idle_us;
+	u64 wall_us;
+	int valid;
+};
+static struct hotplug_cpu_time cpu_time[HOTPLUG_MAX_CPUS];
+
+static u64 hotplug_cpu_idle_us(unsigned int cpu, u64 *wall)
 {
-	total_num_target_freq++;
-	freq_in_trg = 800000;
-
-	if (nr_running() <= 1) {
-		ctn_nr_running_over2 = 0;
-		ctn_nr_running_over3 = 0;
-		ctn_nr_running_over4 = 0;
-		ctn_nr_running_under2++;
-		ctn_nr_running_under3++;
-		ctn_nr_running_under4++;
-	} else if ((nr_running() > 1) && (nr_running() <= 2)) {
-		ctn_nr_running_over2++;
-		ctn_nr_running_over3 = 0;
-		ctn_nr_running_over4 = 0;
-		ctn_nr_running_under2 = 0;
-		ctn_nr_running_under3++;
-		ctn_nr_running_under4++;
-	} else if ((nr_running() > 2) && (nr_running() <= 3)) {
-		ctn_nr_running_over2++;
-		ctn_nr_running_over3++;
-		ctn_nr_running_over4 = 0;
-		ctn_nr_running_under2 = 0;
-		ctn_nr_running_under3 = 0;
-		ctn_nr_running_under4++;
-	} else if (nr_running() > 3) {
-		ctn_nr_running_over2++;
-		ctn_nr_running_over3++;
-		ctn_nr_running_over4++;
-		ctn_nr_running_under2 = 0;
-		ctn_nr_running_under3 = 0;
-		ctn_nr_running_under4 = 0;
-	}
+	cputime64_t busy;
+	u64 idle = get_cpu_idle_time_us(cpu, wall);
 
-	if (soc_is_exynos4412()) {
-		if ((cpu_online(3) == 0) && (nr_running() >= 2)) {
-			if (ctn_nr_running_over2 >= 4) {		/* over 400ms, tunnable */
-				cpu_up(3);
-			}
-		} else if ((cpu_online(2) == 0) && (nr_running() >= 3)) {
-			if (ctn_nr_running_over3 >= 4) {		/* over 400ms, tunnable */
-				cpu_up(2);
-			}
-		} else if ((cpu_online(1) == 0) && (nr_running() >= 4)) {
-			if (ctn_nr_running_over4 >= 8) {		/* over 800ms, tunnable */
-				cpu_up(1);
-			}
-		}
-	} else {
-		if (cpu_online(1) == 0) {
-			if (ctn_nr_running_over2 >= 8) {		/* over 800ms, tunnable */
-				cpu_up(1);
-				ctn_nr_running_over2 = 0;
-			}
-		}
-	} /* end of else */
-	if (soc_is_exynos4412()) {
-		if ((cpu_online(1) == 1) && (nr_running() < 4)) {
-			if (ctn_nr_running_under4 >= 8) {		/* over 800ms, tunnable */
-				cpu_down(1);
-			}
-		} else if ((cpu_online(2) == 1) && (nr_running() < 3)) {
-			if (ctn_nr_running_under3 >= 8) {		/* over 800ms, tunnable */
-				cpu_down(2);
-			}
-		} else if ((cpu_online(3) == 1) && (nr_running() < 2)) {
-			if (ctn_nr_running_under2 >= 8) {		/* over 800ms, tunnable */
-				cpu_down(3);
-			}
+	if (idle != -1ULL)
+		return idle;
+
+	/* No NO_HZ idle accounting, fall back to the jiffy counters */
+	*wall = jiffies_to_usecs(get_jiffies_64());
+	busy = cputime64_add(kstat_cpu(cpu).cpustat.user,
+			     kstat_cpu(cpu).cpustat.system);
+	busy = cputime64_add(busy, kstat_cpu(cpu).cpustat.irq);
+	busy = cputime64_add(busy, kstat_cpu(cpu).cpustat.softirq);
+	busy = cputime64_add(busy, kstat_cpu(cpu).cpustat.steal);
+	busy = cputime64_add(busy, kstat_cpu(cpu).cpustat.nice);
+
+	return *wall - cputime64_to_jiffies64(busy) * (USEC_PER_SEC / HZ);
+}
+
+static void hotplug_take_sample(struct hotplug_sample *s)
+{
+	unsigned int cpu;
+	u64 now = ktime_to_us(ktime_get());
+
+	s->elapsed_ms = last_sample_us ? (now - last_sample_us) / 1000 : 0;
+	last_sample_us = now;
+	s->nr_running = nr_running();
+	s->online = 0;
+
+	for (cpu = 0; cpu < HOTPLUG_MAX_CPUS; cpu++) {
+		struct hotplug_cpu_time *t = &cpu_time[cpu];
+		u64 idle, wall;
+		unsigned int load = 0;
+
+		s->load[cpu] = 0;
+		if (!cpu_online(cpu)) {
+			t->valid = 0;
+			continue;
 		}
-	} else {
-		if (cpu_online(1) == 1) {
-			if (ctn_nr_running_under2 >= 8) {		/* over 800ms, tunnable */
-				cpu_down(1);
-				ctn_nr_running_under2 = 0;
-			}
+		s->online |= 1U << cpu;
+
+		idle = hotplug_cpu_idle_us(cpu, &wall);
+		if (t->valid && wall > t->wall_us) {
+			u64 dwall = wall - t->wall_us;
+			u64 didle = idle - t->idle_us;
+
+			if (didle < dwall)
+				load = div64_u64(100 * (dwall - didle), dwall);
 		}
-	} /* end of else */
+		t->idle_us = idle;
+		t->wall_us = wall;
+		t->valid = 1;
+		s->load[cpu] = load;
+	}
 }
 
-static int hotplug_cpufreq_transition(struct notifier_block *nb,
-					unsigned long val, void *data)
+static void hotplug_timer(struct work_struct *work)
 {
-	struct cpufreq_freqs *freqs = (struct cpufreq_freqs *)data;
+	struct hotplug_sample s;
+	enum hotplug_action action;
+	int cpu;
 
-	if ((val == CPUFREQ_POSTCHANGE) && can_hotplug)
-		exynos4_integrated_dvfs_hotplug(freqs->old, freqs->new);
+	mutex_lock(&hotplug_lock);
 
-	return 0;
+	if (!can_hotplug)
+		goto out;
+
+	hotplug_take_sample(&s);
+	action = hotplug_policy_decide(&tunables, &state, &s, &cpu);
+
+	if (action == HOTPLUG_UP)
+		cpu_up(cpu);
+	else if (action == HOTPLUG_DOWN)
+		cpu_down(cpu);
+
+	queue_delayed_work(hotplug_wq, &hotplug_work,
+			   msecs_to_jiffies(hotplug_sampling_ms));
+out:
+	mutex_unlock(&hotplug_lock);
 }
 
-static struct notifier_block dvfs_hotplug = {
-	.notifier_call = hotplug_cpufreq_transition,
-};
+static void hotplug_start(void)
+{
+	mutex_lock(&hotplug_lock);
+	can_hotplug = 1;
+	last_sample_us = 0;
+	memset(&state, 0, sizeof(state));
+	memset(cpu_time, 0, sizeof(cpu_time));
+	queue_delayed_work(hotplug_wq, &hotplug_work,
+			   msecs_to_jiffies(hotplug_sampling_ms));
+	mutex_unlock(&hotplug_lock);
+}
+
+static void hotplug_stop(void)
+{
+	mutex_lock(&hotplug_lock);
+	can_hotplug = 0;
+	mutex_unlock(&hotplug_lock);
+	cancel_delayed_work_sync(&hotplug_work);
+}
 
 static int hotplug_pm_transition(struct notifier_block *nb,
 					unsigned long val, void *data)
 {
 	switch (val) {
 	case PM_SUSPEND_PREPARE:
-		can_hotplug = 0;
-		ctn_highestlevel_cnt = 0;
-		ctn_lowestlevel_cnt = 0;
+		hotplug_stop();
 		break;
 	case PM_POST_RESTORE:
 	case PM_POST_SUSPEND:
-		can_hotplug = 1;
+		hotplug_start();
 		break;
 	}
 
@@ -152,48 +174,162 @@ static struct notifier_block pm_hotplug = {
 	.notifier_call = hotplug_pm_transition,
 };
 
+/* sysfs interface: /sys/devices/system/cpu/cpufreq/hotplug/ */
+
+#define show_one(file_name, object)					\
+static ssize_t show_##file_name						\
+(struct kobject *kobj, struct attribute *attr, char *buf)		\
+{									\
+	return sprintf(buf, "%u\n", object);				\
+}
+
+#define store_one(file_name, object, min, max)				\
+static ssize_t store_##file_name					\
+(struct kobject *a, struct attribute *b, const char *buf, size_t count)	\
+{									\
+	unsigned int input;						\
+									\
+	if (sscanf(buf, "%u", &input) != 1 || input < (min) ||		\
+	    input > (max))						\
+		return -EINVAL;						\
+									\
+	mutex_lock(&hotplug_lock);					\
+	object = input;							\
+	mutex_unlock(&hotplug_lock);					\
+	return count;							\
+}
+
+show_one(sampling_ms, hotplug_sampling_ms);
+show_one(up_load, tunables.up_load);
+show_one(down_load, tunables.down_load);
+show_one(up_dwell_ms, tunables.up_dwell_ms);
+show_one(down_dwell_ms, tunables.down_dwell_ms);
+show_one(avg_weight, tunables.avg_weight);
+show_one(min_cpus, tunables.min_cpus);
+show_one(max_cpus, tunables.max_cpus);
+show_one(avg_nr_running, state.avg_nr);
+show_one(avg_load, state.avg_load);
+
+store_one(sampling_ms, hotplug_sampling_ms, 10, 10000);
+store_one(up_load, tunables.up_load, 0, 100);
+store_one(down_load, tunables.down_load, 0, 100);
+store_one(up_dwell_ms, tunables.up_dwell_ms, 0, 60000);
+store_one(down_dwell_ms, tunables.down_dwell_ms, 0, 60000);
+store_one(avg_weight, tunables.avg_weight, 1, 1 << HOTPLUG_AVG_SHIFT);
+store_one(min_cpus, tunables.min_cpus, 1, tunables.max_cpus);
+store_one(max_cpus, tunables.max_cpus, tunables.min_cpus,
+	  min_t(unsigned int, num_possible_cpus(), HOTPLUG_MAX_CPUS));
+
 /*
- * Note : This function should be called after intialization of CPUFreq
- * driver for exynos4. The cpufreq_frequency_table for exynos4 should be
- * established before calling this function.
+ * The threshold tables read and write as one value per number of online
+ * CPUs, starting with one CPU online.
  */
-static int __init exynos4_integrated_dvfs_hotplug_init(void)
+static ssize_t show_table(const unsigned int *table, char *buf)
 {
+	ssize_t len = 0;
 	int i;
-	struct cpufreq_frequency_table *table;
-	unsigned int freq;
-
-	total_num_target_freq = 0;
-	ctn_highestlevel_cnt = 0;
-	ctn_lowestlevel_cnt = 0;
-	ctn_nr_running_over2 = 0;
-	ctn_nr_running_over3 = 0;
-	ctn_nr_running_over4 = 0;
-	ctn_nr_running_under2 = 0;
-	ctn_nr_running_under3 = 0;
-	ctn_nr_running_under4 = 0;
 
-	can_hotplug = 1;
+	for (i = 1; i <= HOTPLUG_MAX_CPUS; i++)
+		len += sprintf(buf + len, "%u%s", table[i],
+			       i == HOTPLUG_MAX_CPUS ? "\n" : " ");
+	return len;
+}
 
-	table = cpufreq_frequency_get_table(0);
-	if (IS_ERR(table)) {
-		printk(KERN_ERR "%s: Check loading cpufreq before\n", __func__);
-		return PTR_ERR(table);
-	}
+static ssize_t store_table(unsigned int *table, const char *buf, size_t count)
+{
+	unsigned int val[HOTPLUG_MAX_CPUS];
+	int i;
 
-	for (i = 0; table[i].frequency != CPUFREQ_TABLE_END; i++) {
-		freq = table[i].frequency;
+	if (sscanf(buf, "%u %u %u %u", &val[0], &val[1], &val[2],
+		   &val[3]) != HOTPLUG_MAX_CPUS)
+		return -EINVAL;
 
-		if (freq != CPUFREQ_ENTRY_INVALID && freq > freq_max)
-			freq_max = freq;
-		else if (freq != CPUFREQ_ENTRY_INVALID && freq_min > freq)
-			freq_min = freq;
-	}
+	mutex_lock(&hotplug_lock);
+	for (i = 0; i < HOTPLUG_MAX_CPUS; i++)
+		table[i + 1] = val[i];
+	mutex_unlock(&hotplug_lock);
+	return count;
+}
+
+static ssize_t show_up_nr_running(struct kobject *kobj,
+				  struct attribute *attr, char *buf)
+{
+	return show_table(tunables.up_nr, buf);
+}
+
+static ssize_t store_up_nr_running(struct kobject *a, struct attribute *b,
+				   const char *buf, size_t count)
+{
+	return store_table(tunables.up_nr, buf, count);
+}
+
+static ssize_t show_down_nr_running(struct kobject *kobj,
+				    struct attribute *attr, char *buf)
+{
+	return show_table(tunables.down_nr, buf);
+}
+
+static ssize_t store_down_nr_running(struct kobject *a, struct attribute *b,
+				     const char *buf, size_t count)
+{
+	return store_table(tunables.down_nr, buf, count);
+}
+
+define_one_global_rw(sampling_ms);
+define_one_global_rw(up_load);
+define_one_global_rw(down_load);
+define_one_global_rw(up_dwell_ms);
+define_one_global_rw(down_dwell_ms);
+define_one_global_rw(avg_weight);
+define_one_global_rw(min_cpus);
+define_one_global_rw(max_cpus);
+define_one_global_rw(up_nr_running);
+define_one_global_rw(down_nr_running);
+define_one_global_ro(avg_nr_running);
+define_one_global_ro(avg_load);
+
+static struct attribute *hotplug_attributes[] = {
+	&sampling_ms.attr,
+	&up_load.attr,
+	&down_load.attr,
+	&up_dwell_ms.attr,
+	&down_dwell_ms.attr,
+	&avg_weight.attr,
+	&min_cpus.attr,
+	&max_cpus.attr,
+	&up_nr_running.attr,
+	&down_nr_running.attr,
+	&avg_nr_running.attr,
+	&avg_load.attr,
+	NULL
+};
+
+static struct attribute_group hotplug_attr_group = {
+	.attrs = hotplug_attributes,
+	.name = "hotplug",
+};
+
+static int __init exynos4_integrated_dvfs_hotplug_init(void)
+{
+	int ret;
+
+	tunables.max_cpus = min_t(unsigned int, num_possible_cpus(),
+				  HOTPLUG_MAX_CPUS);
+
+	hotplug_wq = alloc_workqueue("exynos_hotplug",
+				     WQ_UNBOUND | WQ_FREEZABLE, 1);
+	if (!hotplug_wq)
+		return -ENOMEM;
+	INIT_DELAYED_WORK(&hotplug_work, hotplug_timer);
+
+	ret = sysfs_create_group(cpufreq_global_kobject, &hotplug_attr_group);
+	if (ret)
+		pr_err("%s: failed to create sysfs group: %d\n", __func__, ret);
 
 	register_pm_notifier(&pm_hotplug);
+	hotplug_start();
 
-	return cpufreq_register_notifier(&dvfs_hotplug,
-					 CPUFREQ_TRANSITION_NOTIFIER);
+	return 0;
 }
 
 late_initcall(exynos4_integrated_dvfs_hotplug_init);
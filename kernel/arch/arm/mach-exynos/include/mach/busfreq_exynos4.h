@@ -28,6 +28,13 @@ struct opp;
 struct device;
 struct busfreq_table;
 
+/* Transitions into one level, for the trans_latency sysfs file */
+struct busfreq_trans_stat {
+	unsigned int count;
+	unsigned int max_us;
+	unsigned long long total_us;
+};
+
 struct busfreq_data {
 	bool use;
 	struct device *dev;
@@ -44,6 +51,7 @@ struct busfreq_data {
 	struct busfreq_table *table;
 	unsigned long long *time_in_state;
 	unsigned long long last_time;
+	struct busfreq_trans_stat *trans_stat;
 	unsigned int load_history[PPMU_END][LOAD_HISTORY_SIZE];
 	int index;
 
@@ -74,6 +82,7 @@ struct busfreq_table {
 };
 
 void exynos_request_apply(unsigned long freq, bool fix, bool disable);
+void exynos_busfreq_set_ceiling(unsigned int steps);
 struct opp *step_down(struct busfreq_data *data, int step);
 
 int exynos4x12_init(struct device *dev, struct busfreq_data *data, bool pop);
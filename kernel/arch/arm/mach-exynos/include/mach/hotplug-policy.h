@@ -0,0 +1,151 @@
+/* linux/arch/arm/mach-exynos/include/mach/hotplug-policy.h
+ *
+ * EXYNOS - load-weighted CPU hotplug decision
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file must not include any kernel header: tools/exynos-hotplug
+ * builds it on the host to replay recorded load traces through the very
+ * same decision code the kernel runs.
+*/
+
+#ifndef __ASM_ARCH_HOTPLUG_POLICY_H
+#define __ASM_ARCH_HOTPLUG_POLICY_H
+
+#define HOTPLUG_MAX_CPUS	4
+
+/* Weights of the runqueue depth average are out of 1 << HOTPLUG_AVG_SHIFT */
+#define HOTPLUG_AVG_SHIFT	3
+
+/*
+ * Thresholds are indexed by the number of online CPUs: with n CPUs
+ * online, one more is brought up once the averaged runqueue depth
+ * (x100) reaches up_nr[n] and the average load of the online CPUs
+ * reaches up_load, both for up_dwell_ms.  One is taken down once the
+ * depth falls below down_nr[n] and the load below down_load for
+ * down_dwell_ms.  Keeping down_nr[n + 1] below up_nr[n] gives the
+ * hysteresis.
+ */
+struct hotplug_tunables {
+	unsigned int up_nr[HOTPLUG_MAX_CPUS + 1];
+	unsigned int down_nr[HOTPLUG_MAX_CPUS + 1];
+	unsigned int up_load;		/* percent */
+	unsigned int down_load;		/* percent */
+	unsigned int up_dwell_ms;
+	unsigned int down_dwell_ms;
+	unsigned int avg_weight;	/* weight of a new depth sample */
+	unsigned int min_cpus;
+	unsigned int max_cpus;
+};
+
+#define HOTPLUG_DEFAULT_TUNABLES {					\
+	.up_nr		= { 0, 150, 250, 350, -1 },			\
+	.down_nr	= { 0, 0, 110, 210, 310 },			\
+	.up_load	= 50,						\
+	.down_load	= 30,						\
+	.up_dwell_ms	= 200,						\
+	.down_dwell_ms	= 800,						\
+	.avg_weight	= 3,						\
+	.min_cpus	= 1,						\
+	.max_cpus	= HOTPLUG_MAX_CPUS,				\
+}
+
+struct hotplug_state {
+	unsigned int avg_nr;		/* runqueue depth x100 */
+	unsigned int avg_load;		/* of the online CPUs, percent */
+	unsigned int up_ms;
+	unsigned int down_ms;
+};
+
+struct hotplug_sample {
+	unsigned int elapsed_ms;	/* since the previous sample */
+	unsigned int nr_running;
+	unsigned int online;		/* mask, CPU 0 always set */
+	unsigned int load[HOTPLUG_MAX_CPUS];	/* percent, online CPUs */
+};
+
+enum hotplug_action {
+	HOTPLUG_NONE,
+	HOTPLUG_UP,
+	HOTPLUG_DOWN,
+};
+
+/*
+ * Feeds one sample to the policy.  Returns what to do and, unless it is
+ * HOTPLUG_NONE, the CPU to do it to in *cpu: the lowest numbered offline
+ * CPU to bring up or the least loaded online one (never CPU 0) to take
+ * down.
+ */
+static inline enum hotplug_action
+hotplug_policy_decide(const struct hotplug_tunables *t,
+		      struct hotplug_state *st,
+		      const struct hotplug_sample *s, int *cpu)
+{
+	unsigned int i, n = 0, load = 0, min_load = -1;
+	unsigned int w = t->avg_weight;
+	int spare = -1, victim = -1;
+
+	for (i = 0; i < HOTPLUG_MAX_CPUS; i++) {
+		if (!(s->online & (1U << i))) {
+			if (spare < 0)
+				spare = i;
+			continue;
+		}
+		n++;
+		load += s->load[i];
+		if (i && s->load[i] < min_load) {
+			min_load = s->load[i];
+			victim = i;
+		}
+	}
+	if (!n)
+		return HOTPLUG_NONE;
+
+	st->avg_load = load / n;
+	st->avg_nr = (st->avg_nr * ((1U << HOTPLUG_AVG_SHIFT) - w) +
+		      s->nr_running * 100 * w) >> HOTPLUG_AVG_SHIFT;
+
+	/* Limits changed from under us, follow them right away */
+	if (n < t->min_cpus && spare >= 0) {
+		*cpu = spare;
+		goto up;
+	}
+	if (n > t->max_cpus && victim > 0) {
+		*cpu = victim;
+		goto down;
+	}
+
+	if (n < t->max_cpus && spare >= 0 &&
+	    st->avg_nr >= t->up_nr[n] && st->avg_load >= t->up_load) {
+		st->down_ms = 0;
+		st->up_ms += s->elapsed_ms;
+		if (st->up_ms < t->up_dwell_ms)
+			return HOTPLUG_NONE;
+		*cpu = spare;
+		goto up;
+	}
+	st->up_ms = 0;
+
+	if (n > t->min_cpus && victim > 0 &&
+	    st->avg_nr < t->down_nr[n] && st->avg_load < t->down_load) {
+		st->down_ms += s->elapsed_ms;
+		if (st->down_ms < t->down_dwell_ms)
+			return HOTPLUG_NONE;
+		*cpu = victim;
+		goto down;
+	}
+	st->down_ms = 0;
+
+	return HOTPLUG_NONE;
+
+up:
+	st->up_ms = st->down_ms = 0;
+	return HOTPLUG_UP;
+down:
+	st->up_ms = st->down_ms = 0;
+	return HOTPLUG_DOWN;
+}
+
+#endif /* __ASM_ARCH_HOTPLUG_POLICY_H */
@@ -14,6 +14,8 @@
 #define __ASM_ARCH_PPMU_H __FILE__
 
 #define NUMBER_OF_COUNTER	4
+/* Index of the cycle counter in the accumulated totals */
+#define PPMU_CYCLE_COUNTER	NUMBER_OF_COUNTER
 
 #define PPMU_CNTENS	0x10
 #define PPMU_CNTENC	0x20
@@ -94,6 +96,9 @@ struct exynos4_ppmu_hw {
 	int id;
 	struct device *dev;
 	unsigned int count[NUMBER_OF_COUNTER];
+	/* 64-bit totals across resets, event counters then cycles */
+	u64 total[NUMBER_OF_COUNTER + 1];
+	u64 last[NUMBER_OF_COUNTER + 1];
 };
 
 void exynos4_ppc_reset(struct exynos4_ppmu_hw *ppmu);
@@ -109,6 +114,7 @@ void exynos4_ppmu_stop(struct exynos4_ppmu_hw *ppmu);
 void exynos4_ppmu_setevent(struct exynos4_ppmu_hw *ppmu,
 				   unsigned int evt_num);
 unsigned long long exynos4_ppmu_update(struct exynos4_ppmu_hw *ppmu, int ch);
+u64 exynos4_ppmu_read_total(struct exynos4_ppmu_hw *ppmu, int counter);
 
 void ppmu_init(struct exynos4_ppmu_hw *ppmu, struct device *dev);
 void ppmu_start(struct device *dev);
@@ -0,0 +1,113 @@
+/* linux/arch/arm/mach-exynos/include/mach/tmu-pid.h
+ *
+ * EXYNOS - PID controller for stepwise thermal throttling
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This file must not include any kernel header: tools/exynos-tmu builds
+ * it on the host to replay recorded temperature traces through the very
+ * same controller the kernel runs.
+*/
+
+#ifndef __ASM_ARCH_TMU_PID_H
+#define __ASM_ARCH_TMU_PID_H
+
+/*
+ * The output is a throttle: how many cpufreq levels below the fastest
+ * one the upper limit is set, between 0 and the range given by the
+ * caller.  Gains are in thousandths of a level:
+ *   kp per degree above the setpoint,
+ *   ki per degree-second of accumulated error,
+ *   kd per degree/second of temperature rise.
+ * The throttle moves by at most step_down levels (slower) or step_up
+ * levels (faster) per decision, which is what removes the sawtooth of
+ * jumping straight to throttle_freq and back.
+ */
+struct tmu_pid_tunables {
+	int kp;
+	int ki;
+	int kd;
+	int integral_max;		/* degree-ms */
+	unsigned int step_down;
+	unsigned int step_up;
+};
+
+#define TMU_PID_DEFAULT_TUNABLES {					\
+	.kp		= 400,						\
+	.ki		= 60,						\
+	.kd		= 1500,						\
+	.integral_max	= 60000,					\
+	.step_down	= 2,						\
+	.step_up	= 1,						\
+}
+
+struct tmu_pid_state {
+	int integral;			/* degree-ms */
+	int deriv;			/* millidegree per second */
+	int prev_temp;
+	int valid;
+	unsigned int throttle;
+};
+
+static inline void tmu_pid_reset(struct tmu_pid_state *st,
+				 unsigned int throttle)
+{
+	st->integral = 0;
+	st->deriv = 0;
+	st->prev_temp = 0;
+	st->valid = 0;
+	st->throttle = throttle;
+}
+
+/*
+ * Feeds one temperature sample taken dt_ms after the previous one and
+ * returns the new throttle, also left in st->throttle.
+ */
+static inline unsigned int
+tmu_pid_decide(const struct tmu_pid_tunables *t, struct tmu_pid_state *st,
+	       int temp, int setpoint, unsigned int dt_ms, unsigned int range)
+{
+	int err = temp - setpoint;
+	int out, target;
+
+	if (!dt_ms)
+		dt_ms = 1;
+
+	st->deriv = st->valid ? (temp - st->prev_temp) * 1000000 / (int)dt_ms
+			      : 0;
+	st->prev_temp = temp;
+	st->valid = 1;
+
+	out = t->kp * err + t->ki * (st->integral / 1000) +
+	      t->kd * (st->deriv / 1000);
+
+	target = out > 0 ? (out + 500) / 1000 : 0;
+	if (target > (int)range)
+		target = range;
+
+	/* Do not wind up while the output is saturated */
+	if (!(target == (int)range && err > 0) && !(target == 0 && err < 0)) {
+		st->integral += err * (int)dt_ms;
+		if (st->integral > t->integral_max)
+			st->integral = t->integral_max;
+		else if (st->integral < -t->integral_max)
+			st->integral = -t->integral_max;
+	}
+
+	if (st->throttle > range)
+		st->throttle = range;
+
+	if (target > (int)st->throttle) {
+		if ((unsigned int)target - st->throttle > t->step_down)
+			target = st->throttle + t->step_down;
+	} else if (st->throttle - (unsigned int)target > t->step_up) {
+		target = st->throttle - t->step_up;
+	}
+	st->throttle = target;
+
+	return st->throttle;
+}
+
+#endif /* __ASM_ARCH_TMU_PID_H */
@@ -0,0 +1,224 @@
+/* linux/arch/arm/mach-exynos/ppmu-perf.c
+ *
+ * EXYNOS4 - PPMU counters as a perf PMU
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Registers the "exynos_ppmu" PMU.  The event is selected by config:
+ *
+ *   config[7:0]	counter: 0 read data, 1 write data, 3 read+write data,
+ *			4 PPMU cycles
+ *   config[15:8]	PPMU: 0 DMC0, 1 DMC1, 2 CPU
+ *
+ * Data counters count bus transfers, so bandwidth is the count times the
+ * bus width over the elapsed time; dividing by the cycles gives the
+ * utilization busfreq looks at.  For example, the memory traffic of a
+ * media pipeline on both DMC ports:
+ *
+ *   perf stat -a -e exynos_ppmu/config=0x0003/ -e exynos_ppmu/config=0x0103/
+ *
+ * The counters are system wide.  Events can only be opened per CPU,
+ * and only the ones on CPU 0 count, so that "perf stat -a" sums up to
+ * the right value.
+ *
+ * When busfreq owns a PPMU it keeps resetting it; the counts are then
+ * taken from the 64-bit totals that exynos4_ppmu_reset() folds the
+ * hardware counters into, and busfreq decides when the PPMU runs.
+ * Otherwise the PPMU is started for as long as an event uses it.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/io.h>
+#include <linux/perf_event.h>
+#include <linux/spinlock.h>
+#include <linux/timer.h>
+
+#include <plat/cpu.h>
+
+#include <mach/ppmu.h>
+
+#define PPMU_PERF_COUNTER(config)	((config) & 0xff)
+#define PPMU_PERF_ID(config)		(((config) >> 8) & 0xff)
+
+/* Folds often enough for 32-bit counters not to wrap twice at 400MHz */
+#define PPMU_PERF_POLL_MS		5000
+
+static DEFINE_SPINLOCK(ppmu_perf_lock);
+static unsigned int ppmu_perf_users;
+static struct timer_list ppmu_perf_timer;
+
+static struct pmu exynos_ppmu_pmu;
+
+static bool exynos_ppmu_perf_valid(u64 config)
+{
+	unsigned int counter = PPMU_PERF_COUNTER(config);
+	unsigned int id = PPMU_PERF_ID(config);
+
+	if (config >> 16)
+		return false;
+
+	if (id > PPMU_CPU)
+		return false;
+
+	if (counter == PPMU_CYCLE_COUNTER)
+		return true;
+
+	return counter < NUMBER_OF_COUNTER && exynos_ppmu[id].event[counter];
+}
+
+static u64 exynos_ppmu_perf_total(struct perf_event *event)
+{
+	u64 config = event->attr.config;
+
+	if (event->cpu)
+		return 0;
+
+	return exynos4_ppmu_read_total(&exynos_ppmu[PPMU_PERF_ID(config)],
+				       PPMU_PERF_COUNTER(config));
+}
+
+static void exynos_ppmu_perf_update(struct perf_event *event)
+{
+	struct hw_perf_event *hwc = &event->hw;
+	u64 prev, now;
+
+	now = exynos_ppmu_perf_total(event);
+	prev = local64_xchg(&hwc->prev_count, now);
+	local64_add(now - prev, &event->count);
+}
+
+static void exynos_ppmu_perf_poll(unsigned long data)
+{
+	unsigned long flags;
+	int id;
+
+	spin_lock_irqsave(&ppmu_perf_lock, flags);
+	for (id = 0; id <= PPMU_CPU; id++)
+		if (exynos_ppmu[id].usage)
+			exynos4_ppmu_read_total(&exynos_ppmu[id],
+						PPMU_CYCLE_COUNTER);
+
+	if (ppmu_perf_users)
+		mod_timer(&ppmu_perf_timer,
+			  jiffies + msecs_to_jiffies(PPMU_PERF_POLL_MS));
+	spin_unlock_irqrestore(&ppmu_perf_lock, flags);
+}
+
+static int exynos_ppmu_perf_event_init(struct perf_event *event)
+{
+	if (event->attr.type != exynos_ppmu_pmu.type)
+		return -ENOENT;
+
+	/* System wide counters: no sampling, no per-task counting */
+	if (is_sampling_event(event) || event->cpu < 0)
+		return -EOPNOTSUPP;
+
+	if (event->attr.exclude_user || event->attr.exclude_kernel ||
+	    event->attr.exclude_hv || event->attr.exclude_idle)
+		return -EINVAL;
+
+	if (!exynos_ppmu_perf_valid(event->attr.config))
+		return -EINVAL;
+
+	return 0;
+}
+
+static void exynos_ppmu_perf_start(struct perf_event *event, int flags)
+{
+	local64_set(&event->hw.prev_count, exynos_ppmu_perf_total(event));
+	event->hw.state = 0;
+}
+
+static void exynos_ppmu_perf_stop(struct perf_event *event, int flags)
+{
+	if (event->hw.state & PERF_HES_STOPPED)
+		return;
+
+	exynos_ppmu_perf_update(event);
+	event->hw.state |= PERF_HES_STOPPED | PERF_HES_UPTODATE;
+}
+
+static int exynos_ppmu_perf_add(struct perf_event *event, int flags)
+{
+	struct exynos4_ppmu_hw *ppmu;
+	unsigned long irqflags;
+	int i;
+
+	event->hw.state = PERF_HES_STOPPED | PERF_HES_UPTODATE;
+
+	if (!event->cpu) {
+		ppmu = &exynos_ppmu[PPMU_PERF_ID(event->attr.config)];
+
+		spin_lock_irqsave(&ppmu_perf_lock, irqflags);
+		if (!ppmu->usage++ && !ppmu->dev) {
+			for (i = 0; i < NUMBER_OF_COUNTER; i++)
+				if (ppmu->event[i])
+					exynos4_ppmu_setevent(ppmu, i);
+			exynos4_ppmu_reset(ppmu);
+			exynos4_ppmu_start(ppmu);
+		}
+		if (!ppmu_perf_users++)
+			mod_timer(&ppmu_perf_timer,
+				  jiffies + msecs_to_jiffies(PPMU_PERF_POLL_MS));
+		spin_unlock_irqrestore(&ppmu_perf_lock, irqflags);
+	}
+
+	if (flags & PERF_EF_START)
+		exynos_ppmu_perf_start(event, flags);
+
+	return 0;
+}
+
+static void exynos_ppmu_perf_del(struct perf_event *event, int flags)
+{
+	struct exynos4_ppmu_hw *ppmu;
+	unsigned long irqflags;
+
+	exynos_ppmu_perf_stop(event, PERF_EF_UPDATE);
+
+	if (event->cpu)
+		return;
+
+	ppmu = &exynos_ppmu[PPMU_PERF_ID(event->attr.config)];
+
+	spin_lock_irqsave(&ppmu_perf_lock, irqflags);
+	if (!--ppmu->usage && !ppmu->dev)
+		exynos4_ppmu_stop(ppmu);
+	ppmu_perf_users--;
+	spin_unlock_irqrestore(&ppmu_perf_lock, irqflags);
+}
+
+static void exynos_ppmu_perf_read(struct perf_event *event)
+{
+	exynos_ppmu_perf_update(event);
+}
+
+static struct pmu exynos_ppmu_pmu = {
+	.task_ctx_nr	= perf_invalid_context,
+	.event_init	= exynos_ppmu_perf_event_init,
+	.add		= exynos_ppmu_perf_add,
+	.del		= exynos_ppmu_perf_del,
+	.start		= exynos_ppmu_perf_start,
+	.stop		= exynos_ppmu_perf_stop,
+	.read		= exynos_ppmu_perf_read,
+};
+
+static int __init exynos_ppmu_perf_init(void)
+{
+	int ret;
+
+	if (!soc_is_exynos4212() && !soc_is_exynos4412())
+		return 0;
+
+	setup_timer(&ppmu_perf_timer, exynos_ppmu_perf_poll, 0);
+
+	ret = perf_pmu_register(&exynos_ppmu_pmu, "exynos_ppmu", -1);
+	if (ret)
+		pr_err("%s: failed to register PMU (%d)\n", __func__, ret);
+
+	return ret;
+}
+device_initcall(exynos_ppmu_perf_init);
@@ -16,6 +16,8 @@
 #include <linux/io.h>
 #include <linux/list.h>
 #include <linux/math64.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
 
 #include <plat/cpu.h>
 
@@ -24,15 +26,78 @@
 #include <mach/ppmu.h>
 
 static LIST_HEAD(ppmu_list);
+static DEFINE_SPINLOCK(ppmu_total_lock);
 
 unsigned long long ppmu_load[PPMU_END];
 
+/* Counter 3 is 40 bits wide except on 4210, its high byte comes first */
+static u64 exynos4_ppmu_read_counter(struct exynos4_ppmu_hw *ppmu, int ch)
+{
+	void __iomem *ppmu_base = ppmu->hw_base;
+
+	if (ch == 3 && !soc_is_exynos4210())
+		return ((u64)(__raw_readl(ppmu_base + PMCNT_OFFSET(ch)) & 0xff)
+				<< 32) |
+			__raw_readl(ppmu_base + PMCNT_OFFSET(ch + 1));
+
+	return __raw_readl(ppmu_base + PMCNT_OFFSET(ch));
+}
+
+static u64 exynos4_ppmu_counter_mask(int counter)
+{
+	if (counter == 3 && !soc_is_exynos4210())
+		return (1ULL << 40) - 1;
+
+	return 0xffffffffULL;
+}
+
+/*
+ * Adds what the counters went through since the last call to the
+ * 64-bit totals, so that perf can follow them across the resets of the
+ * bus frequency governor.  Called with ppmu_total_lock held.
+ */
+static void exynos4_ppmu_fold(struct exynos4_ppmu_hw *ppmu)
+{
+	u64 val;
+	int i;
+
+	for (i = 0; i <= NUMBER_OF_COUNTER; i++) {
+		if (i == PPMU_CYCLE_COUNTER)
+			val = __raw_readl(ppmu->hw_base + PPMU_CCNT);
+		else
+			val = exynos4_ppmu_read_counter(ppmu, i);
+
+		ppmu->total[i] += (val - ppmu->last[i]) &
+				  exynos4_ppmu_counter_mask(i);
+		ppmu->last[i] = val;
+	}
+}
+
+u64 exynos4_ppmu_read_total(struct exynos4_ppmu_hw *ppmu, int counter)
+{
+	unsigned long flags;
+	u64 total;
+
+	spin_lock_irqsave(&ppmu_total_lock, flags);
+	exynos4_ppmu_fold(ppmu);
+	total = ppmu->total[counter];
+	spin_unlock_irqrestore(&ppmu_total_lock, flags);
+
+	return total;
+}
+
 void exynos4_ppmu_reset(struct exynos4_ppmu_hw *ppmu)
 {
 	void __iomem *ppmu_base = ppmu->hw_base;
+	unsigned long flags;
 	int i;
 
+	spin_lock_irqsave(&ppmu_total_lock, flags);
+	exynos4_ppmu_fold(ppmu);
 	__raw_writel(0x3 << 1, ppmu_base);
+	memset(ppmu->last, 0, sizeof(ppmu->last));
+	spin_unlock_irqrestore(&ppmu_total_lock, flags);
+
 	__raw_writel(0x8000000f, ppmu_base + PPMU_CNTENS);
 
 	if (soc_is_exynos4210())
@@ -74,11 +139,7 @@ unsigned long long exynos4_ppmu_update(struct exynos4_ppmu_hw *ppmu, int ch)
 	if (ch >= NUMBER_OF_COUNTER || ppmu->event[ch] == 0)
 		return 0;
 
-	if (ch == 3 && !soc_is_exynos4210())
-		total = (((u64)__raw_readl(ppmu_base + PMCNT_OFFSET(ch)) << 8) |
-				__raw_readl(ppmu_base + PMCNT_OFFSET(ch + 1)));
-	else
-		total = __raw_readl(ppmu_base + PMCNT_OFFSET(ch));
+	total = exynos4_ppmu_read_counter(ppmu, ch);
 
 	if (total > ppmu->ccnt)
 		total = ppmu->ccnt;
@@ -146,18 +207,24 @@ struct exynos4_ppmu_hw exynos_ppmu[] = {
 	[PPMU_DMC0] = {
 		.id = PPMU_DMC0,
 		.hw_base = S5P_VA_PPMU_DMC0,
+		.event[0] = RD_DATA_COUNT,
+		.event[1] = WR_DATA_COUNT,
 		.event[3] = RDWR_DATA_COUNT,
 		.weight = DEFAULT_WEIGHT,
 	},
 	[PPMU_DMC1] = {
 		.id = PPMU_DMC1,
 		.hw_base = S5P_VA_PPMU_DMC1,
+		.event[0] = RD_DATA_COUNT,
+		.event[1] = WR_DATA_COUNT,
 		.event[3] = RDWR_DATA_COUNT,
 		.weight = DEFAULT_WEIGHT,
 	},
 	[PPMU_CPU] = {
 		.id = PPMU_CPU,
 		.hw_base = S5P_VA_PPMU_CPU,
+		.event[0] = RD_DATA_COUNT,
+		.event[1] = WR_DATA_COUNT,
 		.event[3] = RDWR_DATA_COUNT,
 		.weight = DEFAULT_WEIGHT,
 	},
@@ -165,24 +232,32 @@ struct exynos4_ppmu_hw exynos_ppmu[] = {
 	[PPMU_DDR_C] = {
 		.id = PPMU_DDR_C,
 		.hw_base = S5P_VA_PPMU_DDR_C,
+		.event[0] = RD_DATA_COUNT,
+		.event[1] = WR_DATA_COUNT,
 		.event[3] = RDWR_DATA_COUNT,
 		.weight = DEFAULT_WEIGHT,
 	},
 	[PPMU_DDR_R1] = {
 		.id = PPMU_DDR_R1,
 		.hw_base = S5P_VA_PPMU_DDR_R1,
+		.event[0] = RD_DATA_COUNT,
+		.event[1] = WR_DATA_COUNT,
 		.event[3] = RDWR_DATA_COUNT,
 		.weight = DEFAULT_WEIGHT,
 	},
 	[PPMU_DDR_L] = {
 		.id = PPMU_DDR_L,
 		.hw_base = S5P_VA_PPMU_DDR_L,
+		.event[0] = RD_DATA_COUNT,
+		.event[1] = WR_DATA_COUNT,
 		.event[3] = RDWR_DATA_COUNT,
 		.weight = DEFAULT_WEIGHT,
 	},
 	[PPMU_RIGHT0_BUS] = {
 		.id = PPMU_RIGHT0_BUS,
 		.hw_base = S5P_VA_PPMU_RIGHT0_BUS,
+		.event[0] = RD_DATA_COUNT,
+		.event[1] = WR_DATA_COUNT,
 		.event[3] = RDWR_DATA_COUNT,
 		.weight = DEFAULT_WEIGHT,
 	},
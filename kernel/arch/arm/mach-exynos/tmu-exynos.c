@@ -24,10 +24,15 @@
 #include <linux/io.h>
 #include <linux/irq.h>
 #include <linux/slab.h>
+#include <linux/cpufreq.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/tmu.h>
 
 #include <mach/regs-tmu.h>
 #include <mach/cpufreq.h>
 #include <mach/tmu.h>
+#include <mach/tmu-pid.h>
 #include <mach/asv.h>
 #ifdef CONFIG_BUSFREQ_OPP
 #include <mach/busfreq_exynos4.h>
@@ -43,6 +48,19 @@ unsigned int already_limit;
 unsigned int auto_refresh_changed;
 static struct workqueue_struct  *tmu_monitor_wq;
 
+/*
+ * While throttled, a PID controller over the temperature and its trend
+ * steps the cpufreq upper limit between the fastest level and
+ * throttle_freq, and the bus level down by up to pid_bus_steps, instead
+ * of dropping straight to throttle_freq.  The setpoint is the throttle
+ * start temperature.  The warning and tripping stages are unchanged.
+ */
+static struct tmu_pid_tunables pid_tunables = TMU_PID_DEFAULT_TUNABLES;
+static struct tmu_pid_state pid_state;
+static unsigned int pid_bus_steps = 2;
+static unsigned int pid_fastest_level;
+static unsigned int pid_applied;	/* throttle, in levels */
+
 static void tmu_tripped_cb(void)
 {
 	/* To do */
@@ -325,12 +343,67 @@ static ssize_t store_warning_freq(struct device *dev,
 
 	return count;
 }
+static ssize_t show_throttle_pid(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	ssize_t ret = 0;
+
+	mutex_lock(&tmu_lock);
+	ret += sprintf(buf+ret, "%d %d %d %u %u %u\n",
+			pid_tunables.kp, pid_tunables.ki, pid_tunables.kd,
+			pid_tunables.step_down, pid_tunables.step_up,
+			pid_bus_steps);
+	ret += sprintf(buf+ret, "throttle: %u levels, integral: %d, "
+			"trend: %d mC/s\n", pid_state.throttle,
+			pid_state.integral, pid_state.deriv);
+	mutex_unlock(&tmu_lock);
+
+	ret += sprintf(buf+ret, "\n");
+	ret += sprintf(buf+ret, "[Change usage] echo kp ki kd step_down"
+			" step_up bus_steps > throttle_pid\n");
+	ret += sprintf(buf+ret, "[Example] echo 400 60 1500 2 1 2"
+			" > throttle_pid\n");
+
+	return ret;
+}
+
+static ssize_t store_throttle_pid(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	int kp, ki, kd;
+	unsigned int step_down, step_up, bus_steps;
+
+	if (sscanf(buf, "%d %d %d %u %u %u", &kp, &ki, &kd, &step_down,
+		   &step_up, &bus_steps) != 6) {
+		printk(KERN_ERR "Invaild format!\n");
+		return -EINVAL;
+	}
+
+	if (kp < 0 || ki < 0 || kd < 0 || !step_down || !step_up) {
+		pr_err("[Wrong value] - Gains must not be negative and"
+			" steps must be at least 1\n");
+		return -EINVAL;
+	}
+
+	mutex_lock(&tmu_lock);
+	pid_tunables.kp = kp;
+	pid_tunables.ki = ki;
+	pid_tunables.kd = kd;
+	pid_tunables.step_down = step_down;
+	pid_tunables.step_up = step_up;
+	pid_bus_steps = bus_steps;
+	mutex_unlock(&tmu_lock);
+
+	return count;
+}
+
 static DEVICE_ATTR(temperature, 0444, show_temperature, NULL);
 static DEVICE_ATTR(throttle_temp, 0666, show_throttle, store_throttle);
 static DEVICE_ATTR(warning_temp, 0666, show_warning, store_warning);
 static DEVICE_ATTR(throttle_freq, 0666,
 			show_throttle_freq, store_throttle_freq);
 static DEVICE_ATTR(warning_freq, 0666, show_warning_freq, store_warning_freq);
+static DEVICE_ATTR(throttle_pid, 0644, show_throttle_pid, store_throttle_pid);
 
 static int thermal_create_sysfs_file(struct device *dev)
 {
@@ -357,7 +430,12 @@ static int thermal_create_sysfs_file(struct device *dev)
 	if (device_create_file(dev, &dev_attr_warning_freq)) {
 		pr_err("Failed to create sysfs file [warning_freq]\n");
 		goto out;
-}
+	}
+
+	if (device_create_file(dev, &dev_attr_throttle_pid)) {
+		pr_err("Failed to create sysfs file [throttle_pid]\n");
+		goto out;
+	}
 	return 0;
 out:
 	return -ENOENT;
@@ -370,6 +448,7 @@ static void thermal_remove_sysfs_file(struct device *dev)
 	device_remove_file(dev, &dev_attr_warning_temp);
 	device_remove_file(dev, &dev_attr_throttle_freq);
 	device_remove_file(dev, &dev_attr_warning_freq);
+	device_remove_file(dev, &dev_attr_throttle_pid);
 }
 /* End of Interface sysfs for thermal information */
 
@@ -526,6 +605,93 @@ err_unlock:
 }
 #endif
 
+static unsigned int tmu_pid_range(struct tmu_info *info)
+{
+	return info->throttle_freq > pid_fastest_level ?
+		info->throttle_freq - pid_fastest_level : 0;
+}
+
+static unsigned int tmu_pid_bus_steps(struct tmu_info *info,
+				      unsigned int throttle)
+{
+	unsigned int range = tmu_pid_range(info);
+
+	return range ? throttle * pid_bus_steps / range : 0;
+}
+
+static void tmu_bus_ceiling(unsigned int bus_steps)
+{
+#if defined(CONFIG_BUSFREQ_OPP) && defined(CONFIG_ARCH_EXYNOS4)
+	exynos_busfreq_set_ceiling(bus_steps);
+#endif
+}
+
+static void tmu_pid_apply(unsigned int throttle, unsigned int bus_steps)
+{
+	if (throttle != pid_applied) {
+		if (throttle)
+			exynos_cpufreq_upper_limit(DVFS_LOCK_ID_TMU,
+					pid_fastest_level + throttle);
+		else
+			exynos_cpufreq_upper_limit_free(DVFS_LOCK_ID_TMU);
+		pid_applied = throttle;
+	}
+	tmu_bus_ceiling(bus_steps);
+}
+
+/*
+ * Called with tmu_lock held and the TMU cpufreq limit released.
+ * @slowest starts from the throttle_freq cap rather than from no cap,
+ * for coming back down from the warning stage.
+ */
+static void tmu_pid_start(struct tmu_info *info, bool slowest)
+{
+	struct cpufreq_policy *policy = cpufreq_cpu_get(0);
+	unsigned int throttle;
+
+	pid_fastest_level = L0;
+	if (policy) {
+		exynos_cpufreq_get_level(policy->cpuinfo.max_freq,
+					 &pid_fastest_level);
+		cpufreq_cpu_put(policy);
+	}
+
+	throttle = slowest ? tmu_pid_range(info) : 0;
+	tmu_pid_reset(&pid_state, throttle);
+	pid_applied = 0;
+	tmu_pid_apply(throttle, tmu_pid_bus_steps(info, throttle));
+	already_limit = 1;
+}
+
+/* Called with tmu_lock held */
+static void tmu_pid_stop(void)
+{
+	tmu_pid_apply(0, 0);
+	already_limit = 0;
+}
+
+/* Called with tmu_lock held */
+static void tmu_pid_step(struct tmu_info *info, int cur_temp)
+{
+	struct tmu_data *data = info->dev->platform_data;
+	unsigned int throttle, bus_steps;
+
+	if (!already_limit)
+		tmu_pid_start(info, false);
+
+	throttle = tmu_pid_decide(&pid_tunables, &pid_state, cur_temp,
+				  data->ts.start_throttle,
+				  jiffies_to_msecs(info->sampling_rate),
+				  tmu_pid_range(info));
+	bus_steps = tmu_pid_bus_steps(info, throttle);
+
+	tmu_pid_apply(throttle, bus_steps);
+
+	trace_tmu_pid_decision(cur_temp, data->ts.start_throttle,
+			       pid_state.integral, pid_state.deriv, throttle,
+			       pid_fastest_level + throttle, bus_steps);
+}
+
 static void tmu_monitor(struct work_struct *work)
 {
 	struct delayed_work *delayed_work = to_delayed_work(work);
@@ -571,19 +737,19 @@ static void tmu_monitor(struct work_struct *work)
 	case TMU_STATUS_THROTTLED:
 		if (cur_temp >= data->ts.start_warning) {
 			info->tmu_state = TMU_STATUS_WARNING;
-			exynos_cpufreq_upper_limit_free(DVFS_LOCK_ID_TMU);
+			/*
+			 * warning_freq takes over the cpu; the bus stays at
+			 * its slowest step until the way back to NORMAL.
+			 */
+			tmu_pid_apply(0, pid_bus_steps);
 			already_limit = 0;
 		} else if (cur_temp > data->ts.stop_throttle &&
-				cur_temp < data->ts.start_warning &&
-							!already_limit) {
-			exynos_cpufreq_upper_limit(DVFS_LOCK_ID_TMU,
-				info->throttle_freq);
-			already_limit = 1;
+				cur_temp < data->ts.start_warning) {
+			tmu_pid_step(info, cur_temp);
 		} else if (cur_temp <= data->ts.stop_throttle) {
 			info->tmu_state = TMU_STATUS_NORMAL;
-			exynos_cpufreq_upper_limit_free(DVFS_LOCK_ID_TMU);
+			tmu_pid_stop();
 			pr_info("Freq limit is released!!\n");
-			already_limit = 0;
 		}
 		break;
 
@@ -596,11 +762,13 @@ static void tmu_monitor(struct work_struct *work)
 							!already_limit) {
 			exynos_cpufreq_upper_limit(DVFS_LOCK_ID_TMU,
 							info->warning_freq);
+			tmu_bus_ceiling(pid_bus_steps);
 			already_limit = 1;
 		} else if (cur_temp <= data->ts.stop_warning) {
 			info->tmu_state = TMU_STATUS_THROTTLED;
 			exynos_cpufreq_upper_limit_free(DVFS_LOCK_ID_TMU);
-			already_limit = 0;
+			/* Come back from warning at the slowest PID step */
+			tmu_pid_start(info, true);
 		}
 		break;
 
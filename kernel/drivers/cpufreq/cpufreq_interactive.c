@@ -19,6 +19,9 @@
 #include <linux/cpu.h>
 #include <linux/cpumask.h>
 #include <linux/cpufreq.h>
+#include <linux/err.h>
+#include <linux/input.h>
+#include <linux/ktime.h>
 #include <linux/mutex.h>
 #include <linux/sched.h>
 #include <linux/tick.h>
@@ -27,6 +30,7 @@
 #include <linux/workqueue.h>
 #include <linux/kthread.h>
 #include <linux/mutex.h>
+#include <linux/slab.h>
 
 #include <asm/cputime.h>
 
@@ -41,6 +45,7 @@ struct cpufreq_interactive_cpuinfo {
 	int idling;
 	u64 freq_change_time;
 	u64 freq_change_time_in_idle;
+	u64 hispeed_validate_time;
 	struct cpufreq_policy *policy;
 	struct cpufreq_frequency_table *freq_table;
 	unsigned int target_freq;
@@ -78,6 +83,41 @@ static unsigned long min_sample_time;
 #define DEFAULT_TIMER_RATE 20 * USEC_PER_MSEC
 static unsigned long timer_rate;
 
+/*
+ * Target load for each frequency range, as "load freq:load ...": the
+ * first load applies below the first frequency, each following one
+ * from its frequency up.  The governor picks the lowest frequency
+ * that keeps the load under the target for that frequency.
+ */
+#define DEFAULT_TARGET_LOAD 90
+static unsigned int default_target_loads[] = {DEFAULT_TARGET_LOAD};
+static unsigned int *target_loads = default_target_loads;
+static int ntarget_loads = ARRAY_SIZE(default_target_loads);
+
+/*
+ * Time to wait at or above hispeed_freq before ramping any higher,
+ * in the same format, keyed by the current frequency.
+ */
+#define DEFAULT_ABOVE_HISPEED_DELAY DEFAULT_TIMER_RATE
+static unsigned int default_above_hispeed_delay[] = {
+	DEFAULT_ABOVE_HISPEED_DELAY};
+static unsigned int *above_hispeed_delay = default_above_hispeed_delay;
+static int nabove_hispeed_delay = ARRAY_SIZE(default_above_hispeed_delay);
+
+/* Protects both tables above */
+static DEFINE_SPINLOCK(freq_tables_lock);
+
+/*
+ * Hold at least hispeed_freq while boost is set, or until
+ * boostpulse_endtime after a pulse from userspace or an input event.
+ * The end time is in jiffies so that it can be read without a lock.
+ */
+#define DEFAULT_BOOSTPULSE_DURATION 80 * USEC_PER_MSEC
+static unsigned long boostpulse_duration;
+static unsigned long boostpulse_endtime;
+static int boost_val;
+static int input_boost;
+
 static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 		unsigned int event);
 
@@ -91,6 +131,109 @@ struct cpufreq_governor cpufreq_gov_interactive = {
 	.owner = THIS_MODULE,
 };
 
+static unsigned int freq_to_table_value(unsigned int *table, int ntokens,
+					unsigned int freq)
+{
+	int i;
+
+	for (i = 0; i < ntokens - 1 && freq >= table[i + 1]; i += 2)
+		;
+
+	return table[i];
+}
+
+static unsigned int freq_to_targetload(unsigned int freq)
+{
+	unsigned long flags;
+	unsigned int ret;
+
+	spin_lock_irqsave(&freq_tables_lock, flags);
+	ret = freq_to_table_value(target_loads, ntarget_loads, freq);
+	spin_unlock_irqrestore(&freq_tables_lock, flags);
+	return ret;
+}
+
+static unsigned int freq_to_above_hispeed_delay(unsigned int freq)
+{
+	unsigned long flags;
+	unsigned int ret;
+
+	spin_lock_irqsave(&freq_tables_lock, flags);
+	ret = freq_to_table_value(above_hispeed_delay, nabove_hispeed_delay,
+				  freq);
+	spin_unlock_irqrestore(&freq_tables_lock, flags);
+	return ret;
+}
+
+/*
+ * Lowest frequency at which loadadjfreq (load in percent times the
+ * frequency it was measured at) stays under the target load for that
+ * frequency.  As the target depends on the frequency, iterate until
+ * the choice settles, narrowing [freqmin, freqmax] so it cannot
+ * oscillate between two neighbours.
+ */
+static unsigned int choose_freq(struct cpufreq_interactive_cpuinfo *pcpu,
+				unsigned int loadadjfreq)
+{
+	unsigned int freq = pcpu->policy->cur;
+	unsigned int prevfreq, freqmin = 0, freqmax = UINT_MAX;
+	unsigned int index;
+
+	do {
+		prevfreq = freq;
+
+		if (cpufreq_frequency_table_target(pcpu->policy,
+				pcpu->freq_table,
+				loadadjfreq / freq_to_targetload(freq),
+				CPUFREQ_RELATION_L, &index))
+			break;
+		freq = pcpu->freq_table[index].frequency;
+
+		if (freq > prevfreq) {
+			/* prevfreq is too low, never go back there */
+			freqmin = prevfreq;
+
+			if (freq >= freqmax) {
+				/* Highest frequency below freqmax */
+				if (cpufreq_frequency_table_target(pcpu->policy,
+						pcpu->freq_table, freqmax - 1,
+						CPUFREQ_RELATION_H, &index))
+					break;
+				freq = pcpu->freq_table[index].frequency;
+
+				if (freq == freqmin) {
+					/* Nothing in between, take freqmax */
+					freq = freqmax;
+					break;
+				}
+			}
+		} else if (freq < prevfreq) {
+			/* prevfreq is high enough, never go above it */
+			freqmax = prevfreq;
+
+			if (freq <= freqmin) {
+				/* Lowest frequency above freqmin */
+				if (cpufreq_frequency_table_target(pcpu->policy,
+						pcpu->freq_table, freqmin + 1,
+						CPUFREQ_RELATION_L, &index))
+					break;
+				freq = pcpu->freq_table[index].frequency;
+
+				/* Nothing in between, freqmax it is */
+				if (freq == freqmax)
+					break;
+			}
+		}
+	} while (freq != prevfreq);
+
+	return freq;
+}
+
+static int cpufreq_interactive_boosted(void)
+{
+	return boost_val || time_before(jiffies, ACCESS_ONCE(boostpulse_endtime));
+}
+
 static void cpufreq_interactive_timer(unsigned long data)
 {
 	unsigned int delta_idle;
@@ -163,15 +306,27 @@ static void cpufreq_interactive_timer(unsigned long data)
 	if (load_since_change > cpu_load)
 		cpu_load = load_since_change;
 
-	if (cpu_load >= go_hispeed_load) {
-		if (pcpu->policy->cur == pcpu->policy->min)
-			new_freq = hispeed_freq;
-		else
-			new_freq = pcpu->policy->max * cpu_load / 100;
+	if (cpu_load >= go_hispeed_load && pcpu->policy->cur < hispeed_freq) {
+		new_freq = hispeed_freq;
 	} else {
-		new_freq = pcpu->policy->cur * cpu_load / 100;
+		new_freq = choose_freq(pcpu, cpu_load * pcpu->policy->cur);
+
+		/* Go through hispeed_freq on the way up */
+		if (new_freq > hispeed_freq &&
+		    pcpu->target_freq < hispeed_freq)
+			new_freq = hispeed_freq;
 	}
 
+	if (cpufreq_interactive_boosted() && new_freq < hispeed_freq)
+		new_freq = hispeed_freq;
+
+	/* Above hispeed_freq, only ramp further after above_hispeed_delay */
+	if (pcpu->target_freq >= hispeed_freq &&
+	    new_freq > pcpu->target_freq &&
+	    cputime64_sub(pcpu->timer_run_time, pcpu->hispeed_validate_time) <
+	    freq_to_above_hispeed_delay(pcpu->target_freq))
+		goto rearm;
+
 	if (cpufreq_frequency_table_target(pcpu->policy, pcpu->freq_table,
 					   new_freq, CPUFREQ_RELATION_H,
 					   &index)) {
@@ -203,6 +358,7 @@ static void cpufreq_interactive_timer(unsigned long data)
 		queue_work(down_wq, &freq_scale_down_work);
 	} else {
 		pcpu->target_freq = new_freq;
+		pcpu->hispeed_validate_time = pcpu->timer_run_time;
 		spin_lock_irqsave(&up_cpumask_lock, flags);
 		cpumask_set_cpu(data, &up_cpumask);
 		spin_unlock_irqrestore(&up_cpumask_lock, flags);
@@ -212,9 +368,12 @@ static void cpufreq_interactive_timer(unsigned long data)
 rearm_if_notmax:
 	/*
 	 * Already set max speed and don't see a need to change that,
-	 * wait until next idle to re-evaluate, don't need timer.
+	 * wait until next idle to re-evaluate, don't need timer.  Not
+	 * while boosted though: the CPU may be idle and nothing else
+	 * would bring it down once the boost ends.
 	 */
-	if (pcpu->target_freq == pcpu->policy->max)
+	if (pcpu->target_freq == pcpu->policy->max &&
+	    !cpufreq_interactive_boosted())
 		goto exit;
 
 rearm:
@@ -431,6 +590,282 @@ static void cpufreq_interactive_freq_down(struct work_struct *work)
 	}
 }
 
+/*
+ * Raise every CPU running this governor to hispeed_freq right away,
+ * without waiting for its timer to see the load.  Safe from atomic
+ * context: the up task does the actual frequency change.
+ *
+ * Other CPUs that are idle are left alone: one idle at policy->min
+ * has no timer armed to lower its target_freq again, and would hold
+ * the whole policy at hispeed_freq until it wakes up.  Their timer
+ * applies the boost on idle exit instead.
+ */
+static void cpufreq_interactive_boost(void)
+{
+	unsigned int cpu;
+	unsigned int freq;
+	unsigned long flags;
+	int anyboost = 0;
+	struct cpufreq_interactive_cpuinfo *pcpu;
+	u64 now = ktime_to_us(ktime_get());
+
+	spin_lock_irqsave(&up_cpumask_lock, flags);
+
+	for_each_online_cpu(cpu) {
+		pcpu = &per_cpu(cpuinfo, cpu);
+		smp_rmb();
+
+		if (!pcpu->governor_enabled)
+			continue;
+
+		if (cpu == pcpu->policy->cpu)
+			pcpu->policy->boost_count++;
+
+		if (pcpu->idling && cpu != smp_processor_id())
+			continue;
+
+		freq = min_t(u64, hispeed_freq, pcpu->policy->max);
+		if (pcpu->target_freq < freq) {
+			pcpu->target_freq = freq;
+			pcpu->hispeed_validate_time = now;
+			cpumask_set_cpu(cpu, &up_cpumask);
+			anyboost = 1;
+		}
+	}
+
+	spin_unlock_irqrestore(&up_cpumask_lock, flags);
+
+	if (anyboost)
+		wake_up_process(up_task);
+}
+
+static void cpufreq_interactive_boostpulse(void)
+{
+	unsigned long now = jiffies;
+	int boosted = time_before(now, boostpulse_endtime);
+
+	boostpulse_endtime = now + usecs_to_jiffies(boostpulse_duration);
+
+	/* Extending a pulse already running is not another boost */
+	if (!boosted)
+		cpufreq_interactive_boost();
+}
+
+static void cpufreq_interactive_input_event(struct input_handle *handle,
+					    unsigned int type,
+					    unsigned int code, int value)
+{
+	if (input_boost && atomic_read(&active_count))
+		cpufreq_interactive_boostpulse();
+}
+
+static int cpufreq_interactive_input_connect(struct input_handler *handler,
+					     struct input_dev *dev,
+					     const struct input_device_id *id)
+{
+	struct input_handle *handle;
+	int error;
+
+	handle = kzalloc(sizeof(struct input_handle), GFP_KERNEL);
+	if (!handle)
+		return -ENOMEM;
+
+	handle->dev = dev;
+	handle->handler = handler;
+	handle->name = "cpufreq_interactive";
+
+	error = input_register_handle(handle);
+	if (error)
+		goto err_register;
+
+	error = input_open_device(handle);
+	if (error)
+		goto err_open;
+
+	return 0;
+
+err_open:
+	input_unregister_handle(handle);
+err_register:
+	kfree(handle);
+	return error;
+}
+
+static void cpufreq_interactive_input_disconnect(struct input_handle *handle)
+{
+	input_close_device(handle);
+	input_unregister_handle(handle);
+	kfree(handle);
+}
+
+static const struct input_device_id cpufreq_interactive_ids[] = {
+	/* multi-touch touchscreens */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_EVBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.evbit = { BIT_MASK(EV_ABS) },
+		.absbit = { [BIT_WORD(ABS_MT_POSITION_X)] =
+			    BIT_MASK(ABS_MT_POSITION_X) },
+	},
+	/* single-touch touchscreens and touchpads */
+	{
+		.flags = INPUT_DEVICE_ID_MATCH_KEYBIT |
+			 INPUT_DEVICE_ID_MATCH_ABSBIT,
+		.keybit = { [BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH) },
+		.absbit = { [BIT_WORD(ABS_X)] = BIT_MASK(ABS_X) },
+	},
+	{ },
+};
+
+static struct input_handler cpufreq_interactive_input_handler = {
+	.event		= cpufreq_interactive_input_event,
+	.connect	= cpufreq_interactive_input_connect,
+	.disconnect	= cpufreq_interactive_input_disconnect,
+	.name		= "cpufreq_interactive",
+	.id_table	= cpufreq_interactive_ids,
+};
+
+/*
+ * Parses "value freq:value freq:value ..." into a kmalloc'ed array of
+ * an odd number of tokens, frequencies in ascending order.
+ */
+static unsigned int *get_tokenized_data(const char *buf, int *num_tokens)
+{
+	const char *cp;
+	int i;
+	int ntokens = 1;
+	unsigned int *tokenized_data;
+	int err = -EINVAL;
+
+	cp = buf;
+	while ((cp = strpbrk(cp + 1, " :")))
+		ntokens++;
+
+	if (!(ntokens & 0x1))
+		goto err;
+
+	tokenized_data = kmalloc(ntokens * sizeof(unsigned int), GFP_KERNEL);
+	if (!tokenized_data) {
+		err = -ENOMEM;
+		goto err;
+	}
+
+	cp = buf;
+	i = 0;
+	while (i < ntokens) {
+		if (sscanf(cp, "%u", &tokenized_data[i++]) != 1)
+			goto err_kfree;
+
+		cp = strpbrk(cp, " :");
+		if (!cp)
+			break;
+		cp++;
+	}
+
+	if (i != ntokens)
+		goto err_kfree;
+
+	for (i = 3; i < ntokens; i += 2)
+		if (tokenized_data[i] <= tokenized_data[i - 2])
+			goto err_kfree;
+
+	*num_tokens = ntokens;
+	return tokenized_data;
+
+err_kfree:
+	kfree(tokenized_data);
+err:
+	return ERR_PTR(err);
+}
+
+static ssize_t show_freq_table(unsigned int **table, int *ntokens, char *buf)
+{
+	unsigned long flags;
+	ssize_t ret = 0;
+	int i;
+
+	spin_lock_irqsave(&freq_tables_lock, flags);
+	for (i = 0; i < *ntokens; i++)
+		ret += sprintf(buf + ret, "%u%s", (*table)[i],
+			       i & 0x1 ? ":" : " ");
+	spin_unlock_irqrestore(&freq_tables_lock, flags);
+
+	/* Replace the trailing separator */
+	buf[ret - 1] = '\n';
+	return ret;
+}
+
+static int store_freq_table(unsigned int **table, int *ntokens,
+			    unsigned int *default_table, const char *buf,
+			    bool nonzero)
+{
+	unsigned int *new_table, *old_table;
+	unsigned long flags;
+	int new_ntokens;
+	int i;
+
+	new_table = get_tokenized_data(buf, &new_ntokens);
+	if (IS_ERR(new_table))
+		return PTR_ERR(new_table);
+
+	for (i = 0; nonzero && i < new_ntokens; i += 2) {
+		if (!new_table[i]) {
+			kfree(new_table);
+			return -EINVAL;
+		}
+	}
+
+	spin_lock_irqsave(&freq_tables_lock, flags);
+	old_table = *table;
+	*table = new_table;
+	*ntokens = new_ntokens;
+	spin_unlock_irqrestore(&freq_tables_lock, flags);
+
+	if (old_table != default_table)
+		kfree(old_table);
+	return 0;
+}
+
+static ssize_t show_target_loads(struct kobject *kobj,
+				 struct attribute *attr, char *buf)
+{
+	return show_freq_table(&target_loads, &ntarget_loads, buf);
+}
+
+static ssize_t store_target_loads(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+
+	ret = store_freq_table(&target_loads, &ntarget_loads,
+			       default_target_loads, buf, true);
+	return ret ? ret : count;
+}
+
+static struct global_attr target_loads_attr = __ATTR(target_loads, 0644,
+		show_target_loads, store_target_loads);
+
+static ssize_t show_above_hispeed_delay(struct kobject *kobj,
+					struct attribute *attr, char *buf)
+{
+	return show_freq_table(&above_hispeed_delay, &nabove_hispeed_delay,
+			       buf);
+}
+
+static ssize_t store_above_hispeed_delay(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+
+	ret = store_freq_table(&above_hispeed_delay, &nabove_hispeed_delay,
+			       default_above_hispeed_delay, buf, false);
+	return ret ? ret : count;
+}
+
+static struct global_attr above_hispeed_delay_attr =
+	__ATTR(above_hispeed_delay, 0644,
+	       show_above_hispeed_delay, store_above_hispeed_delay);
+
 static ssize_t show_hispeed_freq(struct kobject *kobj,
 				 struct attribute *attr, char *buf)
 {
@@ -521,11 +956,98 @@ static ssize_t store_timer_rate(struct kobject *kobj,
 static struct global_attr timer_rate_attr = __ATTR(timer_rate, 0644,
 		show_timer_rate, store_timer_rate);
 
+static ssize_t show_boost(struct kobject *kobj, struct attribute *attr,
+			  char *buf)
+{
+	return sprintf(buf, "%d\n", boost_val);
+}
+
+static ssize_t store_boost(struct kobject *kobj, struct attribute *attr,
+			   const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+
+	boost_val = !!val;
+	if (boost_val)
+		cpufreq_interactive_boost();
+
+	return count;
+}
+
+static struct global_attr boost_attr = __ATTR(boost, 0644,
+		show_boost, store_boost);
+
+static ssize_t store_boostpulse(struct kobject *kobj, struct attribute *attr,
+				const char *buf, size_t count)
+{
+	cpufreq_interactive_boostpulse();
+	return count;
+}
+
+static struct global_attr boostpulse_attr = __ATTR(boostpulse, 0200,
+		NULL, store_boostpulse);
+
+static ssize_t show_boostpulse_duration(struct kobject *kobj,
+					struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", boostpulse_duration);
+}
+
+static ssize_t store_boostpulse_duration(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	boostpulse_duration = val;
+	return count;
+}
+
+static struct global_attr boostpulse_duration_attr =
+	__ATTR(boostpulse_duration, 0644,
+	       show_boostpulse_duration, store_boostpulse_duration);
+
+static ssize_t show_input_boost(struct kobject *kobj,
+				struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", input_boost);
+}
+
+static ssize_t store_input_boost(struct kobject *kobj,
+			struct attribute *attr, const char *buf, size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	input_boost = !!val;
+	return count;
+}
+
+static struct global_attr input_boost_attr = __ATTR(input_boost, 0644,
+		show_input_boost, store_input_boost);
+
 static struct attribute *interactive_attributes[] = {
 	&hispeed_freq_attr.attr,
 	&go_hispeed_load_attr.attr,
 	&min_sample_time_attr.attr,
 	&timer_rate_attr.attr,
+	&target_loads_attr.attr,
+	&above_hispeed_delay_attr.attr,
+	&boost_attr.attr,
+	&boostpulse_attr.attr,
+	&boostpulse_duration_attr.attr,
+	&input_boost_attr.attr,
 	NULL,
 };
 
@@ -558,6 +1080,7 @@ static int cpufreq_governor_interactive(struct cpufreq_policy *policy,
 			pcpu->freq_change_time_in_idle =
 				get_cpu_idle_time_us(j,
 					     &pcpu->freq_change_time);
+			pcpu->hispeed_validate_time = pcpu->freq_change_time;
 			pcpu->governor_enabled = 1;
 			smp_wmb();
 		}
@@ -645,6 +1168,10 @@ static int __init cpufreq_interactive_init(void)
 	go_hispeed_load = DEFAULT_GO_HISPEED_LOAD;
 	min_sample_time = DEFAULT_MIN_SAMPLE_TIME;
 	timer_rate = DEFAULT_TIMER_RATE;
+	boostpulse_duration = DEFAULT_BOOSTPULSE_DURATION;
+	/* jiffies starts out close to wrapping */
+	boostpulse_endtime = jiffies;
+	input_boost = 1;
 
 	/* Initalize per-cpu timers */
 	for_each_possible_cpu(i) {
@@ -678,6 +1205,9 @@ static int __init cpufreq_interactive_init(void)
 
 	idle_notifier_register(&cpufreq_interactive_idle_nb);
 
+	if (input_register_handler(&cpufreq_interactive_input_handler))
+		pr_warn("%s: failed to register input handler\n", __func__);
+
 	return cpufreq_register_governor(&cpufreq_gov_interactive);
 
 err_freeuptask:
@@ -694,6 +1224,7 @@ module_init(cpufreq_interactive_init);
 static void __exit cpufreq_interactive_exit(void)
 {
 	cpufreq_unregister_governor(&cpufreq_gov_interactive);
+	input_unregister_handler(&cpufreq_interactive_input_handler);
 	kthread_stop(up_task);
 	put_task_struct(up_task);
 	destroy_workqueue(down_wq);
@@ -77,6 +77,11 @@ static ssize_t show_total_trans(struct cpufreq_policy *policy, char *buf)
 			per_cpu(cpufreq_stats_table, stat->cpu)->total_trans);
 }
 
+static ssize_t show_boost_count(struct cpufreq_policy *policy, char *buf)
+{
+	return sprintf(buf, "%u\n", policy->boost_count);
+}
+
 static ssize_t show_time_in_state(struct cpufreq_policy *policy, char *buf)
 {
 	ssize_t len = 0;
@@ -142,10 +147,12 @@ CPUFREQ_STATDEVICE_ATTR(trans_table, 0444, show_trans_table);
 
 CPUFREQ_STATDEVICE_ATTR(total_trans, 0444, show_total_trans);
 CPUFREQ_STATDEVICE_ATTR(time_in_state, 0444, show_time_in_state);
+CPUFREQ_STATDEVICE_ATTR(boost_count, 0444, show_boost_count);
 
 static struct attribute *default_attrs[] = {
 	&_attr_total_trans.attr,
 	&_attr_time_in_state.attr,
+	&_attr_boost_count.attr,
 #ifdef CONFIG_CPU_FREQ_STAT_DETAILS
 	&_attr_trans_table.attr,
 #endif
@@ -26,6 +26,10 @@
 #include <linux/bitops.h>
 #include <linux/pagemap.h>
 #include <linux/dma-mapping.h>
+#include <linux/highmem.h>
+#include <linux/spinlock.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <asm/pgtable.h>
 
@@ -51,6 +55,170 @@ static struct device *exynos_ion_dev;
 
 static int orders[] = {PAGE_SHIFT + 8, PAGE_SHIFT + 4, PAGE_SHIFT, 0};
 
+/*
+ * Page pools of the exynos heap, one per entry of orders[]. Freed chunks are
+ * zeroed and kept in the pool of their order instead of going back to the
+ * buddy allocator, so that the next buffer allocation takes them without
+ * entering the page allocator or clearing them. The shrinker gives them
+ * back under memory pressure.
+ */
+struct exynos_page_pool {
+	spinlock_t lock;
+	struct list_head items;		/* chunks, linked by page->lru */
+	unsigned int order;		/* gfp order of the chunks */
+	unsigned long count;		/* no. of chunks in the pool */
+	unsigned long hits;		/* allocations served by the pool */
+	unsigned long misses;		/* allocations that found it empty */
+};
+
+static struct exynos_page_pool page_pools[ARRAY_SIZE(orders) - 1];
+
+static struct exynos_page_pool *page_pool_find(unsigned int order)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(page_pools); i++)
+		if (page_pools[i].order == order)
+			return &page_pools[i];
+	return NULL;
+}
+
+static struct page *page_pool_alloc(struct exynos_page_pool *pool)
+{
+	struct page *page = NULL;
+
+	spin_lock(&pool->lock);
+	if (pool->count) {
+		page = list_first_entry(&pool->items, struct page, lru);
+		list_del(&page->lru);
+		pool->count--;
+		pool->hits++;
+	} else {
+		pool->misses++;
+	}
+	spin_unlock(&pool->lock);
+
+	if (page)
+		return page;
+
+	return alloc_pages(GFP_HIGHUSER | __GFP_ZERO | __GFP_COMP |
+			   __GFP_NOWARN | __GFP_NORETRY, pool->order);
+}
+
+static void page_pool_free(struct page *page, unsigned int order)
+{
+	struct exynos_page_pool *pool = page_pool_find(order);
+	int i;
+
+	if (!pool) {
+		__free_pages(page, order);
+		return;
+	}
+
+	for (i = 0; i < (1 << order); i++)
+		clear_highpage(page + i);
+
+	spin_lock(&pool->lock);
+	list_add_tail(&page->lru, &pool->items);
+	pool->count++;
+	spin_unlock(&pool->lock);
+}
+
+static unsigned long page_pool_total(void)
+{
+	unsigned long total = 0;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(page_pools); i++)
+		total += page_pools[i].count << page_pools[i].order;
+	return total;
+}
+
+/*
+ * page_pool_shrink - give up to 'nr_to_scan' pooled pages back to the buddy
+ * allocator, largest chunks first, and return the no. of pages left.
+ */
+static int page_pool_shrink(struct shrinker *shrinker,
+			    struct shrink_control *sc)
+{
+	long nr = sc->nr_to_scan;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(page_pools) && nr > 0; i++) {
+		struct exynos_page_pool *pool = &page_pools[i];
+		struct page *page;
+
+		while (nr > 0) {
+			spin_lock(&pool->lock);
+			if (!pool->count) {
+				spin_unlock(&pool->lock);
+				break;
+			}
+			page = list_first_entry(&pool->items, struct page, lru);
+			list_del(&page->lru);
+			pool->count--;
+			spin_unlock(&pool->lock);
+
+			__free_pages(page, pool->order);
+			nr -= 1 << pool->order;
+		}
+	}
+
+	return page_pool_total();
+}
+
+static struct shrinker page_pool_shrinker = {
+	.shrink = page_pool_shrink,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int page_pool_debug_show(struct seq_file *s, void *unused)
+{
+	int i;
+
+	seq_printf(s, "%8s %10s %10s %12s %12s\n",
+		   "order", "chunks", "pages", "hits", "misses");
+	for (i = 0; i < ARRAY_SIZE(page_pools); i++) {
+		struct exynos_page_pool *pool = &page_pools[i];
+
+		spin_lock(&pool->lock);
+		seq_printf(s, "%8u %10lu %10lu %12lu %12lu\n", pool->order,
+			   pool->count, pool->count << pool->order,
+			   pool->hits, pool->misses);
+		spin_unlock(&pool->lock);
+	}
+	seq_printf(s, "total %lu pages\n", page_pool_total());
+
+	return 0;
+}
+
+static int page_pool_debug_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, page_pool_debug_show, inode->i_private);
+}
+
+static const struct file_operations page_pool_debug_fops = {
+	.open = page_pool_debug_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void __init page_pool_init(void)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(page_pools); i++) {
+		spin_lock_init(&page_pools[i].lock);
+		INIT_LIST_HEAD(&page_pools[i].items);
+		page_pools[i].order = orders[i] - PAGE_SHIFT;
+	}
+
+	register_shrinker(&page_pool_shrinker);
+	debugfs_create_file("ion_exynos_page_pool", 0444, NULL, NULL,
+			    &page_pool_debug_fops);
+}
+
 static inline phys_addr_t *get_imbufs(int idx,
 		phys_addr_t *lv0imbufs, phys_addr_t **lv1pimbufs,
 		phys_addr_t ***lv2ppimbufs)
@@ -127,9 +295,7 @@ static int ion_exynos_heap_allocate(struct ion_heap *heap,
 			continue;
 		}
 
-		page = alloc_pages(GFP_HIGHUSER | __GFP_COMP |
-						__GFP_NOWARN | __GFP_NORETRY,
-						*cur_order - PAGE_SHIFT);
+		page = page_pool_alloc(&page_pools[cur_order - orders]);
 		if (!page) {
 			cur_order++;
 			continue;
@@ -250,7 +416,7 @@ alloc_error:
 				phys = cur_bufs[i];
 				gfp_order = (phys & ~PAGE_MASK) - PAGE_SHIFT;
 				phys = phys & PAGE_MASK;
-				__free_pages(phys_to_page(phys), gfp_order);
+				page_pool_free(phys_to_page(phys), gfp_order);
 			}
 		}
 
@@ -268,7 +434,7 @@ static void ion_exynos_heap_free(struct ion_buffer *buffer)
 	struct sg_table *sgtable = buffer->priv_virt;
 
 	for_each_sg(sgtable->sgl, sg, sgtable->orig_nents, i)
-		__free_pages(sg_page(sg), __ffs(sg_dma_len(sg)) - PAGE_SHIFT);
+		page_pool_free(sg_page(sg), __ffs(sg_dma_len(sg)) - PAGE_SHIFT);
 
 	sg_free_table(sgtable);
 	kfree(sgtable);
@@ -392,11 +558,14 @@ static struct ion_heap *ion_exynos_heap_create(struct ion_platform_heap *unused)
 		return ERR_PTR(-ENOMEM);
 	heap->ops = &vmheap_ops;
 	heap->type = ION_HEAP_TYPE_EXYNOS;
+	/* freeing zeroes the chunks for the page pools, do it off-line */
+	heap->flags = ION_HEAP_FLAG_DEFER_FREE;
 	return heap;
 }
 
 static void ion_exynos_heap_destroy(struct ion_heap *heap)
 {
+	ion_heap_deinit_deferred_free(heap);
 	kfree(heap);
 }
 
@@ -969,6 +1138,7 @@ static struct platform_driver ion_driver = {
 
 static int __init ion_init(void)
 {
+	page_pool_init();
 	return platform_driver_register(&ion_driver);
 }
 
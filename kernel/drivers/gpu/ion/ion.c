@@ -159,22 +159,32 @@ static struct ion_buffer *ion_buffer_create(struct ion_heap *heap,
 	return buffer;
 }
 
+void ion_buffer_free(struct ion_buffer *buffer)
+{
+	buffer->heap->ops->free(buffer);
+	kfree(buffer);
+}
+
 static void ion_buffer_destroy(struct kref *kref)
 {
 	struct ion_buffer *buffer = container_of(kref, struct ion_buffer, ref);
+	struct ion_heap *heap = buffer->heap;
 	struct ion_device *dev = buffer->dev;
 
 	if (WARN_ON(buffer->kmap_cnt > 0))
-		buffer->heap->ops->unmap_kernel(buffer->heap, buffer);
+		heap->ops->unmap_kernel(heap, buffer);
 
 	if (WARN_ON(buffer->dmap_cnt > 0))
-		buffer->heap->ops->unmap_dma(buffer->heap, buffer);
+		heap->ops->unmap_dma(heap, buffer);
 
-	buffer->heap->ops->free(buffer);
 	mutex_lock(&dev->lock);
 	rb_erase(&buffer->node, &dev->buffers);
 	mutex_unlock(&dev->lock);
-	kfree(buffer);
+
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE)
+		ion_heap_freelist_add(heap, buffer);
+	else
+		ion_buffer_free(buffer);
 }
 
 static void ion_buffer_get(struct ion_buffer *buffer)
@@ -293,6 +303,8 @@ struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 	struct ion_handle *handle;
 	struct ion_device *dev = client->dev;
 	struct ion_buffer *buffer = NULL;
+	bool retried = false;
+	bool nomem;
 
 	/*
 	 * traverse the list of heaps available in this system in priority
@@ -306,6 +318,8 @@ struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 	len = PAGE_ALIGN(len);
 
 	mutex_lock(&dev->lock);
+retry:
+	nomem = false;
 	for (n = rb_first(&dev->heaps); n != NULL; n = rb_next(n)) {
 		struct ion_heap *heap = rb_entry(n, struct ion_heap, node);
 		/* if the client doesn't support this heap type */
@@ -317,6 +331,30 @@ struct ion_handle *ion_alloc(struct ion_client *client, size_t len,
 		buffer = ion_buffer_create(heap, dev, len, align, flags);
 		if (!IS_ERR_OR_NULL(buffer))
 			break;
+		if (PTR_ERR(buffer) == -ENOMEM)
+			nomem = true;
+	}
+
+	/*
+	 * If any heap ran out of memory, some may still be waiting on the
+	 * deferred free lists; release it now and try once more before
+	 * failing.
+	 */
+	if (IS_ERR_OR_NULL(buffer) && nomem && !retried) {
+		size_t drained = 0;
+
+		retried = true;
+		for (n = rb_first(&dev->heaps); n != NULL; n = rb_next(n)) {
+			struct ion_heap *heap = rb_entry(n, struct ion_heap,
+							 node);
+
+			if (heap->flags & ION_HEAP_FLAG_DEFER_FREE)
+				drained += ion_heap_freelist_drain(heap, 0);
+		}
+		if (drained) {
+			buffer = NULL;
+			goto retry;
+		}
 	}
 	mutex_unlock(&dev->lock);
 
@@ -1285,6 +1323,9 @@ static int ion_debug_heap_show(struct seq_file *s, void *unused)
 		seq_printf(s, "%16.s %16u %16u\n", client->name, client->pid,
 			   size);
 	}
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE)
+		seq_printf(s, "%16.s %16.s %16u\n", "deferred free", "",
+			   ion_heap_freelist_size(heap));
 	return 0;
 }
 
@@ -1323,6 +1364,9 @@ void ion_device_add_heap(struct ion_device *dev, struct ion_heap *heap)
 		}
 	}
 
+	if (heap->flags & ION_HEAP_FLAG_DEFER_FREE)
+		ion_heap_init_deferred_free(heap);
+
 	rb_link_node(&heap->node, parent, p);
 	rb_insert_color(&heap->node, &dev->heaps);
 	debugfs_create_file(heap->name, 0664, dev->debug_root, heap,
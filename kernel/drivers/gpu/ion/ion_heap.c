@@ -15,7 +15,12 @@
  */
 
 #include <linux/err.h>
+#include <linux/freezer.h>
 #include <linux/ion.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
 #include "ion_priv.h"
 
 struct ion_heap *ion_heap_create(struct ion_platform_heap *heap_data)
@@ -70,3 +75,112 @@ void ion_heap_destroy(struct ion_heap *heap)
 		       heap->type);
 	}
 }
+
+void ion_heap_freelist_add(struct ion_heap *heap, struct ion_buffer *buffer)
+{
+	spin_lock(&heap->free_lock);
+	list_add_tail(&buffer->list, &heap->free_list);
+	heap->free_list_size += buffer->size;
+	spin_unlock(&heap->free_lock);
+	wake_up(&heap->waitqueue);
+}
+
+size_t ion_heap_freelist_size(struct ion_heap *heap)
+{
+	size_t size;
+
+	spin_lock(&heap->free_lock);
+	size = heap->free_list_size;
+	spin_unlock(&heap->free_lock);
+
+	return size;
+}
+
+/* take the oldest buffer off the free list, or NULL if it is empty */
+static struct ion_buffer *ion_heap_freelist_pop(struct ion_heap *heap)
+{
+	struct ion_buffer *buffer = NULL;
+
+	spin_lock(&heap->free_lock);
+	if (!list_empty(&heap->free_list)) {
+		buffer = list_first_entry(&heap->free_list, struct ion_buffer,
+					  list);
+		list_del(&buffer->list);
+		heap->free_list_size -= buffer->size;
+	}
+	spin_unlock(&heap->free_lock);
+
+	return buffer;
+}
+
+size_t ion_heap_freelist_drain(struct ion_heap *heap, size_t size)
+{
+	struct ion_buffer *buffer;
+	size_t total_drained = 0;
+
+	if (!size)
+		size = ion_heap_freelist_size(heap);
+
+	while (total_drained < size) {
+		buffer = ion_heap_freelist_pop(heap);
+		if (!buffer)
+			break;
+		total_drained += buffer->size;
+		ion_buffer_free(buffer);
+	}
+
+	return total_drained;
+}
+
+static int ion_heap_deferred_free(void *data)
+{
+	struct ion_heap *heap = data;
+	struct ion_buffer *buffer;
+
+	set_freezable();
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(heap->waitqueue,
+				     ion_heap_freelist_size(heap) > 0 ||
+				     kthread_should_stop());
+
+		buffer = ion_heap_freelist_pop(heap);
+		if (buffer)
+			ion_buffer_free(buffer);
+	}
+
+	return 0;
+}
+
+int ion_heap_init_deferred_free(struct ion_heap *heap)
+{
+	struct sched_param param = { .sched_priority = 0 };
+
+	INIT_LIST_HEAD(&heap->free_list);
+	heap->free_list_size = 0;
+	spin_lock_init(&heap->free_lock);
+	init_waitqueue_head(&heap->waitqueue);
+
+	heap->task = kthread_run(ion_heap_deferred_free, heap, "ion_%s",
+				 heap->name);
+	if (IS_ERR(heap->task)) {
+		pr_err("%s: creating thread for deferred free failed\n",
+		       __func__);
+		heap->task = NULL;
+		heap->flags &= ~ION_HEAP_FLAG_DEFER_FREE;
+		return -ENOMEM;
+	}
+	sched_setscheduler(heap->task, SCHED_IDLE, &param);
+
+	return 0;
+}
+
+void ion_heap_deinit_deferred_free(struct ion_heap *heap)
+{
+	if (!heap->task)
+		return;
+
+	kthread_stop(heap->task);
+	heap->task = NULL;
+	ion_heap_freelist_drain(heap, 0);
+}
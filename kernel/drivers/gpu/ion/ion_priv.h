@@ -21,6 +21,8 @@
 #include <linux/mm_types.h>
 #include <linux/mutex.h>
 #include <linux/rbtree.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
 #include <linux/ion.h>
 
 struct ion_mapping;
@@ -41,6 +43,7 @@ struct ion_buffer *ion_handle_buffer(struct ion_handle *handle);
  * struct ion_buffer - metadata for a particular buffer
  * @ref:		refernce count
  * @node:		node in the ion_device buffers tree
+ * @list:		element in the heap's deferred free list
  * @dev:		back pointer to the ion_device
  * @heap:		back pointer to the heap the buffer came from
  * @flags:		buffer specific flags
@@ -58,6 +61,7 @@ struct ion_buffer *ion_handle_buffer(struct ion_handle *handle);
 struct ion_buffer {
 	struct kref ref;
 	struct rb_node node;
+	struct list_head list;
 	struct ion_device *dev;
 	struct ion_heap *heap;
 	unsigned long flags;
@@ -101,16 +105,27 @@ struct ion_heap_ops {
 			 struct vm_area_struct *vma);
 };
 
+/**
+ * heap flags - flags between the heaps and core ion code
+ */
+#define ION_HEAP_FLAG_DEFER_FREE (1 << 0)
+
 /**
  * struct ion_heap - represents a heap in the system
  * @node:		rb node to put the heap on the device's tree of heaps
  * @dev:		back pointer to the ion_device
  * @type:		type of heap
  * @ops:		ops struct as above
+ * @flags:		flags
  * @id:			id of heap, also indicates priority of this heap when
  *			allocating.  These are specified by platform data and
  *			MUST be unique
  * @name:		used for debugging
+ * @free_list:		free list head if deferred free is used
+ * @free_list_size:	size of the deferred free list in bytes
+ * @free_lock:		protects the free list
+ * @waitqueue:		queue to wait on from deferred free thread
+ * @task:		task struct of deferred free thread
  *
  * Represents a pool of memory from which buffers can be made.  In some
  * systems the only heap is regular system memory allocated via vmalloc.
@@ -122,10 +137,22 @@ struct ion_heap {
 	struct ion_device *dev;
 	enum ion_heap_type type;
 	struct ion_heap_ops *ops;
+	unsigned long flags;
 	int id;
 	const char *name;
+	struct list_head free_list;
+	size_t free_list_size;
+	spinlock_t free_lock;
+	wait_queue_head_t waitqueue;
+	struct task_struct *task;
 };
 
+/**
+ * ion_buffer_free - release a buffer's memory and its metadata
+ * @buffer:		a buffer no longer reachable through its device
+ */
+void ion_buffer_free(struct ion_buffer *buffer);
+
 /**
  * ion_device_create - allocates and returns an ion device
  * @custom_ioctl:	arch specific ioctl function if applicable
@@ -175,6 +202,38 @@ ion_phys_addr_t ion_carveout_allocate(struct ion_heap *heap, unsigned long size,
 				      unsigned long align);
 void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
 		       unsigned long size);
+
+/**
+ * deferred free: heaps with ION_HEAP_FLAG_DEFER_FREE set have their buffers
+ * queued on a free list when the last reference goes away, and released by
+ * a SCHED_IDLE thread, so that freeing large buffers (and zeroing their
+ * pages for a pool) happens off the caller's path.
+ */
+int ion_heap_init_deferred_free(struct ion_heap *heap);
+void ion_heap_deinit_deferred_free(struct ion_heap *heap);
+
+/**
+ * ion_heap_freelist_add - add a buffer to the deferred free list
+ * @heap:		the heap
+ * @buffer:		the buffer
+ */
+void ion_heap_freelist_add(struct ion_heap *heap, struct ion_buffer *buffer);
+
+/**
+ * ion_heap_freelist_drain - free buffers on the deferred free list
+ * @heap:		the heap
+ * @size:		amount of memory to drain in bytes, 0 for all
+ *
+ * Frees buffers synchronously, e.g. before giving up on an allocation.
+ * Returns the number of bytes drained.
+ */
+size_t ion_heap_freelist_drain(struct ion_heap *heap, size_t size);
+
+/**
+ * ion_heap_freelist_size - bytes waiting on the deferred free list
+ * @heap:		the heap
+ */
+size_t ion_heap_freelist_size(struct ion_heap *heap);
 /**
  * The carveout heap returns physical addresses, since 0 may be a valid
  * physical address, this is used to indicate allocation failed
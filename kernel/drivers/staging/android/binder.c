@@ -19,6 +19,7 @@
 #include <linux/fdtable.h>
 #include <linux/file.h>
 #include <linux/fs.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/miscdevice.h>
 #include <linux/mm.h>
@@ -36,7 +37,7 @@
 
 #include "binder.h"
 
-static DEFINE_MUTEX(binder_lock);
+static DEFINE_MUTEX(binder_main_lock);
 static DEFINE_MUTEX(binder_deferred_lock);
 
 static HLIST_HEAD(binder_procs);
@@ -80,6 +81,12 @@ BINDER_DEBUG_ENTRY(proc);
 
 #define BINDER_SMALL_BUF_SIZE (PAGE_SIZE * 64)
 
+/*
+ * Pages kept mapped at the start of each free buffer, so allocations
+ * carved from it usually find their pages already in place.
+ */
+#define BINDER_MAP_AHEAD_PAGES 4
+
 enum {
 	BINDER_DEBUG_USER_ERROR             = 1U << 0,
 	BINDER_DEBUG_FAILED_TRANSACTION     = 1U << 1,
@@ -164,6 +171,65 @@ static inline void binder_stats_created(enum binder_stat_types type)
 	binder_stats.obj_created[type]++;
 }
 
+/*
+ * Contention accounting for binder_main_lock and the per-proc allocator
+ * lock. Only updated while the lock itself is held.
+ */
+struct binder_lock_stats {
+	unsigned long acquired;
+	unsigned long contended;
+	u64 wait_ns;
+	u64 max_wait_ns;
+};
+
+static struct binder_lock_stats binder_main_lock_stats;
+
+static void binder_mutex_lock(struct mutex *lock,
+			      struct binder_lock_stats *stats)
+{
+	ktime_t start;
+	u64 wait;
+
+	if (mutex_trylock(lock)) {
+		stats->acquired++;
+		return;
+	}
+	start = ktime_get();
+	mutex_lock(lock);
+	wait = ktime_to_ns(ktime_sub(ktime_get(), start));
+	stats->acquired++;
+	stats->contended++;
+	stats->wait_ns += wait;
+	if (wait > stats->max_wait_ns)
+		stats->max_wait_ns = wait;
+}
+
+#define BINDER_HIST_BUCKETS 16
+
+/* log2 histogram, bucket i counts values below 1 << i */
+struct binder_hist {
+	unsigned int bucket[BINDER_HIST_BUCKETS];
+};
+
+static void binder_hist_add(struct binder_hist *hist, unsigned long val)
+{
+	unsigned int i = fls_long(val);
+
+	if (i >= BINDER_HIST_BUCKETS)
+		i = BINDER_HIST_BUCKETS - 1;
+	hist->bucket[i]++;
+}
+
+static inline void binder_lock(void)
+{
+	binder_mutex_lock(&binder_main_lock, &binder_main_lock_stats);
+}
+
+static inline void binder_unlock(void)
+{
+	mutex_unlock(&binder_main_lock);
+}
+
 struct binder_transaction_log_entry {
 	int debug_id;
 	int call_type;
@@ -175,6 +241,9 @@ struct binder_transaction_log_entry {
 	int to_node;
 	int data_size;
 	int offsets_size;
+	s64 enqueue_us;
+	int wake_us;
+	int dequeue_us;
 };
 struct binder_transaction_log {
 	int next;
@@ -232,6 +301,7 @@ struct binder_node {
 	unsigned accept_fds:1;
 	unsigned min_priority:8;
 	struct list_head async_todo;
+	int tmp_refs;
 };
 
 struct binder_ref_death {
@@ -279,6 +349,27 @@ enum binder_deferred_state {
 	BINDER_DEFERRED_RELEASE      = 0x04,
 };
 
+/*
+ * Locking:
+ *
+ * binder_main_lock protects the node/ref graph, the thread and
+ * transaction stacks and the todo lists of every proc and thread.
+ *
+ * proc->alloc_lock protects the buffer allocator of a proc (buffers,
+ * free_buffers, allocated_buffers, pages and free_async_space). It nests
+ * inside binder_main_lock, but is also taken on its own by
+ * binder_transaction() when it allocates the target buffer and copies
+ * the payload in with binder_main_lock dropped.
+ *
+ * While binder_main_lock is dropped, tmp_ref keeps a proc or thread
+ * alive. Release marks it is_dead and the last binder_*_dec_tmpref()
+ * frees it. Both fields are protected by binder_main_lock. A node is
+ * pinned the same way by tmp_refs; once its proc is gone, node->proc
+ * is NULL.
+ *
+ * The node graph, the threads and the todo lists are still all under
+ * binder_main_lock: only the allocator has a lock of its own.
+ */
 struct binder_proc {
 	struct hlist_node proc_node;
 	struct rb_root threads;
@@ -294,10 +385,18 @@ struct binder_proc {
 	void *buffer;
 	ptrdiff_t user_buffer_offset;
 
+	struct mutex alloc_lock;
+	struct binder_lock_stats alloc_lock_stats;
 	struct list_head buffers;
 	struct rb_root free_buffers;
 	struct rb_root allocated_buffers;
 	size_t free_async_space;
+	struct binder_hist alloc_size_hist;
+	struct binder_hist map_time_hist;
+	unsigned long pages_mapped;
+	struct binder_hist queue_hist;
+	struct binder_hist wake_hist;
+	struct binder_hist handle_hist;
 
 	struct page **pages;
 	size_t buffer_size;
@@ -312,6 +411,8 @@ struct binder_proc {
 	int ready_threads;
 	long default_priority;
 	struct dentry *debugfs_entry;
+	int tmp_ref;
+	int is_dead;
 };
 
 enum {
@@ -336,6 +437,9 @@ struct binder_thread {
 		/* we are also waiting on */
 	wait_queue_head_t wait;
 	struct binder_stats stats;
+	ktime_t wake_time;
+	int tmp_ref;
+	int is_dead;
 };
 
 struct binder_transaction {
@@ -355,8 +459,14 @@ struct binder_transaction {
 	long	priority;
 	long	saved_priority;
 	uid_t	sender_euid;
+	ktime_t	enqueue_time;
+	ktime_t	dequeue_time;
+	struct binder_transaction_log_entry *log_entry;
 };
 
+#define CREATE_TRACE_POINTS
+#include "binder_trace.h"
+
 static void
 binder_defer_work(struct binder_proc *proc, enum binder_deferred_state defer);
 
@@ -583,16 +693,34 @@ static void binder_insert_allocated_buffer(struct binder_proc *proc,
 	rb_insert_color(&new_buffer->rb_node, &proc->allocated_buffers);
 }
 
+static inline void binder_alloc_lock(struct binder_proc *proc)
+{
+	binder_mutex_lock(&proc->alloc_lock, &proc->alloc_lock_stats);
+}
+
+static inline void binder_alloc_unlock(struct binder_proc *proc)
+{
+	mutex_unlock(&proc->alloc_lock);
+}
+
+/*
+ * Finds the buffer userspace passed to BC_FREE_BUFFER and claims it, so
+ * that it cannot be freed twice. A buffer still being filled in by a
+ * sender without binder_main_lock has allow_user_free clear, so it is
+ * never returned: ERR_PTR(-EPERM) tells it apart from no match at all.
+ */
 static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 						  void __user *user_ptr)
 {
-	struct rb_node *n = proc->allocated_buffers.rb_node;
+	struct rb_node *n;
 	struct binder_buffer *buffer;
 	struct binder_buffer *kern_ptr;
 
 	kern_ptr = user_ptr - proc->user_buffer_offset
 		- offsetof(struct binder_buffer, data);
 
+	binder_alloc_lock(proc);
+	n = proc->allocated_buffers.rb_node;
 	while (n) {
 		buffer = rb_entry(n, struct binder_buffer, rb_node);
 		BUG_ON(buffer->free);
@@ -601,73 +729,68 @@ static struct binder_buffer *binder_buffer_lookup(struct binder_proc *proc,
 			n = n->rb_left;
 		else if (kern_ptr > buffer)
 			n = n->rb_right;
-		else
+		else {
+			if (buffer->allow_user_free)
+				buffer->allow_user_free = 0;
+			else
+				buffer = ERR_PTR(-EPERM);
+			binder_alloc_unlock(proc);
 			return buffer;
+		}
 	}
+	binder_alloc_unlock(proc);
 	return NULL;
 }
 
-static int binder_update_page_range(struct binder_proc *proc, int allocate,
-				    void *start, void *end,
-				    struct vm_area_struct *vma)
+static inline struct page **binder_page(struct binder_proc *proc,
+					void *page_addr)
+{
+	return &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
+}
+
+/*
+ * Populate a run of pages that are not mapped yet: allocate them all,
+ * map the run into the kernel with a single map_vm_area() call and then
+ * insert the pages into the user mapping.
+ */
+static int binder_map_pages(struct binder_proc *proc, void *start, void *end,
+			    struct vm_area_struct *vma)
 {
 	void *page_addr;
 	unsigned long user_page_addr;
 	struct vm_struct tmp_area;
+	struct page **page_array_ptr;
 	struct page **page;
-	struct mm_struct *mm;
-
-	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
-		     "binder: %d: %s pages %p-%p\n", proc->pid,
-		     allocate ? "allocate" : "free", start, end);
-
-	if (end <= start)
-		return 0;
-
-	if (vma)
-		mm = NULL;
-	else
-		mm = get_task_mm(proc->tsk);
-
-	if (mm) {
-		down_write(&mm->mmap_sem);
-		vma = proc->vma;
-	}
-
-	if (allocate == 0)
-		goto free_range;
-
-	if (vma == NULL) {
-		printk(KERN_ERR "binder: %d: binder_alloc_buf failed to "
-		       "map pages in userspace, no vma\n", proc->pid);
-		goto err_no_vma;
-	}
+	int ret;
 
 	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
-		int ret;
-		struct page **page_array_ptr;
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
-
+		page = binder_page(proc, page_addr);
 		BUG_ON(*page);
 		*page = alloc_page(GFP_KERNEL | __GFP_ZERO);
 		if (*page == NULL) {
 			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
 			       "for page at %p\n", proc->pid, page_addr);
+			end = page_addr;
 			goto err_alloc_page_failed;
 		}
-		tmp_area.addr = page_addr;
-		tmp_area.size = PAGE_SIZE + PAGE_SIZE /* guard page? */;
-		page_array_ptr = page;
-		ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
-		if (ret) {
-			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
-			       "to map page at %p in kernel\n",
-			       proc->pid, page_addr);
-			goto err_map_kernel_failed;
-		}
+	}
+
+	tmp_area.addr = start;
+	tmp_area.size = end - start + PAGE_SIZE /* guard page? */;
+	page_array_ptr = binder_page(proc, start);
+	ret = map_vm_area(&tmp_area, PAGE_KERNEL, &page_array_ptr);
+	if (ret) {
+		printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
+		       "to map pages %p-%p in kernel\n",
+		       proc->pid, start, end);
+		goto err_map_kernel_failed;
+	}
+
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
 		user_page_addr =
 			(uintptr_t)page_addr + proc->user_buffer_offset;
-		ret = vm_insert_page(vma, user_page_addr, page[0]);
+		ret = vm_insert_page(vma, user_page_addr,
+				     *binder_page(proc, page_addr));
 		if (ret) {
 			printk(KERN_ERR "binder: %d: binder_alloc_buf failed "
 			       "to map page at %lx in userspace\n",
@@ -676,38 +799,107 @@ static int binder_update_page_range(struct binder_proc *proc, int allocate,
 		}
 		/* vm_insert_page does not seem to increment the refcount */
 	}
-	if (mm) {
-		up_write(&mm->mmap_sem);
-		mmput(mm);
-	}
+	proc->pages_mapped += (end - start) / PAGE_SIZE;
 	return 0;
 
-free_range:
-	for (page_addr = end - PAGE_SIZE; page_addr >= start;
-	     page_addr -= PAGE_SIZE) {
-		page = &proc->pages[(page_addr - proc->buffer) / PAGE_SIZE];
-		if (vma)
-			zap_page_range(vma, (uintptr_t)page_addr +
-				proc->user_buffer_offset, PAGE_SIZE, NULL);
 err_vm_insert_page_failed:
-		unmap_kernel_range((unsigned long)page_addr, PAGE_SIZE);
+	if (page_addr > start)
+		zap_page_range(vma, (uintptr_t)start + proc->user_buffer_offset,
+			       page_addr - start, NULL);
 err_map_kernel_failed:
+	unmap_kernel_range((unsigned long)start, end - start);
+err_alloc_page_failed:
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = binder_page(proc, page_addr);
 		__free_page(*page);
 		*page = NULL;
-err_alloc_page_failed:
-		;
 	}
-err_no_vma:
+	return -ENOMEM;
+}
+
+static void binder_unmap_pages(struct binder_proc *proc, void *start,
+			       void *end, struct vm_area_struct *vma)
+{
+	void *page_addr;
+	struct page **page;
+
+	if (vma)
+		zap_page_range(vma, (uintptr_t)start + proc->user_buffer_offset,
+			       end - start, NULL);
+	unmap_kernel_range((unsigned long)start, end - start);
+	for (page_addr = start; page_addr < end; page_addr += PAGE_SIZE) {
+		page = binder_page(proc, page_addr);
+		__free_page(*page);
+		*page = NULL;
+	}
+}
+
+/*
+ * Make every page in [start, end) present (allocate) or absent (free).
+ * Pages already in the requested state are left alone, so free space may
+ * keep pages mapped for the next allocation to reuse.
+ */
+static int binder_update_page_range(struct binder_proc *proc, int allocate,
+				    void *start, void *end,
+				    struct vm_area_struct *vma)
+{
+	void *page_addr;
+	void *run_end;
+	struct mm_struct *mm;
+	int present;
+	int ret = 0;
+
+	binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
+		     "binder: %d: %s pages %p-%p\n", proc->pid,
+		     allocate ? "allocate" : "free", start, end);
+
+	if (end <= start)
+		return 0;
+
+	if (vma)
+		mm = NULL;
+	else
+		mm = get_task_mm(proc->tsk);
+
+	if (mm) {
+		down_write(&mm->mmap_sem);
+		vma = proc->vma;
+	}
+
+	if (allocate && vma == NULL) {
+		printk(KERN_ERR "binder: %d: binder_alloc_buf failed to "
+		       "map pages in userspace, no vma\n", proc->pid);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (page_addr = start; page_addr < end; page_addr = run_end) {
+		present = *binder_page(proc, page_addr) != NULL;
+		run_end = page_addr + PAGE_SIZE;
+		while (run_end < end &&
+		       (*binder_page(proc, run_end) != NULL) == present)
+			run_end += PAGE_SIZE;
+
+		if (allocate && !present) {
+			ret = binder_map_pages(proc, page_addr, run_end, vma);
+			if (ret)
+				break;
+		} else if (!allocate && present) {
+			binder_unmap_pages(proc, page_addr, run_end, vma);
+		}
+	}
+out:
 	if (mm) {
 		up_write(&mm->mmap_sem);
 		mmput(mm);
 	}
-	return -ENOMEM;
+	return ret;
 }
 
-static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
-					      size_t data_size,
-					      size_t offsets_size, int is_async)
+static struct binder_buffer *__binder_alloc_buf(struct binder_proc *proc,
+						size_t data_size,
+						size_t offsets_size,
+						int is_async)
 {
 	struct rb_node *n = proc->free_buffers.rb_node;
 	struct binder_buffer *buffer;
@@ -716,6 +908,8 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	void *has_page_addr;
 	void *end_page_addr;
 	size_t size;
+	unsigned long pages_mapped;
+	ktime_t map_start;
 
 	if (proc->vma == NULL) {
 		printk(KERN_ERR "binder: %d: binder_alloc_buf, no vma\n",
@@ -779,11 +973,21 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	}
 	end_page_addr =
 		(void *)PAGE_ALIGN((uintptr_t)buffer->data + buffer_size);
+	if (buffer_size != size) {
+		/* populate the head of the free buffer split off below */
+		end_page_addr += BINDER_MAP_AHEAD_PAGES * PAGE_SIZE;
+	}
 	if (end_page_addr > has_page_addr)
 		end_page_addr = has_page_addr;
+	pages_mapped = proc->pages_mapped;
+	map_start = ktime_get();
 	if (binder_update_page_range(proc, 1,
 	    (void *)PAGE_ALIGN((uintptr_t)buffer->data), end_page_addr, NULL))
 		return NULL;
+	if (proc->pages_mapped != pages_mapped)
+		binder_hist_add(&proc->map_time_hist,
+				ktime_us_delta(ktime_get(), map_start));
+	binder_hist_add(&proc->alloc_size_hist, size >> 6);
 
 	rb_erase(best_fit, &proc->free_buffers);
 	buffer->free = 0;
@@ -800,6 +1004,13 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	buffer->data_size = data_size;
 	buffer->offsets_size = offsets_size;
 	buffer->async_transaction = is_async;
+	/*
+	 * The buffer is visible to binder_buffer_lookup() as soon as it is
+	 * in allocated_buffers, before the sender has filled it in.
+	 */
+	buffer->allow_user_free = 0;
+	buffer->transaction = NULL;
+	buffer->target_node = NULL;
 	if (is_async) {
 		proc->free_async_space -= size + sizeof(struct binder_buffer);
 		binder_debug(BINDER_DEBUG_BUFFER_ALLOC_ASYNC,
@@ -811,6 +1022,18 @@ static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
 	return buffer;
 }
 
+static struct binder_buffer *binder_alloc_buf(struct binder_proc *proc,
+					      size_t data_size,
+					      size_t offsets_size, int is_async)
+{
+	struct binder_buffer *buffer;
+
+	binder_alloc_lock(proc);
+	buffer = __binder_alloc_buf(proc, data_size, offsets_size, is_async);
+	binder_alloc_unlock(proc);
+	return buffer;
+}
+
 static void *buffer_start_page(struct binder_buffer *buffer)
 {
 	return (void *)((uintptr_t)buffer & PAGE_MASK);
@@ -868,8 +1091,8 @@ static void binder_delete_free_buffer(struct binder_proc *proc,
 	}
 }
 
-static void binder_free_buf(struct binder_proc *proc,
-			    struct binder_buffer *buffer)
+static void __binder_free_buf(struct binder_proc *proc,
+			      struct binder_buffer *buffer)
 {
 	size_t size, buffer_size;
 
@@ -897,10 +1120,6 @@ static void binder_free_buf(struct binder_proc *proc,
 			     proc->free_async_space);
 	}
 
-	binder_update_page_range(proc, 0,
-		(void *)PAGE_ALIGN((uintptr_t)buffer->data),
-		(void *)(((uintptr_t)buffer->data + buffer_size) & PAGE_MASK),
-		NULL);
 	rb_erase(&buffer->rb_node, &proc->allocated_buffers);
 	buffer->free = 1;
 	if (!list_is_last(&buffer->entry, &proc->buffers)) {
@@ -920,9 +1139,23 @@ static void binder_free_buf(struct binder_proc *proc,
 			buffer = prev;
 		}
 	}
+	binder_update_page_range(proc, 0,
+		(void *)PAGE_ALIGN((uintptr_t)buffer->data) +
+			BINDER_MAP_AHEAD_PAGES * PAGE_SIZE,
+		(void *)(((uintptr_t)buffer->data +
+			  binder_buffer_size(proc, buffer)) & PAGE_MASK),
+		NULL);
 	binder_insert_free_buffer(proc, buffer);
 }
 
+static void binder_free_buf(struct binder_proc *proc,
+			    struct binder_buffer *buffer)
+{
+	binder_alloc_lock(proc);
+	__binder_free_buf(proc, buffer);
+	binder_alloc_unlock(proc);
+}
+
 static struct binder_node *binder_get_node(struct binder_proc *proc,
 					   void __user *ptr)
 {
@@ -1039,7 +1272,7 @@ static int binder_dec_node(struct binder_node *node, int strong, int internal)
 		}
 	} else {
 		if (hlist_empty(&node->refs) && !node->local_strong_refs &&
-		    !node->local_weak_refs) {
+		    !node->local_weak_refs && !node->tmp_refs) {
 			list_del_init(&node->work.entry);
 			if (node->proc) {
 				rb_erase(&node->rb_node, &node->proc->nodes);
@@ -1060,6 +1293,14 @@ static int binder_dec_node(struct binder_node *node, int strong, int internal)
 	return 0;
 }
 
+static void binder_node_dec_tmpref(struct binder_node *node)
+{
+	BUG_ON(node->tmp_refs <= 0);
+	node->tmp_refs--;
+	/* Frees the node if nothing else references it any more */
+	binder_dec_node(node, 0, 1);
+}
+
 
 static struct binder_ref *binder_get_ref(struct binder_proc *proc,
 					 uint32_t desc)
@@ -1375,6 +1616,100 @@ static void binder_transaction_buffer_release(struct binder_proc *proc,
 	}
 }
 
+static void binder_free_proc(struct binder_proc *proc);
+
+static void binder_proc_dec_tmpref(struct binder_proc *proc)
+{
+	BUG_ON(proc->tmp_ref <= 0);
+	if (--proc->tmp_ref == 0 && proc->is_dead)
+		binder_free_proc(proc);
+}
+
+static void binder_thread_dec_tmpref(struct binder_thread *thread)
+{
+	BUG_ON(thread->tmp_ref <= 0);
+	if (--thread->tmp_ref == 0 && thread->is_dead) {
+		kfree(thread);
+		binder_stats_deleted(BINDER_STAT_THREAD);
+	}
+}
+
+/*
+ * Allocate the target buffer and copy the payload into it. Called without
+ * binder_main_lock, the caller holds a tmp_ref on target_proc.
+ */
+static uint32_t binder_transaction_copy(struct binder_proc *proc,
+					struct binder_thread *thread,
+					struct binder_proc *target_proc,
+					struct binder_transaction *t,
+					struct binder_transaction_data *tr,
+					int reply)
+{
+	struct binder_buffer *buffer;
+	size_t *offp;
+
+	buffer = binder_alloc_buf(target_proc, tr->data_size,
+		tr->offsets_size, !reply && (t->flags & TF_ONE_WAY));
+	if (buffer == NULL)
+		return BR_FAILED_REPLY;
+
+	offp = (size_t *)(buffer->data + ALIGN(tr->data_size, sizeof(void *)));
+
+	if (copy_from_user(buffer->data, tr->data.ptr.buffer, tr->data_size)) {
+		binder_user_error("binder: %d:%d got transaction with invalid "
+			"data ptr\n", proc->pid, thread->pid);
+		goto err_copy_data_failed;
+	}
+	if (copy_from_user(offp, tr->data.ptr.offsets, tr->offsets_size)) {
+		binder_user_error("binder: %d:%d got transaction with invalid "
+			"offsets ptr\n", proc->pid, thread->pid);
+		goto err_copy_data_failed;
+	}
+	t->buffer = buffer;
+	return BR_OK;
+
+err_copy_data_failed:
+	binder_free_buf(target_proc, buffer);
+	return BR_FAILED_REPLY;
+}
+
+/*
+ * Latency accounting. A transaction is stamped when it is queued, the
+ * receiving thread when it returns from its wait, and the transaction
+ * again when that thread hands it to userspace. The time from there
+ * to the reply is the time the server spent handling it.
+ */
+static void binder_transaction_dequeued(struct binder_proc *proc,
+					struct binder_thread *thread,
+					struct binder_transaction *t)
+{
+	struct binder_transaction_log_entry *e = t->log_entry;
+	s64 queue_us, wake_us = 0;
+
+	t->dequeue_time = ktime_get();
+	queue_us = ktime_us_delta(t->dequeue_time, t->enqueue_time);
+	if (ktime_to_ns(thread->wake_time) > ktime_to_ns(t->enqueue_time))
+		wake_us = ktime_us_delta(thread->wake_time, t->enqueue_time);
+
+	binder_hist_add(&proc->queue_hist, queue_us);
+	binder_hist_add(&proc->wake_hist, wake_us);
+	if (e->debug_id == t->debug_id) {
+		e->wake_us = wake_us;
+		e->dequeue_us = queue_us;
+	}
+	trace_binder_transaction_dequeue(t, thread, queue_us, wake_us);
+}
+
+static void binder_transaction_handled(struct binder_proc *proc,
+				       struct binder_thread *thread,
+				       struct binder_transaction *t)
+{
+	s64 handle_us = ktime_us_delta(ktime_get(), t->dequeue_time);
+
+	binder_hist_add(&proc->handle_hist, handle_us);
+	trace_binder_transaction_handled(t, thread, handle_us);
+}
+
 static void binder_transaction(struct binder_proc *proc,
 			       struct binder_thread *thread,
 			       struct binder_transaction_data *tr, int reply)
@@ -1398,6 +1733,8 @@ static void binder_transaction(struct binder_proc *proc,
 	e->target_handle = tr->target.handle;
 	e->data_size = tr->data_size;
 	e->offsets_size = tr->offsets_size;
+	e->wake_us = -1;
+	e->dequeue_us = -1;
 
 	if (reply) {
 		in_reply_to = thread->transaction_stack;
@@ -1515,6 +1852,7 @@ static void binder_transaction(struct binder_proc *proc,
 
 	t->debug_id = ++binder_last_id;
 	e->debug_id = t->debug_id;
+	t->log_entry = e;
 
 	if (reply)
 		binder_debug(BINDER_DEBUG_TRANSACTION,
@@ -1543,13 +1881,40 @@ static void binder_transaction(struct binder_proc *proc,
 	t->code = tr->code;
 	t->flags = tr->flags;
 	t->priority = task_nice(current);
-	t->buffer = binder_alloc_buf(target_proc, tr->data_size,
-		tr->offsets_size, !reply && (t->flags & TF_ONE_WAY));
-	if (t->buffer == NULL) {
+
+	/*
+	 * Mapping the target buffer and copying the payload are the slow
+	 * part of a transaction and only need target_proc's allocator, so
+	 * do them without binder_main_lock. Everything looked up above is
+	 * revalidated once the lock is taken again.
+	 */
+	target_proc->tmp_ref++;
+	if (target_thread)
+		target_thread->tmp_ref++;
+	if (target_node)
+		target_node->tmp_refs++;
+	binder_unlock();
+	return_error = binder_transaction_copy(proc, thread, target_proc, t,
+					       tr, reply);
+	binder_lock();
+	if (target_proc->is_dead ||
+	    (target_thread && target_thread->is_dead) ||
+	    (target_node && !target_node->proc)) {
+		return_error = BR_DEAD_REPLY;
+		goto err_binder_alloc_buf_failed;
+	}
+	if (reply && (in_reply_to->from != target_thread ||
+		      target_thread->transaction_stack != in_reply_to)) {
+		binder_user_error("binder: %d:%d reply target %d:%d changed "
+			"transaction stack while sending\n",
+			proc->pid, thread->pid, target_proc->pid,
+			target_thread->pid);
 		return_error = BR_FAILED_REPLY;
+		in_reply_to = NULL;
 		goto err_binder_alloc_buf_failed;
 	}
-	t->buffer->allow_user_free = 0;
+	if (return_error != BR_OK)
+		goto err_binder_alloc_buf_failed;
 	t->buffer->debug_id = t->debug_id;
 	t->buffer->transaction = t;
 	t->buffer->target_node = target_node;
@@ -1558,18 +1923,6 @@ static void binder_transaction(struct binder_proc *proc,
 
 	offp = (size_t *)(t->buffer->data + ALIGN(tr->data_size, sizeof(void *)));
 
-	if (copy_from_user(t->buffer->data, tr->data.ptr.buffer, tr->data_size)) {
-		binder_user_error("binder: %d:%d got transaction with invalid "
-			"data ptr\n", proc->pid, thread->pid);
-		return_error = BR_FAILED_REPLY;
-		goto err_copy_data_failed;
-	}
-	if (copy_from_user(offp, tr->data.ptr.offsets, tr->offsets_size)) {
-		binder_user_error("binder: %d:%d got transaction with invalid "
-			"offsets ptr\n", proc->pid, thread->pid);
-		return_error = BR_FAILED_REPLY;
-		goto err_copy_data_failed;
-	}
 	if (!IS_ALIGNED(tr->offsets_size, sizeof(size_t))) {
 		binder_user_error("binder: %d:%d got transaction with "
 			"invalid offsets size, %zd\n",
@@ -1717,6 +2070,7 @@ static void binder_transaction(struct binder_proc *proc,
 	}
 	if (reply) {
 		BUG_ON(t->buffer->async_transaction != 0);
+		binder_transaction_handled(proc, thread, in_reply_to);
 		binder_pop_transaction(target_thread, in_reply_to);
 	} else if (!(t->flags & TF_ONE_WAY)) {
 		BUG_ON(t->buffer->async_transaction != 0);
@@ -1733,11 +2087,21 @@ static void binder_transaction(struct binder_proc *proc,
 			target_node->has_async_transaction = 1;
 	}
 	t->work.type = BINDER_WORK_TRANSACTION;
+	t->enqueue_time = ktime_get();
+	/* The log slot may have been recycled while the lock was dropped */
+	if (e->debug_id == t->debug_id)
+		e->enqueue_us = ktime_to_us(t->enqueue_time);
+	trace_binder_transaction_enqueue(t, reply, target_proc, target_thread);
 	list_add_tail(&t->work.entry, target_list);
 	tcomplete->type = BINDER_WORK_TRANSACTION_COMPLETE;
 	list_add_tail(&tcomplete->entry, &thread->todo);
 	if (target_wait)
 		wake_up_interruptible(target_wait);
+	if (target_node)
+		binder_node_dec_tmpref(target_node);
+	if (target_thread)
+		binder_thread_dec_tmpref(target_thread);
+	binder_proc_dec_tmpref(target_proc);
 	return;
 
 err_get_unused_fd_failed:
@@ -1748,11 +2112,18 @@ err_binder_get_ref_failed:
 err_binder_new_node_failed:
 err_bad_object_type:
 err_bad_offset:
-err_copy_data_failed:
 	binder_transaction_buffer_release(target_proc, t->buffer, offp);
 	t->buffer->transaction = NULL;
 	binder_free_buf(target_proc, t->buffer);
+	t->buffer = NULL;
 err_binder_alloc_buf_failed:
+	if (t->buffer)
+		binder_free_buf(target_proc, t->buffer);
+	if (target_node)
+		binder_node_dec_tmpref(target_node);
+	if (target_thread)
+		binder_thread_dec_tmpref(target_thread);
+	binder_proc_dec_tmpref(target_proc);
 	kfree(tcomplete);
 	binder_stats_deleted(BINDER_STAT_TRANSACTION_COMPLETE);
 err_alloc_tcomplete_failed:
@@ -1940,7 +2311,7 @@ int binder_thread_write(struct binder_proc *proc, struct binder_thread *thread,
 					proc->pid, thread->pid, data_ptr);
 				break;
 			}
-			if (!buffer->allow_user_free) {
+			if (IS_ERR(buffer)) {
 				binder_user_error("binder: %d:%d "
 					"BC_FREE_BUFFER u%p matched "
 					"unreturned buffer\n",
@@ -2232,7 +2603,7 @@ retry:
 	thread->looper |= BINDER_LOOPER_STATE_WAITING;
 	if (wait_for_proc_work)
 		proc->ready_threads++;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 	if (wait_for_proc_work) {
 		if (!(thread->looper & (BINDER_LOOPER_STATE_REGISTERED |
 					BINDER_LOOPER_STATE_ENTERED))) {
@@ -2256,7 +2627,8 @@ retry:
 		} else
 			ret = wait_event_interruptible(thread->wait, binder_has_thread_work(thread));
 	}
-	mutex_lock(&binder_lock);
+	thread->wake_time = ktime_get();
+	binder_lock();
 	if (wait_for_proc_work)
 		proc->ready_threads--;
 	thread->looper &= ~BINDER_LOOPER_STATE_WAITING;
@@ -2346,7 +2718,7 @@ retry:
 					     proc->pid, thread->pid, cmd_name, node->debug_id, node->ptr, node->cookie);
 			} else {
 				list_del_init(&w->entry);
-				if (!weak && !strong) {
+				if (!weak && !strong && !node->tmp_refs) {
 					binder_debug(BINDER_DEBUG_INTERNAL_REFS,
 						     "binder: %d:%d node %d u%p c%p deleted\n",
 						     proc->pid, thread->pid, node->debug_id,
@@ -2459,6 +2831,7 @@ retry:
 			     tr.data.ptr.buffer, tr.data.ptr.offsets);
 
 		list_del(&t->work.entry);
+		binder_transaction_dequeued(proc, thread, t);
 		t->buffer->allow_user_free = 1;
 		if (cmd == BR_TRANSACTION && !(t->flags & TF_ONE_WAY)) {
 			t->to_parent = thread->transaction_stack;
@@ -2586,8 +2959,11 @@ static int binder_free_thread(struct binder_proc *proc,
 	if (send_reply)
 		binder_send_failed_reply(send_reply, BR_DEAD_REPLY);
 	binder_release_work(&thread->todo);
-	kfree(thread);
-	binder_stats_deleted(BINDER_STAT_THREAD);
+	thread->is_dead = 1;
+	if (!thread->tmp_ref) {
+		kfree(thread);
+		binder_stats_deleted(BINDER_STAT_THREAD);
+	}
 	return active_transactions;
 }
 
@@ -2598,12 +2974,12 @@ static unsigned int binder_poll(struct file *filp,
 	struct binder_thread *thread = NULL;
 	int wait_for_proc_work;
 
-	mutex_lock(&binder_lock);
+	binder_lock();
 	thread = binder_get_thread(proc);
 
 	wait_for_proc_work = thread->transaction_stack == NULL &&
 		list_empty(&thread->todo) && thread->return_error == BR_OK;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 
 	if (wait_for_proc_work) {
 		if (binder_has_proc_work(proc, thread))
@@ -2635,7 +3011,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	if (ret)
 		return ret;
 
-	mutex_lock(&binder_lock);
+	binder_lock();
 	thread = binder_get_thread(proc);
 	if (thread == NULL) {
 		ret = -ENOMEM;
@@ -2744,7 +3120,7 @@ static long binder_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 err:
 	if (thread)
 		thread->looper &= ~BINDER_LOOPER_STATE_NEED_RETURN;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 	wait_event_interruptible(binder_user_error_wait, binder_stop_on_user_error < 2);
 	if (ret && ret != -ERESTARTSYS)
 		printk(KERN_INFO "binder: %d:%d ioctl %x %lx returned %d\n", proc->pid, current->pid, cmd, arg, ret);
@@ -2885,13 +3261,14 @@ static int binder_open(struct inode *nodp, struct file *filp)
 	INIT_LIST_HEAD(&proc->todo);
 	init_waitqueue_head(&proc->wait);
 	proc->default_priority = task_nice(current);
-	mutex_lock(&binder_lock);
+	mutex_init(&proc->alloc_lock);
+	binder_lock();
 	binder_stats_created(BINDER_STAT_PROC);
 	hlist_add_head(&proc->proc_node, &binder_procs);
 	proc->pid = current->group_leader->pid;
 	INIT_LIST_HEAD(&proc->delivered_death);
 	filp->private_data = proc;
-	mutex_unlock(&binder_lock);
+	binder_unlock();
 
 	if (binder_debugfs_dir_entry_proc) {
 		char strbuf[11];
@@ -2940,16 +3317,78 @@ static int binder_release(struct inode *nodp, struct file *filp)
 	return 0;
 }
 
+/*
+ * Tear down the buffer space of a released proc. Deferred until no
+ * binder_transaction() is copying into it any more.
+ */
+static void binder_free_proc(struct binder_proc *proc)
+{
+	struct binder_transaction *t;
+	struct rb_node *n;
+	int buffers, page_count;
+
+	BUG_ON(!proc->is_dead);
+	BUG_ON(proc->tmp_ref);
+
+	buffers = 0;
+	while ((n = rb_first(&proc->allocated_buffers))) {
+		struct binder_buffer *buffer = rb_entry(n, struct binder_buffer,
+							rb_node);
+		t = buffer->transaction;
+		if (t) {
+			t->buffer = NULL;
+			buffer->transaction = NULL;
+			printk(KERN_ERR "binder: release proc %d, "
+			       "transaction %d, not freed\n",
+			       proc->pid, t->debug_id);
+			/*BUG();*/
+		}
+		binder_free_buf(proc, buffer);
+		buffers++;
+	}
+
+	binder_stats_deleted(BINDER_STAT_PROC);
+
+	page_count = 0;
+	if (proc->pages) {
+		int i;
+		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
+			if (proc->pages[i]) {
+				void *page_addr = proc->buffer + i * PAGE_SIZE;
+				binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
+					     "binder_release: %d: "
+					     "page %d at %p not freed\n",
+					     proc->pid, i,
+					     page_addr);
+				unmap_kernel_range((unsigned long)page_addr,
+					PAGE_SIZE);
+				__free_page(proc->pages[i]);
+				page_count++;
+			}
+		}
+		kfree(proc->pages);
+		vfree(proc->buffer);
+	}
+
+	put_task_struct(proc->tsk);
+
+	binder_debug(BINDER_DEBUG_OPEN_CLOSE,
+		     "binder_release: %d buffers %d, pages %d\n",
+		     proc->pid, buffers, page_count);
+
+	kfree(proc);
+}
+
 static void binder_deferred_release(struct binder_proc *proc)
 {
 	struct hlist_node *pos;
-	struct binder_transaction *t;
 	struct rb_node *n;
-	int threads, nodes, incoming_refs, outgoing_refs, buffers, active_transactions, page_count;
+	int threads, nodes, incoming_refs, outgoing_refs, active_transactions;
 
 	BUG_ON(proc->vma);
 	BUG_ON(proc->files);
 
+	proc->is_dead = 1;
 	hlist_del(&proc->proc_node);
 	if (binder_context_mgr_node && binder_context_mgr_node->proc == proc) {
 		binder_debug(BINDER_DEBUG_DEAD_BINDER,
@@ -2973,7 +3412,7 @@ static void binder_deferred_release(struct binder_proc *proc)
 		nodes++;
 		rb_erase(&node->rb_node, &proc->nodes);
 		list_del_init(&node->work.entry);
-		if (hlist_empty(&node->refs)) {
+		if (hlist_empty(&node->refs) && !node->tmp_refs) {
 			kfree(node);
 			binder_stats_deleted(BINDER_STAT_NODE);
 		} else {
@@ -3011,57 +3450,15 @@ static void binder_deferred_release(struct binder_proc *proc)
 		binder_delete_ref(ref);
 	}
 	binder_release_work(&proc->todo);
-	buffers = 0;
-
-	while ((n = rb_first(&proc->allocated_buffers))) {
-		struct binder_buffer *buffer = rb_entry(n, struct binder_buffer,
-							rb_node);
-		t = buffer->transaction;
-		if (t) {
-			t->buffer = NULL;
-			buffer->transaction = NULL;
-			printk(KERN_ERR "binder: release proc %d, "
-			       "transaction %d, not freed\n",
-			       proc->pid, t->debug_id);
-			/*BUG();*/
-		}
-		binder_free_buf(proc, buffer);
-		buffers++;
-	}
-
-	binder_stats_deleted(BINDER_STAT_PROC);
-
-	page_count = 0;
-	if (proc->pages) {
-		int i;
-		for (i = 0; i < proc->buffer_size / PAGE_SIZE; i++) {
-			if (proc->pages[i]) {
-				void *page_addr = proc->buffer + i * PAGE_SIZE;
-				binder_debug(BINDER_DEBUG_BUFFER_ALLOC,
-					     "binder_release: %d: "
-					     "page %d at %p not freed\n",
-					     proc->pid, i,
-					     page_addr);
-				unmap_kernel_range((unsigned long)page_addr,
-					PAGE_SIZE);
-				__free_page(proc->pages[i]);
-				page_count++;
-			}
-		}
-		kfree(proc->pages);
-		vfree(proc->buffer);
-	}
-
-	put_task_struct(proc->tsk);
 
 	binder_debug(BINDER_DEBUG_OPEN_CLOSE,
 		     "binder_release: %d threads %d, nodes %d (ref %d), "
-		     "refs %d, active transactions %d, buffers %d, "
-		     "pages %d\n",
+		     "refs %d, active transactions %d\n",
 		     proc->pid, threads, nodes, incoming_refs, outgoing_refs,
-		     active_transactions, buffers, page_count);
+		     active_transactions);
 
-	kfree(proc);
+	if (!proc->tmp_ref)
+		binder_free_proc(proc);
 }
 
 static void binder_deferred_func(struct work_struct *work)
@@ -3071,7 +3468,7 @@ static void binder_deferred_func(struct work_struct *work)
 
 	int defer;
 	do {
-		mutex_lock(&binder_lock);
+		binder_lock();
 		mutex_lock(&binder_deferred_lock);
 		if (!hlist_empty(&binder_deferred_list)) {
 			proc = hlist_entry(binder_deferred_list.first,
@@ -3096,9 +3493,9 @@ static void binder_deferred_func(struct work_struct *work)
 			binder_deferred_flush(proc);
 
 		if (defer & BINDER_DEFERRED_RELEASE)
-			binder_deferred_release(proc); /* frees proc */
+			binder_deferred_release(proc); /* may free proc */
 
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 		if (files)
 			put_files_struct(files);
 	} while (proc);
@@ -3279,9 +3676,11 @@ static void print_binder_proc(struct seq_file *m,
 			print_binder_ref(m, rb_entry(n, struct binder_ref,
 						     rb_node_desc));
 	}
+	binder_alloc_lock(proc);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		print_binder_buffer(m, "  buffer",
 				    rb_entry(n, struct binder_buffer, rb_node));
+	binder_alloc_unlock(proc);
 	list_for_each_entry(w, &proc->todo, entry)
 		print_binder_work(m, "  ", "  pending transaction", w);
 	list_for_each_entry(w, &proc->delivered_death, entry) {
@@ -3377,6 +3776,31 @@ static void print_binder_stats(struct seq_file *m, const char *prefix,
 	}
 }
 
+static void print_binder_lock_stats(struct seq_file *m, const char *prefix,
+				    struct binder_lock_stats *stats)
+{
+	seq_printf(m, "%s: acquired %lu contended %lu wait %llu ns "
+		   "max %llu ns\n", prefix, stats->acquired, stats->contended,
+		   (unsigned long long)stats->wait_ns,
+		   (unsigned long long)stats->max_wait_ns);
+}
+
+static void print_binder_hist(struct seq_file *m, const char *prefix,
+			      unsigned long scale, const char *unit,
+			      struct binder_hist *hist)
+{
+	int i;
+
+	for (i = 0; i < BINDER_HIST_BUCKETS - 1; i++) {
+		if (hist->bucket[i])
+			seq_printf(m, "%s < %lu%s: %u\n", prefix,
+				   scale << i, unit, hist->bucket[i]);
+	}
+	if (hist->bucket[i])
+		seq_printf(m, "%s >= %lu%s: %u\n", prefix,
+			   scale << (i - 1), unit, hist->bucket[i]);
+}
+
 static void print_binder_proc_stats(struct seq_file *m,
 				    struct binder_proc *proc)
 {
@@ -3411,9 +3835,18 @@ static void print_binder_proc_stats(struct seq_file *m,
 	seq_printf(m, "  refs: %d s %d w %d\n", count, strong, weak);
 
 	count = 0;
+	binder_alloc_lock(proc);
 	for (n = rb_first(&proc->allocated_buffers); n != NULL; n = rb_next(n))
 		count++;
 	seq_printf(m, "  buffers: %d\n", count);
+	seq_printf(m, "  pages mapped: %lu\n", proc->pages_mapped);
+	print_binder_hist(m, "  alloc size", 64, "B", &proc->alloc_size_hist);
+	print_binder_hist(m, "  map time", 1, "us", &proc->map_time_hist);
+	print_binder_hist(m, "  queue latency", 1, "us", &proc->queue_hist);
+	print_binder_hist(m, "  wakeup latency", 1, "us", &proc->wake_hist);
+	print_binder_hist(m, "  handle time", 1, "us", &proc->handle_hist);
+	binder_alloc_unlock(proc);
+	print_binder_lock_stats(m, "  alloc lock", &proc->alloc_lock_stats);
 
 	count = 0;
 	list_for_each_entry(w, &proc->todo, entry) {
@@ -3439,7 +3872,7 @@ static int binder_state_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 
 	seq_puts(m, "binder state:\n");
 
@@ -3451,7 +3884,7 @@ static int binder_state_show(struct seq_file *m, void *unused)
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc(m, proc, 1);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	return 0;
 }
 
@@ -3462,16 +3895,17 @@ static int binder_stats_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 
 	seq_puts(m, "binder stats:\n");
 
 	print_binder_stats(m, "", &binder_stats);
+	print_binder_lock_stats(m, "main lock", &binder_main_lock_stats);
 
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc_stats(m, proc);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	return 0;
 }
 
@@ -3482,13 +3916,13 @@ static int binder_transactions_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 
 	seq_puts(m, "binder transactions:\n");
 	hlist_for_each_entry(proc, pos, &binder_procs, proc_node)
 		print_binder_proc(m, proc, 0);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	return 0;
 }
 
@@ -3498,11 +3932,11 @@ static int binder_proc_show(struct seq_file *m, void *unused)
 	int do_lock = !binder_debug_no_lock;
 
 	if (do_lock)
-		mutex_lock(&binder_lock);
+		binder_lock();
 	seq_puts(m, "binder proc state:\n");
 	print_binder_proc(m, proc, 1);
 	if (do_lock)
-		mutex_unlock(&binder_lock);
+		binder_unlock();
 	return 0;
 }
 
@@ -3510,11 +3944,13 @@ static void print_binder_transaction_log_entry(struct seq_file *m,
 					struct binder_transaction_log_entry *e)
 {
 	seq_printf(m,
-		   "%d: %s from %d:%d to %d:%d node %d handle %d size %d:%d\n",
+		   "%d: %s from %d:%d to %d:%d node %d handle %d size %d:%d "
+		   "at %lldus wake %dus dequeue %dus\n",
 		   e->debug_id, (e->call_type == 2) ? "reply" :
 		   ((e->call_type == 1) ? "async" : "call "), e->from_proc,
 		   e->from_thread, e->to_proc, e->to_thread, e->to_node,
-		   e->target_handle, e->data_size, e->offsets_size);
+		   e->target_handle, e->data_size, e->offsets_size,
+		   e->enqueue_us, e->wake_us, e->dequeue_us);
 }
 
 static int binder_transaction_log_show(struct seq_file *m, void *unused)
@@ -0,0 +1,107 @@
+/* binder_trace.h
+ *
+ * Android IPC Subsystem tracepoints
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM binder
+
+#if !defined(_BINDER_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _BINDER_TRACE_H
+
+#include <linux/tracepoint.h>
+
+struct binder_proc;
+struct binder_thread;
+struct binder_transaction;
+
+TRACE_EVENT(binder_transaction_enqueue,
+	TP_PROTO(struct binder_transaction *t, int reply,
+		 struct binder_proc *target_proc,
+		 struct binder_thread *target_thread),
+	TP_ARGS(t, reply, target_proc, target_thread),
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, to_proc)
+		__field(int, to_thread)
+		__field(int, reply)
+		__field(unsigned int, code)
+		__field(unsigned int, flags)
+	),
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->to_proc = target_proc->pid;
+		__entry->to_thread = target_thread ? target_thread->pid : 0;
+		__entry->reply = reply;
+		__entry->code = t->code;
+		__entry->flags = t->flags;
+	),
+	TP_printk("transaction=%d dest_proc=%d dest_thread=%d reply=%d "
+		  "flags=0x%x code=0x%x",
+		  __entry->debug_id, __entry->to_proc, __entry->to_thread,
+		  __entry->reply, __entry->flags, __entry->code)
+);
+
+TRACE_EVENT(binder_transaction_dequeue,
+	TP_PROTO(struct binder_transaction *t, struct binder_thread *thread,
+		 s64 queue_us, s64 wake_us),
+	TP_ARGS(t, thread, queue_us, wake_us),
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, proc)
+		__field(int, thread)
+		__field(s64, queue_us)
+		__field(s64, wake_us)
+	),
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->proc = thread->proc->pid;
+		__entry->thread = thread->pid;
+		__entry->queue_us = queue_us;
+		__entry->wake_us = wake_us;
+	),
+	TP_printk("transaction=%d proc=%d thread=%d queue_us=%lld wake_us=%lld",
+		  __entry->debug_id, __entry->proc, __entry->thread,
+		  __entry->queue_us, __entry->wake_us)
+);
+
+TRACE_EVENT(binder_transaction_handled,
+	TP_PROTO(struct binder_transaction *t, struct binder_thread *thread,
+		 s64 handle_us),
+	TP_ARGS(t, thread, handle_us),
+	TP_STRUCT__entry(
+		__field(int, debug_id)
+		__field(int, proc)
+		__field(int, thread)
+		__field(unsigned int, code)
+		__field(s64, handle_us)
+	),
+	TP_fast_assign(
+		__entry->debug_id = t->debug_id;
+		__entry->proc = thread->proc->pid;
+		__entry->thread = thread->pid;
+		__entry->code = t->code;
+		__entry->handle_us = handle_us;
+	),
+	TP_printk("transaction=%d proc=%d thread=%d code=0x%x handle_us=%lld",
+		  __entry->debug_id, __entry->proc, __entry->thread,
+		  __entry->code, __entry->handle_us)
+);
+
+#endif /* _BINDER_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_PATH .
+#define TRACE_INCLUDE_FILE binder_trace
+#include <trace/define_trace.h>
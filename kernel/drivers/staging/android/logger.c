@@ -25,10 +25,57 @@
 #include <linux/poll.h>
 #include <linux/slab.h>
 #include <linux/time.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
+#include <linux/mm.h>
 #include "logger.h"
 
 #include <asm/ioctls.h>
 
+/*
+ * Writers do not take log->mutex. Each CPU has a small staging ring per log:
+ * a writer reserves a record in the ring of the CPU it runs on, copies its
+ * payload in, and marks the record committed. Whoever next needs the log
+ * contents (a reader, poll, an ioctl or a writer that fell back to the slow
+ * path) drains the staging rings into the log under log->mutex, merging the
+ * committed records of all CPUs in timestamp order.
+ */
+#define LOGGER_STAGE_SIZE	(8*1024)	/* per CPU, power of two */
+#define LOGGER_STAGE_MAX_REC	(LOGGER_STAGE_SIZE / 4)
+
+enum {
+	LOGGER_REC_RESERVED,	/* writer is still copying the payload */
+	LOGGER_REC_COMMITTED,	/* ready to be drained */
+	LOGGER_REC_DISCARD,	/* copy failed, skip */
+	LOGGER_REC_PAD,		/* filler up to the end of the ring */
+};
+
+/*
+ * struct logger_stage_rec - a record in a staging ring. 'size' and 'state'
+ * come first so that padding records need only four bytes.
+ */
+struct logger_stage_rec {
+	__u16			size;	/* whole record, multiple of 8 */
+	__u8			state;
+	__u8			__pad[5];
+	u64			stamp;	/* local_clock() at reservation */
+	struct logger_entry	entry;
+};
+
+/*
+ * struct logger_stage - a per-CPU staging ring. 'prod' and 'cons' are
+ * free-running byte counts protected by 'lock'; 'end' and 'drain' are only
+ * used while draining, under log->mutex.
+ */
+struct logger_stage {
+	spinlock_t		lock;
+	unsigned char		*buf;
+	unsigned long		prod;	/* bytes reserved by writers */
+	unsigned long		cons;	/* bytes given back by the drainer */
+	unsigned long		end;	/* 'prod' when the drain started */
+	unsigned long		drain;	/* drain cursor */
+};
+
 /*
  * struct logger_log - represents a specific log, such as 'main' or 'radio'
  *
@@ -45,6 +92,7 @@ struct logger_log {
 	size_t			w_off;	/* current write head offset */
 	size_t			head;	/* new readers start here */
 	size_t			size;	/* size of the log */
+	struct logger_stage __percpu *stage; /* per-CPU staging rings */
 };
 
 /*
@@ -57,6 +105,7 @@ struct logger_reader {
 	struct logger_log	*log;	/* associated log */
 	struct list_head	list;	/* entry in logger_log's list */
 	size_t			r_off;	/* current read head offset */
+	bool			batch;	/* read() returns as many entries as fit */
 };
 
 /* logger_offset - returns index 'n' into the log via (optimized) modulus */
@@ -142,6 +191,8 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
 	return count;
 }
 
+static void logger_drain_stages(struct logger_log *log);
+
 /*
  * logger_read - our log's read() method
  *
@@ -149,7 +200,8 @@ static ssize_t do_read_log_to_user(struct logger_log *log,
  *
  * 	- O_NONBLOCK works
  * 	- If there are no log entries to read, blocks until log is written to
- * 	- Atomically reads exactly one log entry
+ * 	- Atomically reads exactly one log entry, or in batch mode (see
+ * 	  LOGGER_SET_BATCH_READ) as many whole entries as fit in 'count'
  *
  * Optimal read size is LOGGER_ENTRY_MAX_LEN. Will set errno to EINVAL if read
  * buffer is insufficient to hold next entry.
@@ -167,6 +219,7 @@ start:
 		prepare_to_wait(&log->wq, &wait, TASK_INTERRUPTIBLE);
 
 		mutex_lock(&log->mutex);
+		logger_drain_stages(log);
 		ret = (log->w_off == reader->r_off);
 		mutex_unlock(&log->mutex);
 		if (!ret)
@@ -207,6 +260,19 @@ start:
 	/* get exactly one entry from the log */
 	ret = do_read_log_to_user(log, reader, buf, ret);
 
+	/* and in batch mode, keep going while whole entries fit */
+	while (reader->batch && ret > 0 && log->w_off != reader->r_off) {
+		size_t len = get_entry_len(log, reader->r_off);
+		ssize_t nr;
+
+		if (ret + len > count)
+			break;
+		nr = do_read_log_to_user(log, reader, buf + ret, len);
+		if (unlikely(nr < 0))
+			break;
+		ret += nr;
+	}
+
 out:
 	mutex_unlock(&log->mutex);
 
@@ -290,6 +356,174 @@ static void do_write_log(struct logger_log *log, const void *buf, size_t count)
 
 }
 
+/*
+ * logger_stage_reserve - reserve 'size' contiguous bytes in 'stage', padding
+ * out the end of the ring if needed. Returns NULL if there is no room.
+ *
+ * Caller must hold stage->lock.
+ */
+static struct logger_stage_rec *logger_stage_reserve(struct logger_stage *stage,
+						     size_t size)
+{
+	size_t off = stage->prod & (LOGGER_STAGE_SIZE - 1);
+	size_t pad = 0;
+	struct logger_stage_rec *rec;
+
+	if (off + size > LOGGER_STAGE_SIZE)
+		pad = LOGGER_STAGE_SIZE - off;
+	if (LOGGER_STAGE_SIZE - (stage->prod - stage->cons) < pad + size)
+		return NULL;
+
+	if (pad) {
+		rec = (struct logger_stage_rec *) (stage->buf + off);
+		rec->size = pad;
+		rec->state = LOGGER_REC_PAD;
+		stage->prod += pad;
+		off = 0;
+	}
+
+	rec = (struct logger_stage_rec *) (stage->buf + off);
+	rec->size = size;
+	rec->state = LOGGER_REC_RESERVED;
+	stage->prod += size;
+
+	return rec;
+}
+
+/*
+ * logger_stage_peek - return the next committed record of 'stage' to drain,
+ * or NULL if there is none or the next one is still being written.
+ *
+ * Caller must hold log->mutex.
+ */
+static struct logger_stage_rec *logger_stage_peek(struct logger_stage *stage)
+{
+	struct logger_stage_rec *rec;
+
+	while (stage->drain != stage->end) {
+		rec = (struct logger_stage_rec *)
+			(stage->buf + (stage->drain & (LOGGER_STAGE_SIZE - 1)));
+
+		switch (ACCESS_ONCE(rec->state)) {
+		case LOGGER_REC_COMMITTED:
+			smp_rmb();
+			return rec;
+		case LOGGER_REC_RESERVED:
+			/* keep this CPU's records in order */
+			return NULL;
+		default:
+			stage->drain += rec->size;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * logger_drain_stages - move the committed records of every CPU's staging
+ * ring into the log, oldest first.
+ *
+ * Caller must hold log->mutex.
+ */
+static void logger_drain_stages(struct logger_log *log)
+{
+	struct logger_stage *stage, *best;
+	struct logger_stage_rec *rec, *best_rec = NULL;
+	size_t len;
+	int cpu;
+
+	if (!log->stage)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		stage = per_cpu_ptr(log->stage, cpu);
+		spin_lock(&stage->lock);
+		stage->end = stage->prod;
+		stage->drain = stage->cons;
+		spin_unlock(&stage->lock);
+	}
+
+	while (1) {
+		best = NULL;
+		for_each_possible_cpu(cpu) {
+			stage = per_cpu_ptr(log->stage, cpu);
+			rec = logger_stage_peek(stage);
+			if (rec && (!best || rec->stamp < best_rec->stamp)) {
+				best = stage;
+				best_rec = rec;
+			}
+		}
+		if (!best)
+			break;
+
+		len = sizeof(struct logger_entry) + best_rec->entry.len;
+		fix_up_readers(log, len);
+		do_write_log(log, &best_rec->entry, len);
+		best->drain += best_rec->size;
+	}
+
+	for_each_possible_cpu(cpu) {
+		stage = per_cpu_ptr(log->stage, cpu);
+		spin_lock(&stage->lock);
+		stage->cons = stage->drain;
+		spin_unlock(&stage->lock);
+	}
+}
+
+/*
+ * logger_stage_write - the fast path of logger_aio_write(): stage the entry
+ * in this CPU's ring without taking log->mutex.
+ *
+ * Returns the payload length on success, -ENOSPC if the entry has to go
+ * through the slow path, or another negative error code on failure.
+ */
+static ssize_t logger_stage_write(struct logger_log *log,
+				  struct logger_entry *header,
+				  const struct iovec *iov,
+				  unsigned long nr_segs)
+{
+	struct logger_stage *stage;
+	struct logger_stage_rec *rec;
+	size_t size = ALIGN(sizeof(*rec) + header->len, 8);
+	size_t left = header->len;
+	char *p;
+
+	if (!log->stage || size > LOGGER_STAGE_MAX_REC)
+		return -ENOSPC;
+
+	stage = get_cpu_ptr(log->stage);
+	spin_lock(&stage->lock);
+	rec = logger_stage_reserve(stage, size);
+	if (rec)
+		rec->stamp = local_clock();
+	spin_unlock(&stage->lock);
+	put_cpu_ptr(log->stage);
+
+	if (!rec)
+		return -ENOSPC;
+
+	/* the record is ours now, the copy may fault and migrate */
+	rec->entry = *header;
+	p = rec->entry.msg;
+	while (nr_segs-- > 0 && left) {
+		size_t len = min_t(size_t, iov->iov_len, left);
+
+		if (copy_from_user(p, iov->iov_base, len)) {
+			smp_wmb();
+			rec->state = LOGGER_REC_DISCARD;
+			return -EFAULT;
+		}
+		p += len;
+		left -= len;
+		iov++;
+	}
+
+	smp_wmb();
+	rec->state = LOGGER_REC_COMMITTED;
+
+	return header->len;
+}
+
 /*
  * do_write_log_user - writes 'len' bytes from the user-space buffer 'buf' to
  * the log 'log'
@@ -325,7 +559,7 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 			 unsigned long nr_segs, loff_t ppos)
 {
 	struct logger_log *log = file_get_log(iocb->ki_filp);
-	size_t orig = log->w_off;
+	size_t orig;
 	struct logger_entry header;
 	struct timespec now;
 	ssize_t ret = 0;
@@ -342,8 +576,17 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 	if (unlikely(!header.len))
 		return 0;
 
+	ret = logger_stage_write(log, &header, iov, nr_segs);
+	if (ret != -ENOSPC)
+		goto out;
+	ret = 0;
+
 	mutex_lock(&log->mutex);
 
+	/* keep the order with what is already staged */
+	logger_drain_stages(log);
+	orig = log->w_off;
+
 	/*
 	 * Fix up any readers, pulling them forward to the first readable
 	 * entry after (what will be) the new write offset. We do this now
@@ -375,6 +618,10 @@ ssize_t logger_aio_write(struct kiocb *iocb, const struct iovec *iov,
 
 	mutex_unlock(&log->mutex);
 
+out:
+	if (unlikely(ret < 0))
+		return ret;
+
 	/* wake up any blocked readers */
 	wake_up_interruptible(&log->wq);
 
@@ -409,6 +656,7 @@ static int logger_open(struct inode *inode, struct file *file)
 			return -ENOMEM;
 
 		reader->log = log;
+		reader->batch = false;
 		INIT_LIST_HEAD(&reader->list);
 
 		mutex_lock(&log->mutex);
@@ -463,6 +711,7 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 	poll_wait(file, &log->wq, wait);
 
 	mutex_lock(&log->mutex);
+	logger_drain_stages(log);
 	if (log->w_off != reader->r_off)
 		ret |= POLLIN | POLLRDNORM;
 	mutex_unlock(&log->mutex);
@@ -470,6 +719,68 @@ static unsigned int logger_poll(struct file *file, poll_table *wait)
 	return ret;
 }
 
+/*
+ * logger_advance_reader - move the read head of 'reader' forward to 'off',
+ * which must be the start of an entry that has already been written (or the
+ * write offset itself).
+ *
+ * Caller must hold log->mutex.
+ */
+static long logger_advance_reader(struct logger_log *log,
+				  struct logger_reader *reader, size_t off)
+{
+	size_t r_off = reader->r_off;
+
+	if (off >= log->size)
+		return -EINVAL;
+
+	while (r_off != off) {
+		if (r_off == log->w_off)
+			return -EINVAL;
+		r_off = logger_offset(r_off + get_entry_len(log, r_off));
+	}
+
+	reader->r_off = off;
+	return 0;
+}
+
+/*
+ * logger_mmap - map the log read-only into a reader's address space
+ *
+ * The mapping is either the ring itself or, if twice the log size is asked
+ * for, the ring followed by a second view of it, so that entries wrapping
+ * around the end of the ring can be parsed in place. Readers take their
+ * positions from LOGGER_GET_READ_POS and LOGGER_GET_WRITE_POS and give back
+ * what they consumed with LOGGER_ADVANCE_READER. Entries between the two
+ * positions may be overwritten by writers at any time; a reader can tell
+ * by LOGGER_GET_READ_POS having moved on by itself.
+ */
+static int logger_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct logger_log *log = file_get_log(file);
+	unsigned long pfn = virt_to_phys(log->buffer) >> PAGE_SHIFT;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	int ret;
+
+	if (!(file->f_mode & FMODE_READ))
+		return -EBADF;
+	if (vma->vm_pgoff || (size != log->size && size != 2 * log->size))
+		return -EINVAL;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTEXPAND;
+
+	ret = remap_pfn_range(vma, vma->vm_start, pfn, log->size,
+			      vma->vm_page_prot);
+	if (ret || size == log->size)
+		return ret;
+
+	return remap_pfn_range(vma, vma->vm_start + log->size, pfn, log->size,
+			       vma->vm_page_prot);
+}
+
 static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct logger_log *log = file_get_log(file);
@@ -477,6 +788,7 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	long ret = -ENOTTY;
 
 	mutex_lock(&log->mutex);
+	logger_drain_stages(log);
 
 	switch (cmd) {
 	case LOGGER_GET_LOG_BUF_SIZE:
@@ -514,6 +826,38 @@ static long logger_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		log->head = log->w_off;
 		ret = 0;
 		break;
+	case LOGGER_SET_BATCH_READ:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		reader = file->private_data;
+		reader->batch = !!arg;
+		ret = 0;
+		break;
+	case LOGGER_GET_READ_POS:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		reader = file->private_data;
+		ret = reader->r_off;
+		break;
+	case LOGGER_GET_WRITE_POS:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		ret = log->w_off;
+		break;
+	case LOGGER_ADVANCE_READER:
+		if (!(file->f_mode & FMODE_READ)) {
+			ret = -EBADF;
+			break;
+		}
+		reader = file->private_data;
+		ret = logger_advance_reader(log, reader, arg);
+		break;
 	}
 
 	mutex_unlock(&log->mutex);
@@ -526,6 +870,7 @@ static const struct file_operations logger_fops = {
 	.read = logger_read,
 	.aio_write = logger_aio_write,
 	.poll = logger_poll,
+	.mmap = logger_mmap,
 	.unlocked_ioctl = logger_ioctl,
 	.compat_ioctl = logger_ioctl,
 	.open = logger_open,
@@ -534,11 +879,12 @@ static const struct file_operations logger_fops = {
 
 /*
  * Defines a log structure with name 'NAME' and a size of 'SIZE' bytes, which
- * must be a power of two, greater than LOGGER_ENTRY_MAX_LEN, and less than
- * LONG_MAX minus LOGGER_ENTRY_MAX_LEN.
+ * must be a power of two, greater than LOGGER_ENTRY_MAX_LEN and PAGE_SIZE,
+ * and less than LONG_MAX minus LOGGER_ENTRY_MAX_LEN. The buffer is page
+ * aligned so that it can be mapped by readers.
  */
 #define DEFINE_LOGGER_DEVICE(VAR, NAME, SIZE) \
-static unsigned char _buf_ ## VAR[SIZE]; \
+static unsigned char _buf_ ## VAR[SIZE] __aligned(PAGE_SIZE); \
 static struct logger_log VAR = { \
 	.buffer = _buf_ ## VAR, \
 	.misc = { \
@@ -573,10 +919,46 @@ static struct logger_log *get_log_from_minor(int minor)
 	return NULL;
 }
 
+/*
+ * init_log_stage - allocate the per-CPU staging rings of 'log'. On failure
+ * the log simply runs without them and every write takes log->mutex.
+ */
+static void __init init_log_stage(struct logger_log *log)
+{
+	struct logger_stage __percpu *stages;
+	struct logger_stage *stage;
+	int cpu;
+
+	stages = alloc_percpu(struct logger_stage);
+	if (!stages)
+		goto err;
+
+	for_each_possible_cpu(cpu) {
+		stage = per_cpu_ptr(stages, cpu);
+		spin_lock_init(&stage->lock);
+		stage->buf = kmalloc(LOGGER_STAGE_SIZE, GFP_KERNEL);
+		if (!stage->buf)
+			goto err_free;
+	}
+
+	log->stage = stages;
+	return;
+
+err_free:
+	for_each_possible_cpu(cpu)
+		kfree(per_cpu_ptr(stages, cpu)->buf);
+	free_percpu(stages);
+err:
+	printk(KERN_WARNING "logger: no staging rings for log '%s'\n",
+	       log->misc.name);
+}
+
 static int __init init_log(struct logger_log *log)
 {
 	int ret;
 
+	init_log_stage(log);
+
 	ret = misc_register(&log->misc);
 	if (unlikely(ret)) {
 		printk(KERN_ERR "logger: failed to register misc "
@@ -45,5 +45,9 @@ struct logger_entry {
 #define LOGGER_GET_LOG_LEN		_IO(__LOGGERIO, 2) /* used log len */
 #define LOGGER_GET_NEXT_ENTRY_LEN	_IO(__LOGGERIO, 3) /* next entry len */
 #define LOGGER_FLUSH_LOG		_IO(__LOGGERIO, 4) /* flush log */
+#define LOGGER_SET_BATCH_READ		_IO(__LOGGERIO, 5) /* multi-entry read */
+#define LOGGER_GET_READ_POS		_IO(__LOGGERIO, 6) /* mmap read offset */
+#define LOGGER_GET_WRITE_POS		_IO(__LOGGERIO, 7) /* mmap write offset */
+#define LOGGER_ADVANCE_READER		_IO(__LOGGERIO, 8) /* consume to offset */
 
 #endif /* _LINUX_LOGGER_H */
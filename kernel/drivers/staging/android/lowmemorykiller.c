@@ -16,6 +16,13 @@
  * percentage of the cached memory is locked this can be very inaccurate
  * and processes may not get killed until the normal oom killer is triggered.
  *
+ * With /sys/module/lowmemorykiller/parameters/async set, a kernel thread also
+ * kills ahead of the shrinker: when reclaim reports medium or critical
+ * pressure (see mm/vmpressure.c), the minfree thresholds are raised by
+ * kill_ahead or twice kill_ahead percent and a victim is picked from the
+ * raised table. /dev/lowmemorykiller can be polled for pressure level
+ * changes and kills; read() returns the current state as one line.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -35,6 +42,15 @@
 #include <linux/oom.h>
 #include <linux/sched.h>
 #include <linux/notifier.h>
+#include <linux/spinlock.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/wait.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/poll.h>
+#include <linux/uaccess.h>
+#include <linux/vmpressure.h>
 
 static uint32_t lowmem_debug_level = 2;
 static int lowmem_adj[6] = {
@@ -54,6 +70,62 @@ static int lowmem_minfree_size = 4;
 
 static struct task_struct *lowmem_deathpending;
 static unsigned long lowmem_deathpending_timeout;
+static DECLARE_WAIT_QUEUE_HEAD(lowmem_death_wait);
+/* Serializes victim selection between the shrinker and lowmemkd */
+static DEFINE_MUTEX(lowmem_kill_lock);
+
+enum {
+	LOWMEM_LEVEL_LOW,
+	LOWMEM_LEVEL_MEDIUM,
+	LOWMEM_LEVEL_CRITICAL,
+};
+
+static const char * const lowmem_level_names[] = {
+	"low",
+	"medium",
+	"critical",
+};
+
+static int lowmem_async;
+static int lowmem_vmpressure_medium = 60;
+static int lowmem_vmpressure_critical = 95;
+static int lowmem_kill_ahead = 25;	/* percent of minfree */
+
+static struct task_struct *lowmem_kthread_task;
+static DECLARE_WAIT_QUEUE_HEAD(lowmem_kthread_wait);
+static atomic_t lowmem_kthread_pending = ATOMIC_INIT(0);
+static atomic_t lowmem_pressure = ATOMIC_INIT(0);
+static int lowmem_last_level;
+
+/* for /dev/lowmemorykiller */
+static DECLARE_WAIT_QUEUE_HEAD(lowmem_event_wait);
+static atomic_t lowmem_event_seq = ATOMIC_INIT(0);
+static atomic_t lowmem_kill_count = ATOMIC_INIT(0);
+
+/*
+ * Candidate index: every process with an mm sits on the bucket of its
+ * oom_adj, so that picking a victim only looks at the buckets at or above
+ * the minimum adj instead of walking the whole tasklist. Processes are
+ * (re)filed when they are forked, exec'd or have their oom_adj written, and
+ * dropped when their task_struct is freed.
+ *
+ * The free notifier may run from softirq context, so the index lock is
+ * taken with interrupts disabled and nothing else is locked under it.
+ * Candidates are pinned with a reference and examined after the lock is
+ * dropped; tasks whose reference count already hit zero are about to be
+ * removed and are skipped.
+ */
+#define LOWMEM_NR_BUCKETS	(OOM_ADJUST_MAX - OOM_DISABLE + 1)
+#define LOWMEM_SCAN_BATCH	32
+
+static DEFINE_SPINLOCK(lowmem_index_lock);
+static struct list_head lowmem_buckets[LOWMEM_NR_BUCKETS];
+
+static inline struct list_head *lowmem_bucket(int oom_adj)
+{
+	return &lowmem_buckets[clamp(oom_adj, OOM_DISABLE, OOM_ADJUST_MAX) -
+			       OOM_DISABLE];
+}
 
 #define lowmem_print(level, x...)			\
 	do {						\
@@ -72,27 +144,196 @@ static int
 task_notify_func(struct notifier_block *self, unsigned long val, void *data)
 {
 	struct task_struct *task = data;
+	unsigned long flags;
 
-	if (task == lowmem_deathpending)
+	if (task == lowmem_deathpending) {
 		lowmem_deathpending = NULL;
+		wake_up(&lowmem_death_wait);
+	}
+
+	if (!list_empty(&task->lowmem_node)) {
+		spin_lock_irqsave(&lowmem_index_lock, flags);
+		list_del_init(&task->lowmem_node);
+		spin_unlock_irqrestore(&lowmem_index_lock, flags);
+	}
 
 	return NOTIFY_OK;
 }
 
-static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+/*
+ * oom_adj_notify_func - file a process on the bucket of its current oom_adj.
+ * The caller holds a reference on 'task', so its signal_struct is valid.
+ */
+static int
+oom_adj_notify_func(struct notifier_block *self, unsigned long val, void *data)
+{
+	struct task_struct *task = data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_index_lock, flags);
+	list_move_tail(&task->lowmem_node,
+		       lowmem_bucket(task->signal->oom_adj));
+	spin_unlock_irqrestore(&lowmem_index_lock, flags);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block oom_adj_nb = {
+	.notifier_call	= oom_adj_notify_func,
+};
+
+/*
+ * lowmem_pin_bucket - take a reference on up to LOWMEM_SCAN_BATCH processes
+ * of the 'oom_adj' bucket and store them in 'tasks'. The pinned processes
+ * are rotated to the tail so that the next pass sees the rest of a large
+ * bucket first. Returns the number of processes pinned.
+ */
+static int lowmem_pin_bucket(int oom_adj, struct task_struct **tasks)
+{
+	struct list_head *bucket = lowmem_bucket(oom_adj);
+	struct task_struct *p, *tmp;
+	unsigned long flags;
+	LIST_HEAD(scanned);
+	int n = 0;
+
+	spin_lock_irqsave(&lowmem_index_lock, flags);
+	list_for_each_entry_safe(p, tmp, bucket, lowmem_node) {
+		if (n == LOWMEM_SCAN_BATCH)
+			break;
+		list_move_tail(&p->lowmem_node, &scanned);
+		if (atomic_inc_not_zero(&p->usage))
+			tasks[n++] = p;
+	}
+	list_splice_tail(&scanned, bucket);
+	spin_unlock_irqrestore(&lowmem_index_lock, flags);
+
+	return n;
+}
+
+static void lowmem_event(void)
+{
+	atomic_inc(&lowmem_event_seq);
+	wake_up_interruptible(&lowmem_event_wait);
+}
+
+/*
+ * lowmem_min_adj - the lowest oom_adj that may be killed given the current
+ * free and file page counts, with the minfree thresholds raised by 'margin'
+ * percent. Returns OOM_ADJUST_MAX + 1 if nothing needs to be killed.
+ */
+static int lowmem_min_adj(int margin, int *other_free, int *other_file)
+{
+	int array_size = ARRAY_SIZE(lowmem_adj);
+	size_t minfree;
+	int i;
+
+	*other_free = global_page_state(NR_FREE_PAGES);
+	*other_file = global_page_state(NR_FILE_PAGES) -
+					global_page_state(NR_SHMEM);
+
+	if (lowmem_adj_size < array_size)
+		array_size = lowmem_adj_size;
+	if (lowmem_minfree_size < array_size)
+		array_size = lowmem_minfree_size;
+	for (i = 0; i < array_size; i++) {
+		minfree = lowmem_minfree[i] + lowmem_minfree[i] * margin / 100;
+		if (*other_free < minfree && *other_file < minfree)
+			return lowmem_adj[i];
+	}
+
+	return OOM_ADJUST_MAX + 1;
+}
+
+static bool lowmem_death_pending(void)
+{
+	return lowmem_deathpending &&
+	       time_before_eq(jiffies, lowmem_deathpending_timeout);
+}
+
+/*
+ * lowmem_kill - kill the largest process of the highest oom_adj at or above
+ * 'min_adj'. Returns the rss of the victim, or 0 if none was found or the
+ * last victim is still on its way out. Called with lowmem_kill_lock held.
+ */
+static int lowmem_kill(int min_adj)
 {
+	struct task_struct *tasks[LOWMEM_SCAN_BATCH];
 	struct task_struct *p;
 	struct task_struct *selected = NULL;
-	int rem = 0;
 	int tasksize;
-	int i;
-	int min_adj = OOM_ADJUST_MAX + 1;
+	int i, n, adj;
 	int selected_tasksize = 0;
-	int selected_oom_adj;
-	int array_size = ARRAY_SIZE(lowmem_adj);
-	int other_free = global_page_state(NR_FREE_PAGES);
-	int other_file = global_page_state(NR_FILE_PAGES) -
-						global_page_state(NR_SHMEM);
+	int selected_oom_adj = min_adj;
+
+	/* The other caller may have killed while we waited for the lock */
+	if (lowmem_death_pending())
+		return 0;
+
+	for (adj = OOM_ADJUST_MAX; adj >= min_adj && !selected; adj--) {
+		n = lowmem_pin_bucket(adj, tasks);
+
+		for (i = 0; i < n; i++) {
+			struct mm_struct *mm;
+			int oom_adj;
+
+			p = tasks[i];
+			task_lock(p);
+			mm = p->mm;
+			if (!mm) {
+				task_unlock(p);
+				continue;
+			}
+			oom_adj = p->signal->oom_adj;
+			if (oom_adj < min_adj) {
+				task_unlock(p);
+				continue;
+			}
+			tasksize = get_mm_rss(mm);
+			task_unlock(p);
+			if (tasksize <= 0)
+				continue;
+			if (selected) {
+				if (oom_adj < selected_oom_adj)
+					continue;
+				if (oom_adj == selected_oom_adj &&
+				    tasksize <= selected_tasksize)
+					continue;
+			}
+			selected = p;
+			selected_tasksize = tasksize;
+			selected_oom_adj = oom_adj;
+			lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
+				     p->pid, p->comm, oom_adj, tasksize);
+		}
+
+		for (i = 0; i < n; i++)
+			if (tasks[i] != selected)
+				put_task_struct(tasks[i]);
+	}
+	if (!selected)
+		return 0;
+
+	lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
+		     selected->pid, selected->comm,
+		     selected_oom_adj, selected_tasksize);
+	lowmem_deathpending = selected;
+	lowmem_deathpending_timeout = jiffies + HZ;
+	read_lock(&tasklist_lock);
+	force_sig(SIGKILL, selected);
+	read_unlock(&tasklist_lock);
+	put_task_struct(selected);
+
+	atomic_inc(&lowmem_kill_count);
+	lowmem_event();
+
+	return selected_tasksize;
+}
+
+static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
+{
+	int rem = 0;
+	int min_adj;
+	int other_free, other_file;
 
 	/*
 	 * If we already have a death outstanding, then
@@ -101,21 +342,10 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	 * this pass.
 	 *
 	 */
-	if (lowmem_deathpending &&
-	    time_before_eq(jiffies, lowmem_deathpending_timeout))
+	if (lowmem_death_pending())
 		return 0;
 
-	if (lowmem_adj_size < array_size)
-		array_size = lowmem_adj_size;
-	if (lowmem_minfree_size < array_size)
-		array_size = lowmem_minfree_size;
-	for (i = 0; i < array_size; i++) {
-		if (other_free < lowmem_minfree[i] &&
-		    other_file < lowmem_minfree[i]) {
-			min_adj = lowmem_adj[i];
-			break;
-		}
-	}
+	min_adj = lowmem_min_adj(0, &other_free, &other_file);
 	if (sc->nr_to_scan > 0)
 		lowmem_print(3, "lowmem_shrink %lu, %x, ofree %d %d, ma %d\n",
 			     sc->nr_to_scan, sc->gfp_mask, other_free, other_file,
@@ -129,55 +359,14 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 			     sc->nr_to_scan, sc->gfp_mask, rem);
 		return rem;
 	}
-	selected_oom_adj = min_adj;
 
-	read_lock(&tasklist_lock);
-	for_each_process(p) {
-		struct mm_struct *mm;
-		struct signal_struct *sig;
-		int oom_adj;
-
-		task_lock(p);
-		mm = p->mm;
-		sig = p->signal;
-		if (!mm || !sig) {
-			task_unlock(p);
-			continue;
-		}
-		oom_adj = sig->oom_adj;
-		if (oom_adj < min_adj) {
-			task_unlock(p);
-			continue;
-		}
-		tasksize = get_mm_rss(mm);
-		task_unlock(p);
-		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_adj < selected_oom_adj)
-				continue;
-			if (oom_adj == selected_oom_adj &&
-			    tasksize <= selected_tasksize)
-				continue;
-		}
-		selected = p;
-		selected_tasksize = tasksize;
-		selected_oom_adj = oom_adj;
-		lowmem_print(2, "select %d (%s), adj %d, size %d, to kill\n",
-			     p->pid, p->comm, oom_adj, tasksize);
-	}
-	if (selected) {
-		lowmem_print(1, "send sigkill to %d (%s), adj %d, size %d\n",
-			     selected->pid, selected->comm,
-			     selected_oom_adj, selected_tasksize);
-		lowmem_deathpending = selected;
-		lowmem_deathpending_timeout = jiffies + HZ;
-		force_sig(SIGKILL, selected);
-		rem -= selected_tasksize;
-	}
+	/* Do not hold up reclaim while lowmemkd is picking a victim */
+	if (!mutex_trylock(&lowmem_kill_lock))
+		return 0;
+	rem -= lowmem_kill(min_adj);
+	mutex_unlock(&lowmem_kill_lock);
 	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
 		     sc->nr_to_scan, sc->gfp_mask, rem);
-	read_unlock(&tasklist_lock);
 	return rem;
 }
 
@@ -186,9 +375,169 @@ static struct shrinker lowmem_shrinker = {
 	.seeks = DEFAULT_SEEKS * 16
 };
 
+static int lowmem_level(int pressure)
+{
+	if (pressure >= lowmem_vmpressure_critical)
+		return LOWMEM_LEVEL_CRITICAL;
+	if (pressure >= lowmem_vmpressure_medium)
+		return LOWMEM_LEVEL_MEDIUM;
+	return LOWMEM_LEVEL_LOW;
+}
+
+/*
+ * lowmem_vmpressure_func - called from reclaim with the pressure of the
+ * last window, 0 (everything scanned was reclaimed) to 100 (nothing was).
+ */
+static int lowmem_vmpressure_func(struct notifier_block *self,
+				  unsigned long pressure, void *data)
+{
+	int level = lowmem_level(pressure);
+
+	atomic_set(&lowmem_pressure, pressure);
+	if (level != lowmem_last_level) {
+		lowmem_last_level = level;
+		lowmem_event();
+	}
+
+	if (lowmem_async && level >= LOWMEM_LEVEL_MEDIUM) {
+		atomic_set(&lowmem_kthread_pending, 1);
+		wake_up(&lowmem_kthread_wait);
+	}
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block lowmem_vmpressure_nb = {
+	.notifier_call	= lowmem_vmpressure_func,
+};
+
+static int lowmem_kthread(void *unused)
+{
+	int level, margin, min_adj;
+	int other_free, other_file;
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(lowmem_kthread_wait,
+				atomic_xchg(&lowmem_kthread_pending, 0) ||
+				kthread_should_stop());
+		if (!lowmem_async)
+			continue;
+
+		/* give the last victim a chance to go away first */
+		if (lowmem_death_pending()) {
+			wait_event_timeout(lowmem_death_wait,
+				!lowmem_death_pending(), HZ);
+			/*
+			 * Whether it went away or the wait timed out, the
+			 * pressure that woke us up predates the kill: go on
+			 * only if reclaim has reported it again since.
+			 */
+			if (!atomic_xchg(&lowmem_kthread_pending, 0))
+				continue;
+		}
+
+		mutex_lock(&lowmem_kill_lock);
+		level = lowmem_level(atomic_read(&lowmem_pressure));
+		if (level == LOWMEM_LEVEL_LOW)
+			goto unlock;
+
+		margin = lowmem_kill_ahead;
+		if (level == LOWMEM_LEVEL_CRITICAL)
+			margin *= 2;
+		min_adj = lowmem_min_adj(margin, &other_free, &other_file);
+		lowmem_print(3, "lowmemkd %s, ofree %d %d, ma %d\n",
+			     lowmem_level_names[level], other_free, other_file,
+			     min_adj);
+		if (min_adj != OOM_ADJUST_MAX + 1)
+			lowmem_kill(min_adj);
+unlock:
+		mutex_unlock(&lowmem_kill_lock);
+	}
+
+	return 0;
+}
+
+static int lowmem_event_open(struct inode *inode, struct file *file)
+{
+	file->private_data = (void *)(long)atomic_read(&lowmem_event_seq);
+	return nonseekable_open(inode, file);
+}
+
+static ssize_t lowmem_event_read(struct file *file, char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	char buffer[80];
+	int pressure = atomic_read(&lowmem_pressure);
+	long seq = atomic_read(&lowmem_event_seq);
+	int len;
+
+	/*
+	 * The line is read to EOF once per event: after a new one, start
+	 * over from the beginning, as poll() expects.
+	 */
+	if ((long)file->private_data != seq)
+		*ppos = 0;
+	file->private_data = (void *)seq;
+
+	len = snprintf(buffer, sizeof(buffer), "level %s pressure %d kills %d\n",
+		       lowmem_level_names[lowmem_level(pressure)], pressure,
+		       atomic_read(&lowmem_kill_count));
+
+	return simple_read_from_buffer(buf, count, ppos, buffer, len);
+}
+
+static unsigned int lowmem_event_poll(struct file *file, poll_table *wait)
+{
+	poll_wait(file, &lowmem_event_wait, wait);
+	if ((long)file->private_data != atomic_read(&lowmem_event_seq))
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
+
+static const struct file_operations lowmem_event_fops = {
+	.owner = THIS_MODULE,
+	.open = lowmem_event_open,
+	.read = lowmem_event_read,
+	.poll = lowmem_event_poll,
+	.llseek = no_llseek,
+};
+
+static struct miscdevice lowmem_event_misc = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "lowmemorykiller",
+	.fops = &lowmem_event_fops,
+};
+
 static int __init lowmem_init(void)
 {
+	struct task_struct *p;
+	int i;
+
+	for (i = 0; i < LOWMEM_NR_BUCKETS; i++)
+		INIT_LIST_HEAD(&lowmem_buckets[i]);
+
 	task_free_register(&task_nb);
+	oom_adj_register(&oom_adj_nb);
+
+	/* index the processes that were forked before we registered */
+	read_lock(&tasklist_lock);
+	for_each_process(p) {
+		if (p->mm)
+			oom_adj_notify_func(&oom_adj_nb, 0, p);
+	}
+	read_unlock(&tasklist_lock);
+
+	lowmem_kthread_task = kthread_run(lowmem_kthread, NULL, "lowmemkd");
+	if (IS_ERR(lowmem_kthread_task)) {
+		printk(KERN_ERR "lowmemorykiller: no kill thread, async mode "
+		       "disabled\n");
+		lowmem_kthread_task = NULL;
+	}
+	vmpressure_register(&lowmem_vmpressure_nb);
+	if (misc_register(&lowmem_event_misc))
+		printk(KERN_ERR "lowmemorykiller: cannot register event "
+		       "device\n");
+
 	register_shrinker(&lowmem_shrinker);
 	return 0;
 }
@@ -196,6 +545,11 @@ static int __init lowmem_init(void)
 static void __exit lowmem_exit(void)
 {
 	unregister_shrinker(&lowmem_shrinker);
+	misc_deregister(&lowmem_event_misc);
+	vmpressure_unregister(&lowmem_vmpressure_nb);
+	if (lowmem_kthread_task)
+		kthread_stop(lowmem_kthread_task);
+	oom_adj_unregister(&oom_adj_nb);
 	task_free_unregister(&task_nb);
 }
 
@@ -205,9 +559,14 @@ module_param_array_named(adj, lowmem_adj, int, &lowmem_adj_size,
 module_param_array_named(minfree, lowmem_minfree, uint, &lowmem_minfree_size,
 			 S_IRUGO | S_IWUSR);
 module_param_named(debug_level, lowmem_debug_level, uint, S_IRUGO | S_IWUSR);
+module_param_named(async, lowmem_async, int, S_IRUGO | S_IWUSR);
+module_param_named(vmpressure_medium, lowmem_vmpressure_medium, int,
+		   S_IRUGO | S_IWUSR);
+module_param_named(vmpressure_critical, lowmem_vmpressure_critical, int,
+		   S_IRUGO | S_IWUSR);
+module_param_named(kill_ahead, lowmem_kill_ahead, int, S_IRUGO | S_IWUSR);
 
 module_init(lowmem_init);
 module_exit(lowmem_exit);
 
 MODULE_LICENSE("GPL");
-
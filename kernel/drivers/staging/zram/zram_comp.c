@@ -0,0 +1,81 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com/
+ */
+
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lzo.h>
+#include <linux/lz4.h>
+
+#include "zram_drv.h"
+
+/*
+ * Available compression backends. The first entry is the default
+ * for newly created devices.
+ */
+static struct zram_backend zram_backends[] = {
+	{
+		.name		= "lzo",
+		.workmem_size	= LZO1X_MEM_COMPRESS,
+		.compress	= lzo1x_1_compress,
+		.decompress	= lzo1x_decompress_safe,
+	},
+#ifdef CONFIG_ZRAM_LZ4
+	{
+		.name		= "lz4",
+		.workmem_size	= LZ4_MEM_COMPRESS,
+		.compress	= lz4_compress,
+		.decompress	= lz4_decompress_safe,
+	},
+#endif
+};
+
+struct zram_backend *zram_default_backend(void)
+{
+	return &zram_backends[0];
+}
+
+struct zram_backend *zram_find_backend(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(zram_backends); i++) {
+		if (sysfs_streq(name, zram_backends[i].name))
+			return &zram_backends[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * List available backends, with the one in use enclosed in brackets:
+ * "[lzo] lz4"
+ */
+ssize_t zram_show_backends(struct zram_backend *cur, char *buf)
+{
+	int i;
+	ssize_t sz = 0;
+
+	for (i = 0; i < ARRAY_SIZE(zram_backends); i++) {
+		if (&zram_backends[i] == cur)
+			sz += sprintf(buf + sz, "[%s] ",
+					zram_backends[i].name);
+		else
+			sz += sprintf(buf + sz, "%s ", zram_backends[i].name);
+	}
+
+	/* Replace the trailing space with a newline */
+	buf[sz - 1] = '\n';
+
+	return sz;
+}
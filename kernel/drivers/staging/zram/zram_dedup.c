@@ -0,0 +1,114 @@
+/*
+ * Compressed RAM block device
+ *
+ * Copyright (C) 2008, 2009, 2010  Nitin Gupta
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ *
+ * Project home: http://compcache.googlecode.com/
+ */
+
+#include <linux/kernel.h>
+#include <linux/jhash.h>
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+
+#include "zram_drv.h"
+
+/*
+ * Content index of compressed objects. Entries are keyed by a checksum
+ * of the uncompressed page, so a duplicate can be found before paying
+ * for compression. Different pages may share a checksum; callers must
+ * verify the content of an entry returned by zram_dedup_get().
+ *
+ * The tree and all refcounts are protected by zram->dedup_lock.
+ */
+
+u32 zram_dedup_checksum(void *mem)
+{
+	return jhash2(mem, PAGE_SIZE / sizeof(u32), 0);
+}
+
+/*
+ * Look up an object with the given checksum and take a reference on it.
+ * Returns NULL if there is none.
+ */
+struct zram_dedup_entry *zram_dedup_get(struct zram *zram, u32 checksum)
+{
+	struct rb_node *node;
+	struct zram_dedup_entry *entry;
+
+	spin_lock(&zram->dedup_lock);
+	node = zram->dedup_root.rb_node;
+	while (node) {
+		entry = rb_entry(node, struct zram_dedup_entry, rb_node);
+		if (checksum == entry->checksum) {
+			entry->refcount++;
+			spin_unlock(&zram->dedup_lock);
+			return entry;
+		}
+
+		node = checksum < entry->checksum ?
+			node->rb_left : node->rb_right;
+	}
+	spin_unlock(&zram->dedup_lock);
+
+	return NULL;
+}
+
+/*
+ * Create an index entry, holding one reference, for a newly stored
+ * compressed object. Returns NULL if no memory is available, in which
+ * case the object is simply stored without being indexed.
+ */
+struct zram_dedup_entry *zram_dedup_insert(struct zram *zram, u32 checksum,
+		struct page *page, u32 offset)
+{
+	struct rb_node **link, *parent = NULL;
+	struct zram_dedup_entry *entry, *tmp;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO);
+	if (!entry)
+		return NULL;
+
+	entry->checksum = checksum;
+	entry->page = page;
+	entry->offset = offset;
+	entry->refcount = 1;
+
+	spin_lock(&zram->dedup_lock);
+	link = &zram->dedup_root.rb_node;
+	while (*link) {
+		parent = *link;
+		tmp = rb_entry(parent, struct zram_dedup_entry, rb_node);
+		link = checksum < tmp->checksum ?
+			&parent->rb_left : &parent->rb_right;
+	}
+	rb_link_node(&entry->rb_node, parent, link);
+	rb_insert_color(&entry->rb_node, &zram->dedup_root);
+	spin_unlock(&zram->dedup_lock);
+
+	return entry;
+}
+
+/*
+ * Drop a reference. Returns 1 if this was the last one: the entry has
+ * then been removed from the index and the caller must free both the
+ * compressed object and the entry itself.
+ */
+int zram_dedup_put(struct zram *zram, struct zram_dedup_entry *entry)
+{
+	int last;
+
+	spin_lock(&zram->dedup_lock);
+	last = !--entry->refcount;
+	if (last)
+		rb_erase(&entry->rb_node, &zram->dedup_root);
+	spin_unlock(&zram->dedup_lock);
+
+	return last;
+}
@@ -29,9 +29,11 @@
 #include <linux/genhd.h>
 #include <linux/highmem.h>
 #include <linux/slab.h>
-#include <linux/lzo.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
+#include <linux/sched.h>
+#include <linux/completion.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
@@ -89,21 +91,157 @@ static void zram_clear_flag(struct zram *zram, u32 index,
 	zram->table[index].flags &= ~BIT(flag);
 }
 
-static int page_zero_filled(void *ptr)
+static int page_same_filled(void *ptr, unsigned long *element)
 {
-	unsigned int pos;
+	unsigned int pos, last;
 	unsigned long *page;
 
 	page = (unsigned long *)ptr;
+	last = PAGE_SIZE / sizeof(*page) - 1;
+
+	/* Cheap early reject for the common case of a mixed page */
+	if (page[0] != page[last])
+		return 0;
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 1; pos < last; pos++) {
+		if (page[pos] != page[0])
 			return 0;
 	}
 
+	*element = page[0];
 	return 1;
 }
 
+static void zram_stream_free(struct zram_stream *zstrm)
+{
+	kfree(zstrm->workmem);
+	free_pages((unsigned long)zstrm->buffer, 1);
+	kfree(zstrm);
+}
+
+static struct zram_stream *zram_stream_alloc(struct zram *zram, gfp_t flags)
+{
+	struct zram_stream *zstrm;
+
+	zstrm = kzalloc(sizeof(*zstrm), flags);
+	if (!zstrm)
+		return NULL;
+
+	zstrm->workmem = kzalloc(zram->backend->workmem_size, flags);
+
+	/*
+	 * Allocate 2 pages: 1 for compressed data, plus 1 extra for the
+	 * case when compressed size is larger than the original one.
+	 */
+	zstrm->buffer = (void *)__get_free_pages(flags | __GFP_ZERO, 1);
+	if (!zstrm->workmem || !zstrm->buffer) {
+		zram_stream_free(zstrm);
+		return NULL;
+	}
+
+	return zstrm;
+}
+
+static int zram_stream_available(struct zram *zram)
+{
+	return !list_empty(&zram->idle_strm) ||
+		zram->avail_strm < zram->max_strm;
+}
+
+/*
+ * Get an idle compression stream. If none is idle and the pool has not
+ * yet reached max_strm, try to allocate a new one; otherwise sleep until
+ * another writer releases its stream.
+ */
+static struct zram_stream *zram_stream_get(struct zram *zram)
+{
+	struct zram_stream *zstrm;
+
+	while (1) {
+		spin_lock(&zram->strm_lock);
+		if (!list_empty(&zram->idle_strm)) {
+			zstrm = list_entry(zram->idle_strm.next,
+					struct zram_stream, list);
+			list_del(&zstrm->list);
+			spin_unlock(&zram->strm_lock);
+			return zstrm;
+		}
+
+		if (zram->avail_strm >= zram->max_strm) {
+			spin_unlock(&zram->strm_lock);
+			wait_event(zram->strm_wait,
+				zram_stream_available(zram));
+			continue;
+		}
+
+		zram->avail_strm++;
+		spin_unlock(&zram->strm_lock);
+
+		zstrm = zram_stream_alloc(zram, GFP_NOIO);
+		if (likely(zstrm))
+			return zstrm;
+
+		/* Out of memory: fall back to waiting for an existing one */
+		spin_lock(&zram->strm_lock);
+		zram->avail_strm--;
+		spin_unlock(&zram->strm_lock);
+		wait_event(zram->strm_wait, !list_empty(&zram->idle_strm));
+	}
+}
+
+static void zram_stream_put(struct zram *zram, struct zram_stream *zstrm)
+{
+	spin_lock(&zram->strm_lock);
+	/* Shrink the pool if max_strm was lowered while we were busy */
+	if (zram->avail_strm > zram->max_strm) {
+		zram->avail_strm--;
+		spin_unlock(&zram->strm_lock);
+		zram_stream_free(zstrm);
+		return;
+	}
+
+	list_add(&zstrm->list, &zram->idle_strm);
+	spin_unlock(&zram->strm_lock);
+	wake_up(&zram->strm_wait);
+}
+
+static void zram_stream_destroy_all(struct zram *zram)
+{
+	struct zram_stream *zstrm;
+
+	while (!list_empty(&zram->idle_strm)) {
+		zstrm = list_entry(zram->idle_strm.next,
+				struct zram_stream, list);
+		list_del(&zstrm->list);
+		zram_stream_free(zstrm);
+		zram->avail_strm--;
+	}
+}
+
+void zram_set_max_streams(struct zram *zram, int num_strm)
+{
+	struct zram_stream *zstrm;
+
+	spin_lock(&zram->strm_lock);
+	zram->max_strm = num_strm;
+
+	/* Release idle streams above the new limit right away */
+	while (zram->avail_strm > zram->max_strm &&
+			!list_empty(&zram->idle_strm)) {
+		zstrm = list_entry(zram->idle_strm.next,
+				struct zram_stream, list);
+		list_del(&zstrm->list);
+		zram->avail_strm--;
+		spin_unlock(&zram->strm_lock);
+		zram_stream_free(zstrm);
+		spin_lock(&zram->strm_lock);
+	}
+	spin_unlock(&zram->strm_lock);
+
+	/* Waiters may now be allowed to allocate a stream of their own */
+	wake_up_all(&zram->strm_wait);
+}
+
 static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 {
 	if (!zram->disksize) {
@@ -133,56 +271,135 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
-static void zram_free_page(struct zram *zram, size_t index)
+#ifdef CONFIG_ZRAM_WRITEBACK
+static unsigned long zram_bd_alloc(struct zram *zram)
+{
+	unsigned long blk;
+
+	spin_lock(&zram->bd_lock);
+	blk = find_next_zero_bit(zram->bd_bitmap, zram->bd_nr_pages,
+				zram->bd_next);
+	if (blk >= zram->bd_nr_pages)
+		blk = find_first_zero_bit(zram->bd_bitmap, zram->bd_nr_pages);
+	if (blk >= zram->bd_nr_pages) {
+		spin_unlock(&zram->bd_lock);
+		return 0;
+	}
+
+	__set_bit(blk, zram->bd_bitmap);
+	zram->bd_next = blk + 1;
+	spin_unlock(&zram->bd_lock);
+
+	return blk;
+}
+
+static void zram_bd_free(struct zram *zram, unsigned long blk)
+{
+	spin_lock(&zram->bd_lock);
+	WARN_ON(!test_bit(blk, zram->bd_bitmap));
+	__clear_bit(blk, zram->bd_bitmap);
+	spin_unlock(&zram->bd_lock);
+}
+#else
+static inline void zram_bd_free(struct zram *zram, unsigned long blk) {}
+#endif
+
+/*
+ * Free a compressed object and remove it from the stats.
+ * Called with table_lock held for writing.
+ */
+static void zram_free_obj(struct zram *zram, struct page *page, u32 offset)
 {
 	u32 clen;
 	void *obj;
 
+	obj = kmap_atomic(page, KM_USER0) + offset;
+	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
+	kunmap_atomic(obj, KM_USER0);
+
+	xv_free(zram->mem_pool, page, offset);
+	if (clen <= PAGE_SIZE / 2)
+		zram_stat_dec(&zram->stats.good_compress);
+
+	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
+}
+
+static void zram_free_page(struct zram *zram, size_t index)
+{
 	struct page *page = zram->table[index].page;
 	u32 offset = zram->table[index].offset;
 
-	if (unlikely(!page)) {
+	/* Also tells a pending writeback that the page has changed */
+	zram_clear_flag(zram, index, ZRAM_IDLE);
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
 		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
+		 * No memory is allocated for same element filled pages.
+		 * Simply clear same page flag.
 		 */
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			zram_clear_flag(zram, index, ZRAM_ZERO);
+		if (!zram->table[index].element)
 			zram_stat_dec(&zram->stats.pages_zero);
-		}
+		zram_stat_dec(&zram->stats.pages_same);
+		zram_clear_flag(zram, index, ZRAM_SAME);
+		zram->table[index].element = 0;
 		return;
 	}
 
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		zram_bd_free(zram, zram->table[index].element);
+		zram_clear_flag(zram, index, ZRAM_WB);
+		zram_stat_dec(&zram->stats.bd_count);
+		goto out;
+	}
+
+	if (unlikely(!page))
+		return;
+
 	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		clen = PAGE_SIZE;
 		__free_page(page);
 		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
 		zram_stat_dec(&zram->stats.pages_expand);
+		zram_stat64_sub(zram, &zram->stats.compr_size, PAGE_SIZE);
 		goto out;
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		struct zram_dedup_entry *entry = zram->table[index].entry;
 
-	xv_free(zram->mem_pool, page, offset);
-	if (clen <= PAGE_SIZE / 2)
-		zram_stat_dec(&zram->stats.good_compress);
+		zram_clear_flag(zram, index, ZRAM_DEDUP);
+		if (!zram_dedup_put(zram, entry)) {
+			/* Object is still used by other pages */
+			zram_stat_dec(&zram->stats.pages_dup);
+			goto out;
+		}
+
+		page = entry->page;
+		offset = entry->offset;
+		kfree(entry);
+	}
+
+	zram_free_obj(zram, page, offset);
 
 out:
-	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
 	zram_stat_dec(&zram->stats.pages_stored);
 
 	zram->table[index].page = NULL;
 	zram->table[index].offset = 0;
 }
 
-static void handle_zero_page(struct page *page)
+static void handle_same_page(struct page *page, unsigned long element)
 {
-	void *user_mem;
+	unsigned int pos;
+	unsigned long *user_mem;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	memset(user_mem, 0, PAGE_SIZE);
+	if (!element) {
+		memset(user_mem, 0, PAGE_SIZE);
+	} else {
+		for (pos = 0; pos < PAGE_SIZE / sizeof(*user_mem); pos++)
+			user_mem[pos] = element;
+	}
 	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
@@ -198,10 +415,257 @@ static void handle_uncompressed_page(struct zram *zram,
 			zram->table[index].offset;
 
 	memcpy(user_mem, cmem, PAGE_SIZE);
+	kunmap_atomic(cmem, KM_USER1);
 	kunmap_atomic(user_mem, KM_USER0);
+
+	flush_dcache_page(page);
+}
+
+/*
+ * Drop a reference to a dedup entry outside of the table, freeing the
+ * object if it was the last one.
+ */
+static void zram_dedup_release(struct zram *zram,
+		struct zram_dedup_entry *entry)
+{
+	if (!zram_dedup_put(zram, entry))
+		return;
+
+	write_lock(&zram->table_lock);
+	zram_free_obj(zram, entry->page, entry->offset);
+	write_unlock(&zram->table_lock);
+	kfree(entry);
+}
+
+/*
+ * Look for an already stored object with the same content as page.
+ * Candidates are verified by decompressing them into the stream buffer,
+ * which is still much cheaper than compressing the page. On success a
+ * reference to the returned entry is held for the caller.
+ */
+static struct zram_dedup_entry *zram_dedup_find(struct zram *zram,
+		struct zram_stream *zstrm, struct page *page, u32 checksum)
+{
+	int ret, match = 0;
+	size_t clen = PAGE_SIZE;
+	struct zram_dedup_entry *entry;
+	unsigned char *user_mem, *cmem;
+
+	entry = zram_dedup_get(zram, checksum);
+	if (!entry)
+		return NULL;
+
+	cmem = kmap_atomic(entry->page, KM_USER0) + entry->offset;
+	ret = zram->backend->decompress(
+		cmem + sizeof(struct zobj_header),
+		xv_get_object_size(cmem) - sizeof(struct zobj_header),
+		zstrm->buffer, &clen);
+	kunmap_atomic(cmem, KM_USER0);
+
+	if (!ret && clen == PAGE_SIZE) {
+		user_mem = kmap_atomic(page, KM_USER0);
+		match = !memcmp(user_mem, zstrm->buffer, PAGE_SIZE);
+		kunmap_atomic(user_mem, KM_USER0);
+	}
+
+	if (match)
+		return entry;
+
+	zram_dedup_release(zram, entry);
+	return NULL;
+}
+
+/*
+ * Trial-compress the first raw_probe_size bytes of the page. If even this
+ * prefix does not shrink below the ratio max_zpage_size demands of a whole
+ * page, the page is very likely incompressible and is stored as-is
+ * without paying for compression of the full page.
+ */
+static int zram_probe_incompressible(struct zram *zram,
+		struct zram_stream *zstrm, void *user_mem)
+{
+	size_t clen;
+	unsigned int probe = zram->raw_probe_size;
+
+	if (!probe)
+		return 0;
+
+	if (zram->backend->compress(user_mem, probe, zstrm->buffer, &clen,
+			zstrm->workmem))
+		return 0;
+
+	return clen * PAGE_SIZE > (size_t)probe * max_zpage_size;
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+static void zram_bd_end_io(struct bio *bio, int err)
+{
+	complete(bio->bi_private);
+}
+
+/*
+ * Synchronously transfer nr_pages pages to/from consecutive blocks of
+ * the backing device starting at blk. Returns the number of pages
+ * transferred successfully.
+ */
+static int zram_bd_rw(struct zram *zram, int rw, struct page **pages,
+		int nr_pages, unsigned long blk)
+{
+	int i, done = 0;
+	struct bio *bio;
+	DECLARE_COMPLETION_ONSTACK(wait);
+
+	bio = bio_alloc(GFP_NOIO, nr_pages);
+	if (!bio)
+		return 0;
+
+	bio->bi_bdev = zram->bdev;
+	bio->bi_sector = blk << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_end_io = zram_bd_end_io;
+	bio->bi_private = &wait;
+
+	for (i = 0; i < nr_pages; i++) {
+		if (bio_add_page(bio, pages[i], PAGE_SIZE, 0) != PAGE_SIZE)
+			break;
+	}
+
+	submit_bio(rw, bio);
+	wait_for_completion(&wait);
+
+	if (test_bit(BIO_UPTODATE, &bio->bi_flags))
+		done = i;
+	bio_put(bio);
+
+	return done;
+}
+
+struct zram_bd_read_work {
+	struct work_struct work;
+	struct zram *zram;
+	struct page *page;
+	unsigned long blk;
+	int ret;
+};
+
+static void zram_bd_read_work_fn(struct work_struct *work)
+{
+	struct zram_bd_read_work *rw;
+
+	rw = container_of(work, struct zram_bd_read_work, work);
+	rw->ret = zram_bd_rw(rw->zram, READ, &rw->page, 1, rw->blk) == 1 ?
+			0 : -EIO;
+}
+
+/*
+ * We are called from zram_make_request(), where generic_make_request()
+ * only queues new bios until we return, so waiting for a read from the
+ * backing device here would deadlock. Let a worker submit and wait.
+ */
+static int zram_read_from_bd(struct zram *zram, struct page *page,
+		unsigned long blk)
+{
+	struct zram_bd_read_work rw;
+
+	rw.zram = zram;
+	rw.page = page;
+	rw.blk = blk;
+
+	INIT_WORK_ONSTACK(&rw.work, zram_bd_read_work_fn);
+	schedule_work(&rw.work);
+	flush_work(&rw.work);
+	destroy_work_on_stack(&rw.work);
+
+	if (!rw.ret)
+		zram_stat64_inc(zram, &zram->stats.bd_reads);
+
+	return rw.ret;
+}
+#else
+static inline int zram_read_from_bd(struct zram *zram, struct page *page,
+		unsigned long blk)
+{
+	return -EIO;
+}
+#endif
+
+/*
+ * Fill page with the contents of the given disk page.
+ */
+static int zram_read_page(struct zram *zram, struct page *page, u32 index)
+{
+	int ret;
+	u32 offset;
+	size_t clen;
+	unsigned long element;
+	struct page *obj_page;
+	struct zobj_header *zheader;
+	unsigned char *user_mem, *cmem;
+
+	read_lock(&zram->table_lock);
+
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		element = zram->table[index].element;
+		read_unlock(&zram->table_lock);
+		handle_same_page(page, element);
+		return 0;
+	}
+
+	/* Page has been written back to the backing device */
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		element = zram->table[index].element;
+		read_unlock(&zram->table_lock);
+		ret = zram_read_from_bd(zram, page, element);
+		flush_dcache_page(page);
+		return ret;
+	}
+
+	/* Requested page is not present in compressed area */
+	if (unlikely(!zram->table[index].page)) {
+		read_unlock(&zram->table_lock);
+		pr_debug("Read before write: page=%u\n", index);
+		handle_same_page(page, 0);
+		return 0;
+	}
+
+	/* Page is stored uncompressed since it's incompressible */
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		handle_uncompressed_page(zram, page, index);
+		read_unlock(&zram->table_lock);
+		return 0;
+	}
+
+	if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+		obj_page = zram->table[index].entry->page;
+		offset = zram->table[index].entry->offset;
+	} else {
+		obj_page = zram->table[index].page;
+		offset = zram->table[index].offset;
+	}
+
+	user_mem = kmap_atomic(page, KM_USER0);
+	clen = PAGE_SIZE;
+
+	cmem = kmap_atomic(obj_page, KM_USER1) + offset;
+
+	ret = zram->backend->decompress(
+		cmem + sizeof(*zheader),
+		xv_get_object_size(cmem) - sizeof(*zheader),
+		user_mem, &clen);
+
 	kunmap_atomic(cmem, KM_USER1);
+	kunmap_atomic(user_mem, KM_USER0);
+
+	read_unlock(&zram->table_lock);
+
+	/* Should NEVER happen. Return bio error if it does. */
+	if (unlikely(ret || clen != PAGE_SIZE)) {
+		pr_err("Decompression failed! err=%d, page=%u\n",
+			ret, index);
+		return -EIO;
+	}
 
 	flush_dcache_page(page);
+	return 0;
 }
 
 static void zram_read(struct zram *zram, struct bio *bio)
@@ -215,68 +679,193 @@ static void zram_read(struct zram *zram, struct bio *bio)
 	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
 
 	bio_for_each_segment(bvec, bio, i) {
-		int ret;
-		size_t clen;
-		struct page *page;
-		struct zobj_header *zheader;
-		unsigned char *user_mem, *cmem;
-
-		page = bvec->bv_page;
-
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			handle_zero_page(page);
-			index++;
-			continue;
+		if (zram_read_page(zram, bvec->bv_page, index)) {
+			zram_stat64_inc(zram, &zram->stats.failed_reads);
+			goto out;
 		}
 
-		/* Requested page is not present in compressed area */
-		if (unlikely(!zram->table[index].page)) {
-			pr_debug("Read before write: sector=%lu, size=%u",
-				(ulong)(bio->bi_sector), bio->bi_size);
-			handle_zero_page(page);
-			index++;
-			continue;
+		/* An accessed page is no longer idle */
+		if (unlikely(zram_test_flag(zram, index, ZRAM_IDLE))) {
+			write_lock(&zram->table_lock);
+			zram_clear_flag(zram, index, ZRAM_IDLE);
+			write_unlock(&zram->table_lock);
 		}
 
-		/* Page is stored uncompressed since it's incompressible */
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-			handle_uncompressed_page(zram, page, index);
-			index++;
-			continue;
-		}
+		index++;
+	}
 
-		user_mem = kmap_atomic(page, KM_USER0);
-		clen = PAGE_SIZE;
+	set_bit(BIO_UPTODATE, &bio->bi_flags);
+	bio_endio(bio, 0);
+	return;
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+out:
+	bio_io_error(bio);
+}
 
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
+/*
+ * Compression runs outside of table_lock using a stream borrowed from
+ * the per-device pool, so writers to different pages only contend for
+ * the short table update at the end.
+ */
+static int zram_write_page(struct zram *zram, struct page *page, u32 index)
+{
+	int ret, dedup;
+	u32 offset, checksum = 0;
+	size_t clen;
+	unsigned long element;
+	struct zobj_header *zheader;
+	struct zram_stream *zstrm;
+	struct zram_dedup_entry *entry = NULL;
+	struct page *page_store;
+	unsigned char *user_mem, *cmem, *src;
+
+	dedup = zram->dedup_enable;
 
+	user_mem = kmap_atomic(page, KM_USER0);
+	if (page_same_filled(user_mem, &element)) {
 		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
 
-		/* Should NEVER happen. Return bio error if it does. */
-		if (unlikely(ret != LZO_E_OK)) {
-			pr_err("Decompression failed! err=%d, page=%u\n",
-				ret, index);
-			zram_stat64_inc(zram, &zram->stats.failed_reads);
-			goto out;
+		write_lock(&zram->table_lock);
+		/*
+		 * System overwrites unused sectors. Free memory
+		 * associated with this sector now.
+		 */
+		zram_free_page(zram, index);
+		zram->table[index].element = element;
+		zram_set_flag(zram, index, ZRAM_SAME);
+		zram_stat_inc(&zram->stats.pages_same);
+		if (!element)
+			zram_stat_inc(&zram->stats.pages_zero);
+		write_unlock(&zram->table_lock);
+
+		return 0;
+	}
+	if (dedup)
+		checksum = zram_dedup_checksum(user_mem);
+	kunmap_atomic(user_mem, KM_USER0);
+
+	zstrm = zram_stream_get(zram);
+	src = zstrm->buffer;
+
+	if (dedup) {
+		entry = zram_dedup_find(zram, zstrm, page, checksum);
+		if (entry) {
+			zram_stream_put(zram, zstrm);
+			zram_stat64_inc(zram, &zram->stats.dup_hits);
+
+			write_lock(&zram->table_lock);
+			zram_free_page(zram, index);
+			zram->table[index].entry = entry;
+			zram_set_flag(zram, index, ZRAM_DEDUP);
+			zram_stat_inc(&zram->stats.pages_stored);
+			zram_stat_inc(&zram->stats.pages_dup);
+			write_unlock(&zram->table_lock);
+
+			return 0;
 		}
+	}
 
-		flush_dcache_page(page);
-		index++;
+	user_mem = kmap_atomic(page, KM_USER0);
+	if (zram_probe_incompressible(zram, zstrm, user_mem)) {
+		zram_stat64_inc(zram, &zram->stats.raw_probe_hits);
+		clen = PAGE_SIZE;
+		ret = 0;
+	} else {
+		ret = zram->backend->compress(user_mem, PAGE_SIZE,
+				src, &clen, zstrm->workmem);
 	}
+	kunmap_atomic(user_mem, KM_USER0);
 
-	set_bit(BIO_UPTODATE, &bio->bi_flags);
-	bio_endio(bio, 0);
-	return;
+	if (unlikely(ret)) {
+		zram_stream_put(zram, zstrm);
+		pr_err("Compression failed! err=%d\n", ret);
+		return -EIO;
+	}
 
-out:
-	bio_io_error(bio);
+	/*
+	 * Page is incompressible. Store it as-is (uncompressed)
+	 * since we do not want to return too many disk write
+	 * errors which has side effect of hanging the system.
+	 */
+	if (unlikely(clen > max_zpage_size)) {
+		zram_stream_put(zram, zstrm);
+		zstrm = NULL;
+
+		clen = PAGE_SIZE;
+		page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
+		if (unlikely(!page_store)) {
+			pr_info("Error allocating memory for "
+				"incompressible page: %u\n", index);
+			return -ENOMEM;
+		}
+
+		offset = 0;
+		src = kmap_atomic(page, KM_USER0);
+		goto memstore;
+	}
+
+	if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
+			&page_store, &offset,
+			GFP_NOIO | __GFP_HIGHMEM)) {
+		zram_stream_put(zram, zstrm);
+		pr_info("Error allocating memory for compressed "
+			"page: %u, size=%zu\n", index, clen);
+		return -ENOMEM;
+	}
+
+memstore:
+	cmem = kmap_atomic(page_store, KM_USER1) + offset;
+
+#if 0
+	/* Back-reference needed for memory defragmentation */
+	if (zstrm) {
+		zheader = (struct zobj_header *)cmem;
+		zheader->table_idx = index;
+		cmem += sizeof(*zheader);
+	}
+#endif
+
+	memcpy(cmem, src, clen);
+
+	kunmap_atomic(cmem, KM_USER1);
+	if (zstrm)
+		zram_stream_put(zram, zstrm);
+	else
+		kunmap_atomic(src, KM_USER0);
+
+	/* Only compressed objects are shared */
+	if (dedup && zstrm)
+		entry = zram_dedup_insert(zram, checksum, page_store, offset);
+
+	write_lock(&zram->table_lock);
+
+	/*
+	 * System overwrites unused sectors. Free memory associated
+	 * with this sector now.
+	 */
+	zram_free_page(zram, index);
+
+	if (entry) {
+		zram->table[index].entry = entry;
+		zram_set_flag(zram, index, ZRAM_DEDUP);
+	} else {
+		zram->table[index].page = page_store;
+		zram->table[index].offset = offset;
+	}
+	if (unlikely(!zstrm)) {
+		zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+		zram_stat_inc(&zram->stats.pages_expand);
+	}
+
+	/* Update stats */
+	zram_stat64_add(zram, &zram->stats.compr_size, clen);
+	zram_stat_inc(&zram->stats.pages_stored);
+	if (clen <= PAGE_SIZE / 2)
+		zram_stat_inc(&zram->stats.good_compress);
+
+	write_unlock(&zram->table_lock);
+
+	return 0;
 }
 
 static void zram_write(struct zram *zram, struct bio *bio)
@@ -289,122 +878,230 @@ static void zram_write(struct zram *zram, struct bio *bio)
 	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
 
 	bio_for_each_segment(bvec, bio, i) {
-		int ret;
-		u32 offset;
-		size_t clen;
-		struct zobj_header *zheader;
-		struct page *page, *page_store;
-		unsigned char *user_mem, *cmem, *src;
+		if (zram_write_page(zram, bvec->bv_page, index)) {
+			zram_stat64_inc(zram, &zram->stats.failed_writes);
+			goto out;
+		}
+		index++;
+	}
+
+	set_bit(BIO_UPTODATE, &bio->bi_flags);
+	bio_endio(bio, 0);
+	return;
 
-		page = bvec->bv_page;
-		src = zram->compress_buffer;
+out:
+	bio_io_error(bio);
+}
 
-		/*
-		 * System overwrites unused sectors. Free memory associated
-		 * with this sector now.
-		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
+#ifdef CONFIG_ZRAM_WRITEBACK
+/*
+ * Mark every page that holds memory in the pool as idle. Pages still
+ * idle at the next writeback pass have not been accessed since.
+ */
+void zram_mark_idle(struct zram *zram)
+{
+	size_t index, num_pages;
 
-		mutex_lock(&zram->lock);
+	num_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < num_pages; index++) {
+		write_lock(&zram->table_lock);
+		if (zram->table[index].page &&
+				!zram_test_flag(zram, index, ZRAM_SAME) &&
+				!zram_test_flag(zram, index, ZRAM_WB))
+			zram_set_flag(zram, index, ZRAM_IDLE);
+		write_unlock(&zram->table_lock);
+	}
+}
 
-		user_mem = kmap_atomic(page, KM_USER0);
-		if (page_zero_filled(user_mem)) {
-			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
-			zram_stat_inc(&zram->stats.pages_zero);
-			zram_set_flag(zram, index, ZRAM_ZERO);
-			index++;
+struct zram_wb_batch {
+	int nr;
+	u32 index[ZRAM_WB_BATCH];
+	struct page *pages[ZRAM_WB_BATCH];
+	unsigned long blk;	/* first block; the batch is contiguous */
+};
+
+/*
+ * Write the batched pages out in a single bio and, for every page that
+ * was not changed in the meantime, release its pool memory and point the
+ * table entry at the backing block instead.
+ */
+static void zram_wb_flush(struct zram *zram, struct zram_wb_batch *wb)
+{
+	int i, done;
+	u32 index;
+
+	if (!wb->nr)
+		return;
+
+	done = zram_bd_rw(zram, WRITE, wb->pages, wb->nr, wb->blk);
+
+	for (i = 0; i < wb->nr; i++) {
+		index = wb->index[i];
+
+		write_lock(&zram->table_lock);
+		if (i < done && zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+			zram_free_page(zram, index);
+			zram->table[index].element = wb->blk + i;
+			zram_set_flag(zram, index, ZRAM_WB);
+			zram_stat_inc(&zram->stats.pages_stored);
+			zram_stat_inc(&zram->stats.bd_count);
+			write_unlock(&zram->table_lock);
 			continue;
 		}
 
-		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+		/* Write failed or the page was rewritten or freed */
+		zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+		write_unlock(&zram->table_lock);
+		zram_bd_free(zram, wb->blk + i);
+	}
 
-		kunmap_atomic(user_mem, KM_USER0);
+	zram_stat64_add(zram, &zram->stats.bd_writes, done);
+	wb->nr = 0;
+}
 
-		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
-			pr_err("Compression failed! err=%d\n", ret);
-			zram_stat64_inc(zram, &zram->stats.failed_writes);
+static int zram_wb_eligible(struct zram *zram, u32 index, int mode)
+{
+	if (!zram->table[index].page ||
+			zram_test_flag(zram, index, ZRAM_SAME) ||
+			zram_test_flag(zram, index, ZRAM_WB) ||
+			zram_test_flag(zram, index, ZRAM_UNDER_WB))
+		return 0;
+
+	if ((mode & ZRAM_WB_IDLE) && zram_test_flag(zram, index, ZRAM_IDLE))
+		return 1;
+
+	if ((mode & ZRAM_WB_HUGE) &&
+			zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))
+		return 1;
+
+	return 0;
+}
+
+/*
+ * Write idle and/or incompressible pages to the backing device in
+ * batches of up to ZRAM_WB_BATCH contiguous blocks.
+ */
+int zram_writeback(struct zram *zram, int mode)
+{
+	int i, ret = 0;
+	unsigned long blk;
+	size_t index, num_pages;
+	struct zram_wb_batch *wb;
+
+	if (!zram->bdev)
+		return -ENODEV;
+
+	wb = kzalloc(sizeof(*wb), GFP_KERNEL);
+	if (!wb)
+		return -ENOMEM;
+
+	for (i = 0; i < ZRAM_WB_BATCH; i++) {
+		wb->pages[i] = alloc_page(GFP_KERNEL);
+		if (!wb->pages[i]) {
+			ret = -ENOMEM;
 			goto out;
 		}
+	}
 
-		/*
-		 * Page is incompressible. Store it as-is (uncompressed)
-		 * since we do not want to return too many disk write
-		 * errors which has side effect of hanging the system.
-		 */
-		if (unlikely(clen > max_zpage_size)) {
-			clen = PAGE_SIZE;
-			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
-			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
-				pr_info("Error allocating memory for "
-					"incompressible page: %u\n", index);
-				zram_stat64_inc(zram,
-					&zram->stats.failed_writes);
-				goto out;
-			}
-
-			offset = 0;
-			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
-			src = kmap_atomic(page, KM_USER0);
-			goto memstore;
+	num_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < num_pages; index++) {
+		write_lock(&zram->table_lock);
+		if (!zram_wb_eligible(zram, index, mode)) {
+			write_unlock(&zram->table_lock);
+			continue;
+		}
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		write_unlock(&zram->table_lock);
+
+		blk = zram_bd_alloc(zram);
+		if (!blk) {
+			ret = -ENOSPC;
+			write_lock(&zram->table_lock);
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			write_unlock(&zram->table_lock);
+			break;
 		}
 
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
-			pr_info("Error allocating memory for compressed "
-				"page: %u, size=%zu\n", index, clen);
-			zram_stat64_inc(zram, &zram->stats.failed_writes);
-			goto out;
+		if (wb->nr && blk != wb->blk + wb->nr)
+			zram_wb_flush(zram, wb);
+		if (!wb->nr)
+			wb->blk = blk;
+
+		if (zram_read_page(zram, wb->pages[wb->nr], index)) {
+			write_lock(&zram->table_lock);
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			write_unlock(&zram->table_lock);
+			zram_bd_free(zram, blk);
+			continue;
 		}
 
-memstore:
-		zram->table[index].offset = offset;
+		wb->index[wb->nr++] = index;
+		if (wb->nr == ZRAM_WB_BATCH)
+			zram_wb_flush(zram, wb);
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+		cond_resched();
+	}
 
-#if 0
-		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-			zheader = (struct zobj_header *)cmem;
-			zheader->table_idx = index;
-			cmem += sizeof(*zheader);
-		}
-#endif
+	zram_wb_flush(zram, wb);
 
-		memcpy(cmem, src, clen);
+out:
+	for (i = 0; i < ZRAM_WB_BATCH; i++) {
+		if (wb->pages[i])
+			__free_page(wb->pages[i]);
+	}
+	kfree(wb);
 
-		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			kunmap_atomic(src, KM_USER0);
+	return ret;
+}
 
-		/* Update stats */
-		zram_stat64_add(zram, &zram->stats.compr_size, clen);
-		zram_stat_inc(&zram->stats.pages_stored);
-		if (clen <= PAGE_SIZE / 2)
-			zram_stat_inc(&zram->stats.good_compress);
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	unsigned long nr_pages, *bitmap;
+	struct block_device *bdev;
+
+	bdev = blkdev_get_by_path(path, FMODE_READ | FMODE_WRITE | FMODE_EXCL,
+				zram);
+	if (IS_ERR(bdev))
+		return PTR_ERR(bdev);
+
+	nr_pages = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	if (nr_pages < 2) {
+		blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+		return -EINVAL;
+	}
 
-		mutex_unlock(&zram->lock);
-		index++;
+	bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!bitmap) {
+		blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+		return -ENOMEM;
 	}
 
-	set_bit(BIO_UPTODATE, &bio->bi_flags);
-	bio_endio(bio, 0);
-	return;
+	/* Block 0 is never used: zram_bd_alloc() returns 0 on failure */
+	__set_bit(0, bitmap);
 
-out:
-	bio_io_error(bio);
+	zram_reset_backing_dev(zram);
+	zram->bdev = bdev;
+	zram->bd_bitmap = bitmap;
+	zram->bd_nr_pages = nr_pages;
+	zram->bd_next = 1;
+
+	return 0;
 }
 
+void zram_reset_backing_dev(struct zram *zram)
+{
+	if (!zram->bdev)
+		return;
+
+	blkdev_put(zram->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	vfree(zram->bd_bitmap);
+
+	zram->bdev = NULL;
+	zram->bd_bitmap = NULL;
+	zram->bd_nr_pages = 0;
+}
+#endif
+
 /*
  * Check if request is within bounds and page aligned.
  */
@@ -460,12 +1157,8 @@ void zram_reset_device(struct zram *zram)
 	mutex_lock(&zram->init_lock);
 	zram->init_done = 0;
 
-	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
-
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	/* Free all idle compression streams */
+	zram_stream_destroy_all(zram);
 
 	/* Free all pages that are still in this zram device */
 	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
@@ -475,14 +1168,32 @@ void zram_reset_device(struct zram *zram)
 		page = zram->table[index].page;
 		offset = zram->table[index].offset;
 
-		if (!page)
+		if (!page || zram_test_flag(zram, index, ZRAM_SAME) ||
+				zram_test_flag(zram, index, ZRAM_WB))
 			continue;
 
+		if (zram_test_flag(zram, index, ZRAM_DEDUP)) {
+			struct zram_dedup_entry *entry;
+
+			entry = zram->table[index].entry;
+			if (!zram_dedup_put(zram, entry))
+				continue;
+
+			page = entry->page;
+			offset = entry->offset;
+			kfree(entry);
+		}
+
 		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
 			__free_page(page);
 		else
 			xv_free(zram->mem_pool, page, offset);
 	}
+	zram->dedup_root = RB_ROOT;
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram_reset_backing_dev(zram);
+#endif
 
 	vfree(zram->table);
 	zram->table = NULL;
@@ -501,6 +1212,7 @@ int zram_init_device(struct zram *zram)
 {
 	int ret;
 	size_t num_pages;
+	struct zram_stream *zstrm;
 
 	mutex_lock(&zram->init_lock);
 
@@ -511,19 +1223,18 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
+	/*
+	 * Always keep one stream around so that writers can make
+	 * progress even if further streams cannot be allocated.
+	 */
+	zstrm = zram_stream_alloc(zram, GFP_KERNEL);
+	if (!zstrm) {
+		pr_err("Error allocating compression stream!\n");
 		ret = -ENOMEM;
 		goto fail;
 	}
+	zram->avail_strm = 1;
+	list_add(&zstrm->list, &zram->idle_strm);
 
 	num_pages = zram->disksize >> PAGE_SHIFT;
 	zram->table = vzalloc(num_pages * sizeof(*zram->table));
@@ -566,7 +1277,9 @@ void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	write_lock(&zram->table_lock);
 	zram_free_page(zram, index);
+	write_unlock(&zram->table_lock);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -579,9 +1292,22 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
 	mutex_init(&zram->init_lock);
 	spin_lock_init(&zram->stat64_lock);
+	rwlock_init(&zram->table_lock);
+
+	spin_lock_init(&zram->strm_lock);
+	INIT_LIST_HEAD(&zram->idle_strm);
+	init_waitqueue_head(&zram->strm_wait);
+	zram->max_strm = num_online_cpus();
+	zram->backend = zram_default_backend();
+
+	spin_lock_init(&zram->dedup_lock);
+	zram->dedup_root = RB_ROOT;
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	spin_lock_init(&zram->bd_lock);
+#endif
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
 	if (!zram->queue) {
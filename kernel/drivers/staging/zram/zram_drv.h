@@ -17,6 +17,9 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/list.h>
+#include <linux/wait.h>
+#include <linux/rbtree.h>
 
 #include "xvmalloc.h"
 
@@ -63,22 +66,65 @@ static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 #define SECTORS_PER_PAGE	(1 << SECTORS_PER_PAGE_SHIFT)
 #define ZRAM_LOGICAL_BLOCK_SIZE	4096
 
+/* Max no. of pages written to the backing device with a single bio */
+#define ZRAM_WB_BATCH		32
+
+/* zram_writeback() modes */
+#define ZRAM_WB_IDLE		(1 << 0)	/* pages marked idle */
+#define ZRAM_WB_HUGE		(1 << 1)	/* incompressible pages */
+
 /* Flags for zram pages (table[page_no].flags) */
 enum zram_pageflags {
 	/* Page is stored uncompressed */
 	ZRAM_UNCOMPRESSED,
 
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO,
+	/* Page is filled with one repeated word (table[].element) */
+	ZRAM_SAME,
+
+	/* Page shares a deduplicated object (table[].entry) */
+	ZRAM_DEDUP,
+
+	/* Page is on the backing device at block table[].element */
+	ZRAM_WB,
+
+	/* Page has not been accessed since the last idle marking pass */
+	ZRAM_IDLE,
+
+	/* Page is being written to the backing device */
+	ZRAM_UNDER_WB,
 
 	__NR_ZRAM_PAGEFLAGS,
 };
 
 /*-- Data structures */
 
+/* Compression algorithm used by a device */
+struct zram_backend {
+	const char *name;
+	size_t workmem_size;
+	int (*compress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len, void *workmem);
+	/* On entry *dst_len holds the size of dst */
+	int (*decompress)(const unsigned char *src, size_t src_len,
+			unsigned char *dst, size_t *dst_len);
+};
+
+/* Compressed object shared by all pages with identical content */
+struct zram_dedup_entry {
+	struct rb_node rb_node;
+	u32 checksum;		/* of the uncompressed page */
+	struct page *page;
+	u16 offset;
+	unsigned long refcount;
+};
+
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
+	union {
+		struct page *page;
+		struct zram_dedup_entry *entry;	/* ZRAM_DEDUP */
+		unsigned long element;		/* ZRAM_SAME, ZRAM_WB */
+	};
 	u16 offset;
 	u8 count;	/* object ref count (not yet used) */
 	u8 flags;
@@ -92,20 +138,44 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
+	u64 raw_probe_hits;	/* pages stored as-is after probe */
+	u64 dup_hits;		/* no. of writes that found a duplicate */
+	u64 bd_reads;		/* no. of pages read from backing device */
+	u64 bd_writes;		/* no. of pages written to backing device */
 	u32 pages_zero;		/* no. of zero filled pages */
+	u32 pages_same;		/* no. of same element filled pages */
+	u32 pages_dup;		/* no. of pages sharing another's object */
+	u32 bd_count;		/* no. of pages on the backing device */
 	u32 pages_stored;	/* no. of pages currently stored */
 	u32 good_compress;	/* % of pages with compression ratio<=50% */
 	u32 pages_expand;	/* % of incompressible pages */
 };
 
+/*
+ * Private working memory for one in-flight compression. Writers borrow
+ * a stream from the per-device pool so that compression of different
+ * pages can proceed in parallel.
+ */
+struct zram_stream {
+	void *workmem;
+	void *buffer;
+	struct list_head list;
+};
+
 struct zram {
 	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zram_backend *backend;	/* can change only before init */
 	struct table *table;
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
+	rwlock_t table_lock;	/* protect table entries and 32-bit stats */
+
+	/* Pool of compression streams */
+	spinlock_t strm_lock;	/* protect idle_strm and avail_strm */
+	struct list_head idle_strm;
+	wait_queue_head_t strm_wait;
+	int avail_strm;		/* no. of streams currently allocated */
+	int max_strm;		/* upper limit on avail_strm */
+
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
@@ -117,6 +187,27 @@ struct zram {
 	 */
 	u64 disksize;	/* bytes */
 
+	/*
+	 * If non-zero, the first raw_probe_size bytes of each page are
+	 * trial-compressed first; pages whose prefix does not compress
+	 * are stored as-is without compressing the whole page.
+	 */
+	unsigned int raw_probe_size;
+
+	/* Content index of compressed objects, used if dedup_enable */
+	int dedup_enable;
+	spinlock_t dedup_lock;
+	struct rb_root dedup_root;
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	/* Optional backing device for idle and incompressible pages */
+	struct block_device *bdev;
+	spinlock_t bd_lock;		/* protect bd_bitmap and bd_next */
+	unsigned long *bd_bitmap;	/* blocks in use */
+	unsigned long bd_nr_pages;
+	unsigned long bd_next;		/* where to start the next search */
+#endif
+
 	struct zram_stats stats;
 };
 
@@ -128,5 +219,24 @@ extern struct attribute_group zram_disk_attr_group;
 
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
+extern void zram_set_max_streams(struct zram *zram, int num_strm);
+
+extern struct zram_backend *zram_default_backend(void);
+extern struct zram_backend *zram_find_backend(const char *name);
+extern ssize_t zram_show_backends(struct zram_backend *cur, char *buf);
+
+extern u32 zram_dedup_checksum(void *mem);
+extern struct zram_dedup_entry *zram_dedup_get(struct zram *zram,
+		u32 checksum);
+extern struct zram_dedup_entry *zram_dedup_insert(struct zram *zram,
+		u32 checksum, struct page *page, u32 offset);
+extern int zram_dedup_put(struct zram *zram, struct zram_dedup_entry *entry);
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_reset_backing_dev(struct zram *zram);
+extern void zram_mark_idle(struct zram *zram);
+extern int zram_writeback(struct zram *zram, int mode);
+#endif
 
 #endif
@@ -1093,6 +1093,12 @@ int flush_old_exec(struct linux_binprm * bprm)
 
 	bprm->mm = NULL;		/* We're using it now */
 
+	/*
+	 * Whether it was forked without an mm or has just changed leader,
+	 * current now leads a process with an mm of its own.
+	 */
+	oom_adj_notify(current);
+
 	set_fs(USER_DS);
 	current->flags &= ~(PF_RANDOMIZE | PF_KTHREAD);
 	flush_thread();
@@ -1074,7 +1074,7 @@ static ssize_t oom_adjust_read(struct file *file, char __user *buf,
 static ssize_t oom_adjust_write(struct file *file, const char __user *buf,
 				size_t count, loff_t *ppos)
 {
-	struct task_struct *task;
+	struct task_struct *task, *leader = NULL;
 	char buffer[PROC_NUMBUF];
 	int oom_adjust;
 	unsigned long flags;
@@ -1144,10 +1144,17 @@ static ssize_t oom_adjust_write(struct file *file, const char __user *buf,
 	else
 		task->signal->oom_score_adj = (oom_adjust * OOM_SCORE_ADJ_MAX) /
 								-OOM_DISABLE;
+	/* The leader can be reaped as soon as the siglock is dropped */
+	leader = task->group_leader;
+	get_task_struct(leader);
 err_sighand:
 	unlock_task_sighand(task, &flags);
 err_task_lock:
 	task_unlock(task);
+	if (leader) {
+		oom_adj_notify(leader);
+		put_task_struct(leader);
+	}
 	put_task_struct(task);
 out:
 	return err < 0 ? err : count;
@@ -1215,7 +1222,7 @@ static ssize_t oom_score_adj_read(struct file *file, char __user *buf,
 static ssize_t oom_score_adj_write(struct file *file, const char __user *buf,
 					size_t count, loff_t *ppos)
 {
-	struct task_struct *task;
+	struct task_struct *task, *leader = NULL;
 	char buffer[PROC_NUMBUF];
 	unsigned long flags;
 	int oom_score_adj;
@@ -1279,10 +1286,17 @@ static ssize_t oom_score_adj_write(struct file *file, const char __user *buf,
 	else
 		task->signal->oom_adj = (oom_score_adj * OOM_ADJUST_MAX) /
 							OOM_SCORE_ADJ_MAX;
+	/* The leader can be reaped as soon as the siglock is dropped */
+	leader = task->group_leader;
+	get_task_struct(leader);
 err_sighand:
 	unlock_task_sighand(task, &flags);
 err_task_lock:
 	task_unlock(task);
+	if (leader) {
+		oom_adj_notify(leader);
+		put_task_struct(leader);
+	}
 	put_task_struct(task);
 out:
 	return err < 0 ? err : count;
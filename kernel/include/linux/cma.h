@@ -203,6 +203,14 @@ cma_info_about(struct cma_info *info, const const char *regions)
 
 struct cma_allocator;
 
+struct cma_region_stats {
+	unsigned long allocs;		/* successful allocations */
+	unsigned long fails;		/* failed allocations */
+	unsigned long migrated;		/* pages migrated out of the region */
+	unsigned long total_us;		/* time spent in successful allocs */
+	unsigned long max_us;		/* slowest successful alloc */
+};
+
 /**
  * struct cma_region - a region reserved for CMA allocations.
  * @name:	Unique name of the region.  Read only.
@@ -220,6 +228,11 @@ struct cma_allocator;
  * @private_data:	Allocator's private data.
  * @users:	Number of chunks allocated in this region.
  * @list:	Entry in list of regions.  Private.
+ * @movable_start_pfn:	First page frame of the part of the region given to
+ *		the page allocator (CONFIG_CMA_MIGRATE).  Private.
+ * @movable_end_pfn:	One past the last such page frame.  Private.
+ * @stats:	Allocation statistics, see struct cma_region_stats.
+ *		Read only.
  * @used:	Whether region was already used, ie. there was at least
  *		one allocation request for.  Private.
  * @registered:	Whether this region has been registered.  Read only.
@@ -259,6 +272,11 @@ struct cma_region {
 	unsigned users;
 	struct list_head list;
 
+#if defined CONFIG_CMA_MIGRATE
+	unsigned long movable_start_pfn, movable_end_pfn;
+#endif
+	struct cma_region_stats stats;
+
 #if defined CONFIG_CMA_SYSFS
 	struct kobject kobj;
 #endif
@@ -104,6 +104,8 @@ struct cpufreq_policy {
 
 	struct cpufreq_real_policy	user_policy;
 
+	unsigned int		boost_count; /* governor boosts, for stats */
+
 	struct kobject		kobj;
 	struct completion	kobj_unregister;
 };
@@ -372,4 +372,12 @@ extern gfp_t gfp_allowed_mask;
 extern void pm_restrict_gfp_mask(void);
 extern void pm_restore_gfp_mask(void);
 
+#ifdef CONFIG_CMA_MIGRATE
+/* The range passed to these must lie within a single zone. */
+extern int alloc_contig_range(unsigned long start, unsigned long end,
+			      int migratetype, unsigned long *migrated);
+extern void free_contig_range(unsigned long pfn, unsigned long nr_pages);
+extern void init_cma_reserved_pageblock(struct page *page);
+#endif
+
 #endif /* __LINUX_GFP_H */
@@ -141,6 +141,7 @@ extern unsigned long nr_uninterruptible(void);
 extern unsigned long nr_iowait(void);
 extern unsigned long nr_iowait_cpu(int cpu);
 extern unsigned long this_cpu_load(void);
+extern unsigned long sched_cpu_util(int cpu);
 
 
 extern void calc_global_load(unsigned long ticks);
@@ -1166,6 +1167,18 @@ struct sched_statistics {
 };
 #endif
 
+/*
+ * Geometrically decayed runnable time of a task, in periods of 1024us
+ * whose weight halves every 32 periods.
+ */
+struct sched_avg {
+	u32			runnable_avg_sum;
+	u32			runnable_avg_period;
+	u64			last_runnable_update;
+	/* runnable_avg_sum / runnable_avg_period, SCHED_POWER_SCALE based */
+	unsigned long		util_contrib;
+};
+
 struct sched_entity {
 	struct load_weight	load;		/* for load-balancing */
 	struct rb_node		run_node;
@@ -1179,6 +1192,9 @@ struct sched_entity {
 
 	u64			nr_migrations;
 
+	/* Only maintained for tasks */
+	struct sched_avg	avg;
+
 #ifdef CONFIG_SCHEDSTATS
 	struct sched_statistics statistics;
 #endif
@@ -1338,6 +1354,9 @@ struct task_struct {
 	/* PID/PID hash table linkage. */
 	struct pid_link pids[PIDTYPE_MAX];
 	struct list_head thread_group;
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+	struct list_head lowmem_node;	/* lowmemorykiller candidate index */
+#endif
 
 	struct completion *vfork_done;		/* for vfork() */
 	int __user *set_child_tid;		/* CLONE_CHILD_SETTID */
@@ -1756,6 +1775,9 @@ extern void thread_group_times(struct task_struct *p, cputime_t *ut, cputime_t *
 
 extern int task_free_register(struct notifier_block *n);
 extern int task_free_unregister(struct notifier_block *n);
+extern int oom_adj_register(struct notifier_block *n);
+extern int oom_adj_unregister(struct notifier_block *n);
+extern void oom_adj_notify(struct task_struct *leader);
 
 /*
  * Per process flags
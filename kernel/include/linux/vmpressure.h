@@ -0,0 +1,20 @@
+#ifndef __LINUX_VMPRESSURE_H
+#define __LINUX_VMPRESSURE_H
+
+#include <linux/types.h>
+#include <linux/gfp.h>
+#include <linux/notifier.h>
+
+/*
+ * Global reclaim pressure. Reclaim reports how many pages it scanned and
+ * how many of those it reclaimed; once a window's worth of pages has been
+ * scanned, the registered notifiers are called with the pressure of that
+ * window as 'val', from 0 (everything scanned was reclaimed) to 100
+ * (nothing was). Notifiers run in reclaim context and must not sleep.
+ */
+extern void vmpressure(gfp_t gfp, unsigned long scanned,
+		       unsigned long reclaimed);
+extern int vmpressure_register(struct notifier_block *nb);
+extern int vmpressure_unregister(struct notifier_block *nb);
+
+#endif /* __LINUX_VMPRESSURE_H */
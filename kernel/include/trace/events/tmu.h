@@ -0,0 +1,53 @@
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM tmu
+
+#if !defined(_TRACE_TMU_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_TMU_H
+
+#include <linux/types.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(tmu_pid_decision,
+
+	TP_PROTO(int temp, int setpoint, int integral, int deriv,
+		unsigned int throttle, unsigned int cpu_level,
+		unsigned int bus_steps),
+
+	TP_ARGS(temp, setpoint, integral, deriv, throttle, cpu_level,
+		bus_steps),
+
+	TP_STRUCT__entry(
+		__field(int, temp)
+		__field(int, setpoint)
+		__field(int, integral)
+		__field(int, deriv)
+		__field(unsigned int, throttle)
+		__field(unsigned int, cpu_level)
+		__field(unsigned int, bus_steps)
+	),
+
+	TP_fast_assign(
+		__entry->temp = temp;
+		__entry->setpoint = setpoint;
+		__entry->integral = integral;
+		__entry->deriv = deriv;
+		__entry->throttle = throttle;
+		__entry->cpu_level = cpu_level;
+		__entry->bus_steps = bus_steps;
+	),
+
+	TP_printk("temp=%d setpoint=%d integral=%d deriv=%d throttle=%u "
+		"cpu_level=%u bus_steps=%u",
+		__entry->temp,
+		__entry->setpoint,
+		__entry->integral,
+		__entry->deriv,
+		__entry->throttle,
+		__entry->cpu_level,
+		__entry->bus_steps)
+);
+
+#endif /* _TRACE_TMU_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
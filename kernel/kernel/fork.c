@@ -157,6 +157,9 @@ static struct kmem_cache *mm_cachep;
 /* Notifier list called when a task struct is freed */
 static ATOMIC_NOTIFIER_HEAD(task_free_notifier);
 
+/* Notifier list called when a process is created or its oom_adj changes */
+static ATOMIC_NOTIFIER_HEAD(oom_adj_notifier);
+
 static void account_kernel_stack(struct thread_info *ti, int account)
 {
 	struct zone *zone = page_zone(virt_to_page(ti));
@@ -200,6 +203,29 @@ int task_free_unregister(struct notifier_block *n)
 }
 EXPORT_SYMBOL(task_free_unregister);
 
+int oom_adj_register(struct notifier_block *n)
+{
+	return atomic_notifier_chain_register(&oom_adj_notifier, n);
+}
+EXPORT_SYMBOL(oom_adj_register);
+
+int oom_adj_unregister(struct notifier_block *n)
+{
+	return atomic_notifier_chain_unregister(&oom_adj_notifier, n);
+}
+EXPORT_SYMBOL(oom_adj_unregister);
+
+/*
+ * oom_adj_notify - tell listeners that the oom_adj of the process led by
+ * 'leader' may have changed, or that it has a new mm. The caller must hold
+ * a reference to 'leader', which nothing else pins once the siglock is
+ * dropped, and must not hold task_lock() or the siglock.
+ */
+void oom_adj_notify(struct task_struct *leader)
+{
+	atomic_notifier_call_chain(&oom_adj_notifier, 0, leader);
+}
+
 void __put_task_struct(struct task_struct *tsk)
 {
 	WARN_ON(!tsk->exit_state);
@@ -1310,6 +1336,9 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 	 */
 	p->group_leader = p;
 	INIT_LIST_HEAD(&p->thread_group);
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+	INIT_LIST_HEAD(&p->lowmem_node);
+#endif
 
 	/* Now that the task is set up, run cgroup callbacks if
 	 * necessary. We need to run them before the task is visible
@@ -1382,6 +1411,8 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 	if (clone_flags & CLONE_THREAD)
 		threadgroup_fork_read_unlock(current);
 	perf_event_fork(p);
+	if (!(clone_flags & CLONE_THREAD) && p->mm)
+		oom_adj_notify(p);
 	return p;
 
 bad_fork_free_pid:
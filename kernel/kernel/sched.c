@@ -78,6 +78,7 @@
 #include <asm/mutex.h>
 
 #include "sched_cpupri.h"
+#include "sched_wake.h"
 #include "workqueue_sched.h"
 #include "sched_autogroup.h"
 
@@ -477,6 +478,9 @@ struct rq {
 	struct cfs_rq cfs;
 	struct rt_rq rt;
 
+	/* Sum of the util_contrib of the CFS tasks queued here */
+	unsigned long cfs_util_avg;
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* list of leaf cfs_rq on this cpu: */
 	struct list_head leaf_cfs_rq_list;
@@ -559,6 +563,9 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+
+	/* select_idle_sibling() stats, with ENERGY_AWARE_WAKE */
+	unsigned int wake_place[NR_WAKE_PLACE];
 #endif
 
 #ifdef CONFIG_SMP
@@ -2807,6 +2814,7 @@ static void __sched_fork(struct task_struct *p)
 	p->se.prev_sum_exec_runtime	= 0;
 	p->se.nr_migrations		= 0;
 	p->se.vruntime			= 0;
+	memset(&p->se.avg, 0, sizeof(p->se.avg));
 	INIT_LIST_HEAD(&p->se.group_node);
 
 #ifdef CONFIG_SCHEDSTATS
@@ -3255,6 +3263,21 @@ unsigned long this_cpu_load(void)
 	return this->cpu_load[0];
 }
 
+/**
+ * sched_cpu_util - decayed utilization of a cpu by its CFS tasks
+ * @cpu: the cpu in question
+ *
+ * Sum of the recent runnable fraction of the tasks queued on @cpu,
+ * SCHED_POWER_SCALE for each one that was always runnable; it is not
+ * capped, so values above SCHED_POWER_SCALE mean more demand than one
+ * cpu can serve.  Since the history travels with the tasks, this
+ * changes as soon as tasks migrate, unlike idle-time based estimates.
+ */
+unsigned long sched_cpu_util(int cpu)
+{
+	return ACCESS_ONCE(cpu_rq(cpu)->cfs_util_avg);
+}
+EXPORT_SYMBOL_GPL(sched_cpu_util);
 
 /* Variables and functions for calc_load */
 static atomic_long_t calc_load_tasks;
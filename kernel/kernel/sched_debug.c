@@ -277,6 +277,7 @@ static void print_cpu(struct seq_file *m, int cpu)
 	P(cpu_load[2]);
 	P(cpu_load[3]);
 	P(cpu_load[4]);
+	P(cfs_util_avg);
 #undef P
 #undef PN
 
@@ -422,6 +423,9 @@ void proc_sched_show_task(struct task_struct *p, struct seq_file *m)
 	PN(se.exec_start);
 	PN(se.vruntime);
 	PN(se.sum_exec_runtime);
+	P(se.avg.runnable_avg_sum);
+	P(se.avg.runnable_avg_period);
+	P(se.avg.util_contrib);
 
 	nr_switches = p->nvcsw + p->nivcsw;
 
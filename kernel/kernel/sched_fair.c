@@ -23,6 +23,9 @@
 #include <linux/latencytop.h>
 #include <linux/sched.h>
 #include <linux/cpumask.h>
+#include <linux/cpufreq.h>
+#include <linux/cpuidle.h>
+#include <linux/math64.h>
 
 /*
  * Targeted preemption latency for CPU-bound tasks:
@@ -935,6 +938,206 @@ static void check_spread(struct cfs_rq *cfs_rq, struct sched_entity *se)
 #endif
 }
 
+/*
+ * Per-task runnable averages, after the per-entity load tracking of
+ * Paul Turner: time is cut in periods of 1024us and the runnable time of
+ * period i in the past is weighted by y^i, with y^32 = 1/2.  Comparing
+ * the decayed runnable time with the decayed elapsed time gives how busy
+ * a task has been lately, whatever cpu it ran on, so the sum over the
+ * tasks queued on a cpu moves with them when they migrate instead of
+ * having to build up again from the cpu's own history.
+ */
+#define LOAD_AVG_PERIOD	32
+#define LOAD_AVG_MAX	47742	/* maximum possible runnable_avg_sum */
+#define LOAD_AVG_MAX_N	348	/* number of full periods to reach it */
+
+/* 2^32 * y^n, for n in [0, LOAD_AVG_PERIOD) */
+static const u32 runnable_avg_yN_inv[] = {
+	0xffffffff, 0xfa83b2db, 0xf5257d15, 0xefe4b99b, 0xeac0c6e7, 0xe5b906e7,
+	0xe0ccdeec, 0xdbfbb797, 0xd744fcca, 0xd2a81d91, 0xce248c15, 0xc9b9bd86,
+	0xc5672a11, 0xc12c4cca, 0xbd08a39f, 0xb8fbaf47, 0xb504f333, 0xb123f581,
+	0xad583eea, 0xa9a15ab4, 0xa5fed6a9, 0xa2704303, 0x9ef53260, 0x9b8d39b9,
+	0x9837f051, 0x94f4efa8, 0x91c3d373, 0x8ea4398b, 0x8b95c1e3, 0x88980e80,
+	0x85aac367, 0x82cd8698,
+};
+
+/* 1024 * (y + y^2 + ... + y^n), for n in [0, LOAD_AVG_PERIOD] */
+static const u32 runnable_avg_yN_sum[] = {
+	    0,  1002,  1982,  2942,  3881,  4800,  5699,  6579,  7440,  8282,
+	 9107,  9914, 10704, 11476, 12232, 12972, 13696, 14405, 15098, 15777,
+	16441, 17091, 17726, 18349, 18957, 19553, 20136, 20707, 21265, 21812,
+	22346, 22870, 23382,
+};
+
+/* val * y^n */
+static __always_inline u64 decay_load(u64 val, u64 n)
+{
+	unsigned int local_n;
+
+	if (!n)
+		return val;
+	else if (unlikely(n > LOAD_AVG_PERIOD * 63))
+		return 0;
+
+	local_n = n;
+	if (unlikely(local_n >= LOAD_AVG_PERIOD)) {
+		val >>= local_n / LOAD_AVG_PERIOD;
+		local_n %= LOAD_AVG_PERIOD;
+	}
+
+	val *= runnable_avg_yN_inv[local_n];
+	return val >> 32;
+}
+
+/* 1024 * (y + y^2 + ... + y^n): what n fully runnable periods add up to */
+static u32 __compute_runnable_contrib(u64 n)
+{
+	u32 contrib = 0;
+
+	if (likely(n <= LOAD_AVG_PERIOD))
+		return runnable_avg_yN_sum[n];
+	else if (unlikely(n >= LOAD_AVG_MAX_N))
+		return LOAD_AVG_MAX;
+
+	do {
+		contrib /= 2;
+		contrib += runnable_avg_yN_sum[LOAD_AVG_PERIOD];
+		n -= LOAD_AVG_PERIOD;
+	} while (n > LOAD_AVG_PERIOD);
+
+	contrib = decay_load(contrib, n);
+	return contrib + runnable_avg_yN_sum[n];
+}
+
+/*
+ * Accounts the time since the last update as runnable or not, decaying
+ * the sums for every period boundary crossed.  Returns whether any was.
+ */
+static __always_inline int
+__update_entity_runnable_avg(u64 now, struct sched_avg *sa, int runnable)
+{
+	u64 delta, periods;
+	u32 runnable_contrib;
+	int delta_w, decayed = 0;
+
+	delta = now - sa->last_runnable_update;
+	/* The clocks of two cpus can be a little apart after a migration */
+	if ((s64)delta < 0) {
+		sa->last_runnable_update = now;
+		return 0;
+	}
+
+	/* Good enough for a microsecond */
+	delta >>= 10;
+	if (!delta)
+		return 0;
+	sa->last_runnable_update = now;
+
+	/* Complete the period that was in progress first */
+	delta_w = sa->runnable_avg_period % 1024;
+	if (delta + delta_w >= 1024) {
+		decayed = 1;
+
+		delta_w = 1024 - delta_w;
+		if (runnable)
+			sa->runnable_avg_sum += delta_w;
+		sa->runnable_avg_period += delta_w;
+		delta -= delta_w;
+
+		periods = delta / 1024;
+		delta %= 1024;
+
+		sa->runnable_avg_sum = decay_load(sa->runnable_avg_sum,
+						  periods + 1);
+		sa->runnable_avg_period = decay_load(sa->runnable_avg_period,
+						     periods + 1);
+
+		runnable_contrib = __compute_runnable_contrib(periods);
+		if (runnable)
+			sa->runnable_avg_sum += runnable_contrib;
+		sa->runnable_avg_period += runnable_contrib;
+	}
+
+	if (runnable)
+		sa->runnable_avg_sum += delta;
+	sa->runnable_avg_period += delta;
+
+	return decayed;
+}
+
+static inline unsigned long task_util_contrib(struct sched_avg *sa)
+{
+	return div_u64((u64)sa->runnable_avg_sum << SCHED_POWER_SHIFT,
+		       sa->runnable_avg_period + 1);
+}
+
+/*
+ * rq->cfs_util_avg is the sum of the util_contrib of the tasks queued on
+ * the cfs_rqs of a cpu.  The running task is brought up to date on every
+ * tick; waiting ones only when they are picked or dequeued.  Waiting
+ * only ever raises a contribution, so the sum lags behind at worst.
+ */
+static void util_enqueue(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	struct sched_avg *sa = &se->avg;
+	struct rq *rq = rq_of(cfs_rq);
+
+	if (!entity_is_task(se))
+		return;
+
+	if (unlikely(!sa->last_runnable_update)) {
+		/*
+		 * A new task starts out as busy for the last LOAD_AVG_PERIOD
+		 * periods: a fork burst shows up right away and an idle
+		 * child decays to nothing within a few tens of ms.
+		 */
+		sa->runnable_avg_sum = runnable_avg_yN_sum[LOAD_AVG_PERIOD];
+		sa->runnable_avg_period = runnable_avg_yN_sum[LOAD_AVG_PERIOD];
+		sa->last_runnable_update = rq->clock;
+	} else {
+		/* It was asleep, or is coming from another cpu */
+		__update_entity_runnable_avg(rq->clock, sa, 0);
+	}
+
+	sa->util_contrib = task_util_contrib(sa);
+	rq->cfs_util_avg += sa->util_contrib;
+}
+
+static void util_dequeue(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	struct sched_avg *sa = &se->avg;
+	struct rq *rq = rq_of(cfs_rq);
+
+	if (!entity_is_task(se))
+		return;
+
+	__update_entity_runnable_avg(rq->clock, sa, 1);
+
+	if (likely(rq->cfs_util_avg > sa->util_contrib))
+		rq->cfs_util_avg -= sa->util_contrib;
+	else
+		rq->cfs_util_avg = 0;
+
+	sa->util_contrib = task_util_contrib(sa);
+}
+
+static void util_update(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	struct sched_avg *sa = &se->avg;
+	struct rq *rq = rq_of(cfs_rq);
+	unsigned long contrib;
+
+	if (!entity_is_task(se) || !se->on_rq)
+		return;
+
+	if (!__update_entity_runnable_avg(rq->clock, sa, 1))
+		return;
+
+	contrib = task_util_contrib(sa);
+	rq->cfs_util_avg += contrib - sa->util_contrib;
+	sa->util_contrib = contrib;
+}
+
 static void
 place_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int initial)
 {
@@ -986,6 +1189,7 @@ enqueue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int flags)
 	update_cfs_load(cfs_rq, 0);
 	account_entity_enqueue(cfs_rq, se);
 	update_cfs_shares(cfs_rq);
+	util_enqueue(cfs_rq, se);
 
 	if (flags & ENQUEUE_WAKEUP) {
 		place_entity(cfs_rq, se, 0);
@@ -1054,6 +1258,7 @@ dequeue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int flags)
 	 * Update run-time statistics of the 'current'.
 	 */
 	update_curr(cfs_rq);
+	util_dequeue(cfs_rq, se);
 
 	update_stats_dequeue(cfs_rq, se);
 	if (flags & DEQUEUE_SLEEP) {
@@ -1144,6 +1349,7 @@ set_next_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 		 */
 		update_stats_wait_end(cfs_rq, se);
 		__dequeue_entity(cfs_rq, se);
+		util_update(cfs_rq, se);
 	}
 
 	update_stats_curr_start(cfs_rq, se);
@@ -1229,6 +1435,7 @@ entity_tick(struct cfs_rq *cfs_rq, struct sched_entity *curr, int queued)
 	 * Update run-time statistics of the 'current'.
 	 */
 	update_curr(cfs_rq);
+	util_update(cfs_rq, curr);
 
 	/*
 	 * Update share accounting for long-running entities.
@@ -1623,10 +1830,149 @@ find_idlest_cpu(struct sched_group *group, struct task_struct *p, int this_cpu)
 	return idlest;
 }
 
+/*
+ * ENERGY_AWARE_WAKE: among the idle cpus the wakee may go to, prefer the
+ * ones that have been online for a while, then the ones with the most
+ * capacity at their current frequency, then the ones in the shallowest
+ * idle state.  Cores that are hotplugged and clocked together, as on
+ * EXYNOS4, otherwise often get woken tasks right after coming online.
+ */
+#define WAKE_ONLINE_SETTLE	msecs_to_jiffies(20)
+
+static DEFINE_PER_CPU(unsigned long, wake_online_stamp);
+static DEFINE_PER_CPU(unsigned long, wake_freq_scale) = SCHED_POWER_SCALE;
+
+static void wake_cand_init(struct wake_cand *c, int cpu)
+{
+#ifdef CONFIG_CPU_IDLE
+	struct cpuidle_device *dev = per_cpu(cpuidle_devices, cpu);
+	struct cpuidle_state *state = dev ? ACCESS_ONCE(dev->last_state) : NULL;
+#endif
+
+	c->settled = time_after_eq(jiffies, per_cpu(wake_online_stamp, cpu) +
+				   WAKE_ONLINE_SETTLE);
+	c->capacity = (power_of(cpu) * per_cpu(wake_freq_scale, cpu)) >>
+		      SCHED_POWER_SHIFT;
+	c->exit_latency = 0;
+#ifdef CONFIG_CPU_IDLE
+	/* cpuidle sets last_state before entering it */
+	if (state)
+		c->exit_latency = state->exit_latency;
+#endif
+}
+
+/* @target is the default pick of __select_idle_sibling() */
+static int select_idle_cpu_energy(struct task_struct *p, int target)
+{
+	int cpu = smp_processor_id();
+	int prev_cpu = task_cpu(p);
+	enum wake_place reason = WAKE_PLACE_DEFAULT;
+	struct wake_cand def, best, cand;
+	struct sched_domain *sd;
+	int i, best_cpu = target;
+
+	if (!idle_cpu(target)) {
+		schedstat_inc(this_rq(), wake_place[WAKE_PLACE_NO_IDLE]);
+		return target;
+	}
+
+	wake_cand_init(&def, target);
+	best = def;
+
+	/* Look as wide as the domain wake_affine() decided within */
+	rcu_read_lock();
+	for_each_domain(target, sd) {
+		if (!cpumask_test_cpu(cpu, sched_domain_span(sd)) ||
+		    !cpumask_test_cpu(prev_cpu, sched_domain_span(sd)))
+			continue;
+
+		for_each_cpu_and(i, sched_domain_span(sd), &p->cpus_allowed) {
+			if (i == best_cpu || !idle_cpu(i))
+				continue;
+
+			wake_cand_init(&cand, i);
+			if (wake_place_better(&cand, &best) ==
+			    WAKE_PLACE_DEFAULT)
+				continue;
+
+			best = cand;
+			best_cpu = i;
+		}
+		break;
+	}
+	rcu_read_unlock();
+
+	/* Account for the reason the winner beat the default pick */
+	if (best_cpu != target)
+		reason = wake_place_better(&best, &def);
+
+	schedstat_inc(this_rq(), wake_place[reason]);
+
+	return best_cpu;
+}
+
+#ifdef CONFIG_CPU_FREQ
+static int wake_cpufreq_transition(struct notifier_block *nb,
+				   unsigned long val, void *data)
+{
+	struct cpufreq_freqs *freqs = data;
+	struct cpufreq_policy *policy;
+	unsigned long scale;
+	int i;
+
+	if (val != CPUFREQ_POSTCHANGE)
+		return 0;
+
+	policy = cpufreq_cpu_get(freqs->cpu);
+	if (!policy)
+		return 0;
+
+	if (policy->cpuinfo.max_freq) {
+		scale = div_u64((u64)freqs->new << SCHED_POWER_SHIFT,
+				policy->cpuinfo.max_freq);
+		for_each_cpu(i, policy->cpus)
+			per_cpu(wake_freq_scale, i) = scale;
+	}
+	cpufreq_cpu_put(policy);
+
+	return 0;
+}
+
+static struct notifier_block wake_cpufreq_nb = {
+	.notifier_call = wake_cpufreq_transition,
+};
+#endif
+
+static int __cpuinit wake_cpu_online(struct notifier_block *nb,
+				     unsigned long action, void *hcpu)
+{
+	if ((action & ~CPU_TASKS_FROZEN) == CPU_ONLINE)
+		per_cpu(wake_online_stamp, (long)hcpu) = jiffies;
+
+	return NOTIFY_OK;
+}
+
+static int __init wake_place_init(void)
+{
+	int i;
+
+	/* The boot cpus are settled already */
+	for_each_possible_cpu(i)
+		per_cpu(wake_online_stamp, i) = jiffies - WAKE_ONLINE_SETTLE;
+
+	hotcpu_notifier(wake_cpu_online, 0);
+#ifdef CONFIG_CPU_FREQ
+	cpufreq_register_notifier(&wake_cpufreq_nb,
+				  CPUFREQ_TRANSITION_NOTIFIER);
+#endif
+	return 0;
+}
+late_initcall(wake_place_init);
+
 /*
  * Try and locate an idle CPU in the sched_domain.
  */
-static int select_idle_sibling(struct task_struct *p, int target)
+static int __select_idle_sibling(struct task_struct *p, int target)
 {
 	int cpu = smp_processor_id();
 	int prev_cpu = task_cpu(p);
@@ -1675,6 +2021,16 @@ static int select_idle_sibling(struct task_struct *p, int target)
 	return target;
 }
 
+static int select_idle_sibling(struct task_struct *p, int target)
+{
+	target = __select_idle_sibling(p, target);
+
+	if (sched_feat(ENERGY_AWARE_WAKE))
+		target = select_idle_cpu_energy(p, target);
+
+	return target;
+}
+
 /*
  * sched_balance_self: balance the current task (running on cpu) in domains
  * that have the 'flag' flag set. In practice, this is SD_BALANCE_FORK and
@@ -72,3 +72,11 @@ SCHED_FEAT(NONIRQ_POWER, 1)
 SCHED_FEAT(TTWU_QUEUE, 1)
 
 SCHED_FEAT(FORCE_SD_OVERLAP, 0)
+
+/*
+ * On wakeup, pick among the idle cpus the one that has been online for
+ * a while, runs at the highest capacity and sits in the shallowest idle
+ * state, rather than the first idle sibling. For SoCs whose cores are
+ * hotplugged and clocked as one domain. See select_idle_cpu_energy().
+ */
+SCHED_FEAT(ENERGY_AWARE_WAKE, 0)
@@ -4,7 +4,7 @@
  * bump this up when changing the output format or the meaning of an existing
  * format, so that tools can adapt (or abort)
  */
-#define SCHEDSTAT_VERSION 15
+#define SCHEDSTAT_VERSION 16
 
 static int show_schedstat(struct seq_file *seq, void *v)
 {
@@ -33,6 +33,13 @@ static int show_schedstat(struct seq_file *seq, void *v)
 		    rq->rq_cpu_time,
 		    rq->rq_sched_info.run_delay, rq->rq_sched_info.pcount);
 
+		seq_printf(seq, " %u %u %u %u %u",
+		    rq->wake_place[WAKE_PLACE_DEFAULT],
+		    rq->wake_place[WAKE_PLACE_NO_IDLE],
+		    rq->wake_place[WAKE_PLACE_SETTLED],
+		    rq->wake_place[WAKE_PLACE_CAPACITY],
+		    rq->wake_place[WAKE_PLACE_SHALLOW]);
+
 		seq_printf(seq, "\n");
 
 #ifdef CONFIG_SMP
@@ -0,0 +1,54 @@
+#ifndef _LINUX_SCHED_WAKE_H
+#define _LINUX_SCHED_WAKE_H
+
+/*
+ * Ranking of idle cpus for ENERGY_AWARE_WAKE placement, see
+ * select_idle_sibling().
+ *
+ * This file must not include any kernel header: tools/sched-wake builds
+ * it on the host to compare placements against the default policy.
+ */
+
+/* Why a wakeup went where it went, counted in /proc/schedstat */
+enum wake_place {
+	WAKE_PLACE_DEFAULT,	/* the default idle sibling pick stood */
+	WAKE_PLACE_NO_IDLE,	/* no idle cpu to choose from */
+	WAKE_PLACE_SETTLED,	/* avoided a cpu onlined moments ago */
+	WAKE_PLACE_CAPACITY,	/* moved to a faster cpu */
+	WAKE_PLACE_SHALLOW,	/* moved to a cpu in a shallower idle state */
+	NR_WAKE_PLACE,
+};
+
+struct wake_cand {
+	int settled;			/* online for long enough */
+	unsigned long capacity;		/* cpu_power scaled by current freq */
+	unsigned int exit_latency;	/* of the idle state it is in, us */
+};
+
+/* Capacities closer than 1/8 of SCHED_POWER_SCALE are not told apart */
+#define WAKE_CAPACITY_SHIFT	7
+
+/*
+ * Returns the reason @a is a better place than @b, or WAKE_PLACE_DEFAULT
+ * if it is not.  Criteria are taken in order: a settled cpu, then a
+ * higher capacity, then a shallower idle state.
+ */
+static inline enum wake_place
+wake_place_better(const struct wake_cand *a, const struct wake_cand *b)
+{
+	unsigned long cap_a = a->capacity >> WAKE_CAPACITY_SHIFT;
+	unsigned long cap_b = b->capacity >> WAKE_CAPACITY_SHIFT;
+
+	if (a->settled != b->settled)
+		return a->settled ? WAKE_PLACE_SETTLED : WAKE_PLACE_DEFAULT;
+
+	if (cap_a != cap_b)
+		return cap_a > cap_b ? WAKE_PLACE_CAPACITY : WAKE_PLACE_DEFAULT;
+
+	if (a->exit_latency < b->exit_latency)
+		return WAKE_PLACE_SHALLOW;
+
+	return WAKE_PLACE_DEFAULT;
+}
+
+#endif /* _LINUX_SCHED_WAKE_H */
@@ -0,0 +1,135 @@
+/*
+ *  LZ4 Compressor
+ *
+ *  Greedy single-pass compressor producing the LZ4 block format, tuned
+ *  for page sized inputs: a 4K entry hash table of 4-byte sequences and
+ *  an accelerating scan step over incompressible data.
+ *
+ *  The LZ4 format and reference implementation are
+ *  Copyright (C) 2011-2012, Yann Collet.
+ *  BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+#define LZ4_READ32(p)	get_unaligned((const u32 *)(p))
+
+static inline u32 lz4_hash(u32 seq)
+{
+	return (seq * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+static inline unsigned char *lz4_write_length(unsigned char *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+
+	return op;
+}
+
+int lz4_compress(const unsigned char *in, size_t in_len,
+			unsigned char *out, size_t *out_len, void *wrkmem)
+{
+	const unsigned char * const in_end = in + in_len;
+	const unsigned char * const mflimit = in_end - MFLIMIT;
+	const unsigned char * const matchlimit = in_end - LASTLITERALS;
+	const unsigned char *ip = in, *anchor = in, *ref;
+	unsigned char *op = out, *token;
+	u32 *dict = wrkmem;
+	u32 seq, h, searches;
+	size_t len;
+
+	if (unlikely(in_len > LZ4_64KLIMIT))
+		return LZ4_E_INPUT_TOO_LARGE;
+
+	memset(dict, 0, LZ4_MEM_COMPRESS);
+
+	if (in_len < MFLIMIT + 1)
+		goto last_literals;
+
+	searches = 1U << SKIPSTRENGTH;
+	ip++;
+
+	while (ip <= mflimit) {
+		seq = LZ4_READ32(ip);
+		h = lz4_hash(seq);
+		ref = in + dict[h];
+		dict[h] = ip - in;
+
+		/* Entries are zero initialized, so ref < ip always holds */
+		if (LZ4_READ32(ref) != seq || ip - ref > MAX_DISTANCE) {
+			ip += searches++ >> SKIPSTRENGTH;
+			continue;
+		}
+		searches = 1U << SKIPSTRENGTH;
+
+		/* Extend the match backwards into pending literals */
+		while (ip > anchor && ref > in && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+
+		/* Literal run */
+		len = ip - anchor;
+		token = op++;
+		if (len >= RUN_MASK) {
+			*token = RUN_MASK << ML_BITS;
+			op = lz4_write_length(op, len - RUN_MASK);
+		} else {
+			*token = len << ML_BITS;
+		}
+		memcpy(op, anchor, len);
+		op += len;
+
+		/* Offset */
+		put_unaligned_le16(ip - ref, op);
+		op += 2;
+
+		/* Match length */
+		ip += MINMATCH;
+		ref += MINMATCH;
+		anchor = ip;
+		while (ip < matchlimit && *ip == *ref) {
+			ip++;
+			ref++;
+		}
+
+		len = ip - anchor;
+		if (len >= ML_MASK) {
+			*token += ML_MASK;
+			op = lz4_write_length(op, len - ML_MASK);
+		} else {
+			*token += len;
+		}
+		anchor = ip;
+
+		/* Seed the table with a position inside the match */
+		if (ip <= mflimit)
+			dict[lz4_hash(LZ4_READ32(ip - 2))] = ip - 2 - in;
+	}
+
+last_literals:
+	len = in_end - anchor;
+	token = op++;
+	if (len >= RUN_MASK) {
+		*token = RUN_MASK << ML_BITS;
+		op = lz4_write_length(op, len - RUN_MASK);
+	} else {
+		*token = len << ML_BITS;
+	}
+	memcpy(op, anchor, len);
+	op += len;
+
+	*out_len = op - out;
+	return LZ4_E_OK;
+}
+EXPORT_SYMBOL_GPL(lz4_compress);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("LZ4 Compressor");
@@ -0,0 +1,115 @@
+/*
+ *  LZ4 Decompressor
+ *
+ *  Every length and offset read from the input is validated against
+ *  both buffers, so corrupted input fails with an error rather than
+ *  reading or writing out of bounds.
+ *
+ *  The LZ4 format and reference implementation are
+ *  Copyright (C) 2011-2012, Yann Collet.
+ *  BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+ */
+
+#ifndef STATIC
+#include <linux/module.h>
+#include <linux/kernel.h>
+#endif
+
+#include <linux/string.h>
+#include <linux/lz4.h>
+#include <asm/unaligned.h>
+#include "lz4defs.h"
+
+int lz4_decompress_safe(const unsigned char *in, size_t in_len,
+			unsigned char *out, size_t *out_len)
+{
+	const unsigned char * const ip_end = in + in_len;
+	unsigned char * const op_end = out + *out_len;
+	const unsigned char *ip = in;
+	unsigned char *op = out, *ref;
+	unsigned int token, s;
+	size_t len, offset;
+
+	*out_len = 0;
+
+	while (ip < ip_end) {
+		token = *ip++;
+
+		/* Literal run */
+		len = token >> ML_BITS;
+		if (len == RUN_MASK) {
+			do {
+				if (unlikely(ip >= ip_end))
+					goto input_overrun;
+				s = *ip++;
+				len += s;
+			} while (s == 255);
+		}
+
+		if (unlikely(len > (size_t)(ip_end - ip)))
+			goto input_overrun;
+		if (unlikely(len > (size_t)(op_end - op)))
+			goto output_overrun;
+		memcpy(op, ip, len);
+		op += len;
+		ip += len;
+
+		/* The last sequence ends with its literals */
+		if (ip == ip_end)
+			break;
+
+		if (unlikely(ip_end - ip < 2))
+			goto input_overrun;
+		offset = get_unaligned_le16(ip);
+		ip += 2;
+		if (unlikely(!offset || offset > (size_t)(op - out)))
+			goto lookbehind_overrun;
+		ref = op - offset;
+
+		/* Match */
+		len = token & ML_MASK;
+		if (len == ML_MASK) {
+			do {
+				if (unlikely(ip >= ip_end))
+					goto input_overrun;
+				s = *ip++;
+				len += s;
+			} while (s == 255);
+		}
+		len += MINMATCH;
+
+		if (unlikely(len > (size_t)(op_end - op)))
+			goto output_overrun;
+
+		if (offset >= len) {
+			memcpy(op, ref, len);
+			op += len;
+		} else {
+			/* Overlapping copy replicates the last offset bytes */
+			while (len--)
+				*op++ = *ref++;
+		}
+	}
+
+	*out_len = op - out;
+	return LZ4_E_OK;
+
+input_overrun:
+	*out_len = op - out;
+	return LZ4_E_INPUT_OVERRUN;
+
+output_overrun:
+	*out_len = op - out;
+	return LZ4_E_OUTPUT_OVERRUN;
+
+lookbehind_overrun:
+	*out_len = op - out;
+	return LZ4_E_LOOKBEHIND_OVERRUN;
+}
+#ifndef STATIC
+EXPORT_SYMBOL_GPL(lz4_decompress_safe);
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_DESCRIPTION("LZ4 Decompressor");
+
+#endif
@@ -0,0 +1,33 @@
+/*
+ *  lz4defs.h -- LZ4 block format constants
+ *
+ *  The LZ4 format and reference implementation are
+ *  Copyright (C) 2011-2012, Yann Collet.
+ *  BSD 2-Clause License (http://www.opensource.org/licenses/bsd-license.php)
+ */
+
+/*
+ * Each sequence is: token, [literal length bytes], literals,
+ * 16-bit little endian offset, [match length bytes]. The token holds the
+ * literal run length in its high nibble and (match length - MINMATCH) in
+ * its low nibble; a nibble of 15 is extended by following bytes summed
+ * until one is below 255. The last sequence carries literals only.
+ */
+#define MINMATCH	4
+
+#define ML_BITS		4
+#define ML_MASK		((1U << ML_BITS) - 1)
+#define RUN_BITS	(8 - ML_BITS)
+#define RUN_MASK	((1U << RUN_BITS) - 1)
+
+#define MAX_DISTANCE	0xffff
+
+/* The last match must start at least MFLIMIT bytes before end of input */
+#define MFLIMIT		12
+/* ... and the last LASTLITERALS bytes are always encoded as literals */
+#define LASTLITERALS	5
+
+/* Searches without a match before the scan step starts to grow */
+#define SKIPSTRENGTH	6
+
+#define LZ4_64KLIMIT	((1U << 16) - 1)
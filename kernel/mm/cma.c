@@ -25,12 +25,17 @@
 #ifdef CONFIG_HAVE_MEMBLOCK
 #  include <linux/memblock.h>  /* memblock*() */
 #endif
+#include <linux/debugfs.h>     /* debugfs_create_file() */
 #include <linux/device.h>      /* struct device, dev_name() */
+#include <linux/dma-mapping.h> /* dma_sync_single_for_device() */
 #include <linux/errno.h>       /* Error numbers */
 #include <linux/err.h>         /* IS_ERR, PTR_ERR, etc. */
+#include <linux/ktime.h>       /* ktime_get() */
 #include <linux/mm.h>          /* PAGE_ALIGN() */
 #include <linux/module.h>      /* EXPORT_SYMBOL_GPL() */
 #include <linux/mutex.h>       /* mutex */
+#include <linux/pfn.h>         /* PFN_UP(), PFN_DOWN() */
+#include <linux/seq_file.h>    /* seq_printf() */
 #include <linux/slab.h>        /* kmalloc() */
 #include <linux/string.h>      /* str*() */
 
@@ -295,6 +300,11 @@ int __must_check cma_region_register(struct cma_region *reg)
 	reg->private_data = NULL;
 	reg->registered = 0;
 	reg->free_space = reg->size;
+	memset(&reg->stats, 0, sizeof reg->stats);
+#if defined CONFIG_CMA_MIGRATE
+	reg->movable_start_pfn = 0;
+	reg->movable_end_pfn = 0;
+#endif
 
 	/* Copy name and alloc_name */
 	name = reg->name;
@@ -462,6 +472,154 @@ __cma_allocator_find(const char *name)
 
 
 
+/************************* Movable regions *************************/
+
+#if defined CONFIG_CMA_MIGRATE
+
+static const char *cma_movable __initdata;
+
+/*
+ * movable ::= REG-NAME [ ',' movable ]
+ *
+ * See Documentation/contiguous-memory.txt for details.
+ */
+static int __init cma_movable_param(char *param)
+{
+	pr_debug("param: movable: %s\n", param);
+
+	cma_movable = param;
+	return 0;
+}
+early_param("cma.movable", cma_movable_param);
+
+/*
+ * Gives whole pageblocks of a region to the page allocator.  Whatever
+ * does not fill a pageblock at either end of the region stays reserved.
+ */
+static void __init __cma_region_release(struct cma_region *reg)
+{
+	unsigned long start, end, pfn;
+	struct zone *zone;
+
+	if (reg->movable_end_pfn)
+		return;
+
+	start = ALIGN(PFN_UP(reg->start), pageblock_nr_pages);
+	end = round_down(PFN_DOWN(reg->start + reg->size), pageblock_nr_pages);
+	if (start >= end) {
+		pr_warn("init: %s: smaller than a pageblock, not movable\n",
+			reg->name);
+		return;
+	}
+
+	zone = page_zone(pfn_to_page(start));
+	for (pfn = start; pfn < end; ++pfn) {
+		if (!pfn_valid(pfn) || page_zone(pfn_to_page(pfn)) != zone ||
+		    PageHighMem(pfn_to_page(pfn))) {
+			pr_warn("init: %s: not in a single lowmem zone, not movable\n",
+				reg->name);
+			return;
+		}
+	}
+
+	for (pfn = start; pfn < end; pfn += pageblock_nr_pages)
+		init_cma_reserved_pageblock(pfn_to_page(pfn));
+
+	reg->movable_start_pfn = start;
+	reg->movable_end_pfn = end;
+
+	pr_info("init: %s: %luK can hold movable pages\n", reg->name,
+		(end - start) << (PAGE_SHIFT - 10));
+}
+
+static void __init cma_movable_init(void)
+{
+	const char *from = cma_movable;
+	struct cma_region *reg;
+
+	if (!from)
+		return;
+
+	mutex_lock(&cma_mutex);
+
+	while (*from && *from != ';') {
+		const char *name = from;
+
+		reg = __cma_region_find(&from);
+		if (reg)
+			__cma_region_release(reg);
+		else
+			pr_warn("init: movable: no region near %s\n", name);
+	}
+
+	mutex_unlock(&cma_mutex);
+}
+
+/*
+ * Takes the pages under a freshly allocated chunk back from the page
+ * allocator, migrating away whatever was placed there meanwhile.
+ */
+static int __cma_chunk_take(struct cma_region *reg, struct cma_chunk *chunk)
+{
+	unsigned long start, end;
+	int ret;
+
+	start = max_t(unsigned long, PFN_DOWN(chunk->start),
+		      reg->movable_start_pfn);
+	end = min_t(unsigned long, PFN_UP(chunk->start + chunk->size),
+		    reg->movable_end_pfn);
+	if (start >= end)
+		return 0;
+
+	ret = alloc_contig_range(start, end, MIGRATE_CMA,
+				 &reg->stats.migrated);
+	if (ret)
+		return ret;
+
+	/*
+	 * The pages held page cache or process data a moment ago.  Clear
+	 * them and write the cache back so no stale line lands on top of
+	 * what the device puts there later.
+	 */
+	memset(pfn_to_kaddr(start), 0, (end - start) << PAGE_SHIFT);
+	dma_sync_single_for_device(NULL, PFN_PHYS(start),
+				   (end - start) << PAGE_SHIFT, DMA_TO_DEVICE);
+	return 0;
+}
+
+static void __cma_chunk_give(struct cma_chunk *chunk)
+{
+	struct cma_region *reg = chunk->reg;
+	unsigned long start, end;
+
+	start = max_t(unsigned long, PFN_DOWN(chunk->start),
+		      reg->movable_start_pfn);
+	end = min_t(unsigned long, PFN_UP(chunk->start + chunk->size),
+		    reg->movable_end_pfn);
+	if (start < end)
+		free_contig_range(start, end - start);
+}
+
+#else
+
+static inline void cma_movable_init(void)
+{
+}
+
+static inline int
+__cma_chunk_take(struct cma_region *reg, struct cma_chunk *chunk)
+{
+	return 0;
+}
+
+static inline void __cma_chunk_give(struct cma_chunk *chunk)
+{
+}
+
+#endif
+
+
+
 /************************* Initialise CMA *************************/
 
 int __init cma_set_defaults(struct cma_region *regions, const char *map)
@@ -601,6 +759,8 @@ static int __init cma_init(void)
 
 	INIT_LIST_HEAD(&cma_early_regions);
 
+	cma_movable_init();
+
 	return 0;
 }
 /*
@@ -936,6 +1096,63 @@ static void __cma_sysfs_region_add(struct cma_region *reg)
 #endif
 
 
+/************************* DebugFS *************************/
+
+#if defined CONFIG_DEBUG_FS
+
+static int cma_debugfs_show(struct seq_file *s, void *unused)
+{
+	struct cma_region *reg;
+
+	seq_printf(s, "%-16s %9s %9s %9s %8s %6s %9s %8s %8s\n",
+		   "region", "size_kb", "free_kb", "movable", "allocs",
+		   "fails", "migrated", "avg_us", "max_us");
+
+	mutex_lock(&cma_mutex);
+
+	cma_foreach_region(reg) {
+		const struct cma_region_stats *st = &reg->stats;
+		unsigned long movable = 0;
+
+#if defined CONFIG_CMA_MIGRATE
+		movable = (reg->movable_end_pfn - reg->movable_start_pfn)
+			<< (PAGE_SHIFT - 10);
+#endif
+		seq_printf(s, "%-16s %9zu %9zu %9lu %8lu %6lu %9lu %8lu %8lu\n",
+			   reg->name ?: "(private)", reg->size >> 10,
+			   reg->free_space >> 10, movable, st->allocs,
+			   st->fails, st->migrated,
+			   st->allocs ? st->total_us / st->allocs : 0,
+			   st->max_us);
+	}
+
+	mutex_unlock(&cma_mutex);
+
+	return 0;
+}
+
+static int cma_debugfs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, cma_debugfs_show, NULL);
+}
+
+static const struct file_operations cma_debugfs_fops = {
+	.open		= cma_debugfs_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init cma_debugfs_init(void)
+{
+	debugfs_create_file("cma", 0444, NULL, NULL, &cma_debugfs_fops);
+	return 0;
+}
+late_initcall(cma_debugfs_init);
+
+#endif
+
+
 /************************* Chunks *************************/
 
 /* All chunks sorted by start address. */
@@ -999,6 +1216,7 @@ static void __cma_chunk_free(struct cma_chunk *chunk)
 	chunk->reg->free_space += chunk->size;
 	--chunk->reg->users;
 
+	__cma_chunk_give(chunk);
 	chunk->reg->alloc->free(chunk);
 }
 
@@ -1016,6 +1234,9 @@ __cma_alloc_from_region(struct cma_region *reg,
 			size_t size, dma_addr_t alignment)
 {
 	struct cma_chunk *chunk;
+	ktime_t begin;
+	unsigned long us;
+	int ret;
 
 	pr_debug("allocate %p/%p from %s\n",
 		 (void *)size, (void *)alignment,
@@ -1031,12 +1252,26 @@ __cma_alloc_from_region(struct cma_region *reg,
 			return -ENOMEM;
 	}
 
+	begin = ktime_get();
+
 	chunk = reg->alloc->alloc(reg, size, alignment);
-	if (!chunk)
+	if (!chunk) {
+		++reg->stats.fails;
 		return -ENOMEM;
+	}
+
+	ret = __cma_chunk_take(reg, chunk);
+	if (unlikely(ret < 0)) {
+		pr_debug("unable to take %p@%p back: %d\n",
+			 (void *)chunk->size, (void *)chunk->start, ret);
+		reg->alloc->free(chunk);
+		++reg->stats.fails;
+		return ret;
+	}
 
 	if (unlikely(__cma_chunk_insert(chunk) < 0)) {
 		/* We should *never* be here. */
+		__cma_chunk_give(chunk);
 		chunk->reg->alloc->free(chunk);
 		kfree(chunk);
 		return -EADDRINUSE;
@@ -1045,7 +1280,14 @@ __cma_alloc_from_region(struct cma_region *reg,
 	chunk->reg = reg;
 	++reg->users;
 	reg->free_space -= chunk->size;
-	pr_debug("allocated at %p\n", (void *)chunk->start);
+
+	us = ktime_us_delta(ktime_get(), begin);
+	++reg->stats.allocs;
+	reg->stats.total_us += us;
+	if (us > reg->stats.max_us)
+		reg->stats.max_us = us;
+
+	pr_debug("allocated at %p in %luus\n", (void *)chunk->start, us);
 	return chunk->start;
 }
 
@@ -1269,7 +1269,7 @@ static struct page *new_page(struct page *p, unsigned long private, int **x)
  */
 static int get_any_page(struct page *p, unsigned long pfn, int flags)
 {
-	int ret;
+	int ret, migratetype;
 
 	if (flags & MF_COUNT_INCREASED)
 		return 1;
@@ -1284,6 +1284,7 @@ static int get_any_page(struct page *p, unsigned long pfn, int flags)
 	 * Isolate the page, so that it doesn't get reallocated if it
 	 * was free.
 	 */
+	migratetype = get_pageblock_migratetype(p);
 	set_migratetype_isolate(p);
 	/*
 	 * When the target page is a free hugepage, just remove it
@@ -1307,7 +1308,7 @@ static int get_any_page(struct page *p, unsigned long pfn, int flags)
 		/* Not a free page */
 		ret = 1;
 	}
-	unset_migratetype_isolate(p);
+	unset_migratetype_isolate(p, migratetype);
 	unlock_memory_hotplug();
 	return ret;
 }
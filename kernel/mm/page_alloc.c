@@ -57,6 +57,9 @@
 #include <linux/ftrace_event.h>
 #include <linux/memcontrol.h>
 #include <linux/prefetch.h>
+#include <linux/migrate.h>
+#include <linux/mm_inline.h>
+#include <linux/swap.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -639,12 +642,21 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 			batch_free = to_free;
 
 		do {
+			int mt;
+
 			page = list_entry(list->prev, struct page, lru);
 			/* must delete as __free_one_page list manipulates */
 			list_del(&page->lru);
 			/* MIGRATE_MOVABLE list may include MIGRATE_RESERVEs */
-			__free_one_page(page, zone, 0, page_private(page));
-			trace_mm_page_pcpu_drain(page, 0, page_private(page));
+			mt = page_private(page);
+			/*
+			 * ... and MIGRATE_CMA pages, whose block may have
+			 * been isolated by alloc_contig_range() since.
+			 */
+			if (is_migrate_cma(mt))
+				mt = get_pageblock_migratetype(page);
+			__free_one_page(page, zone, 0, mt);
+			trace_mm_page_pcpu_drain(page, 0, mt);
 		} while (--to_free && --batch_free && !list_empty(list));
 	}
 	__mod_zone_page_state(zone, NR_FREE_PAGES, count);
@@ -845,7 +857,13 @@ struct page *__rmqueue_smallest(struct zone *zone, unsigned int order,
 static int fallbacks[MIGRATE_TYPES][MIGRATE_TYPES-1] = {
 	[MIGRATE_UNMOVABLE]   = { MIGRATE_RECLAIMABLE, MIGRATE_MOVABLE,   MIGRATE_RESERVE },
 	[MIGRATE_RECLAIMABLE] = { MIGRATE_UNMOVABLE,   MIGRATE_MOVABLE,   MIGRATE_RESERVE },
+#ifdef CONFIG_CMA_MIGRATE
+	/* CMA blocks only ever hold movable pages, see alloc_contig_range() */
+	[MIGRATE_MOVABLE]     = { MIGRATE_CMA,         MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE, MIGRATE_RESERVE },
+	[MIGRATE_CMA]         = { MIGRATE_RESERVE,     MIGRATE_RESERVE,   MIGRATE_RESERVE }, /* Never used */
+#else
 	[MIGRATE_MOVABLE]     = { MIGRATE_RECLAIMABLE, MIGRATE_UNMOVABLE, MIGRATE_RESERVE },
+#endif
 	[MIGRATE_RESERVE]     = { MIGRATE_RESERVE,     MIGRATE_RESERVE,   MIGRATE_RESERVE }, /* Never used */
 };
 
@@ -960,11 +978,14 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 			 * If breaking a large block of pages, move all free
 			 * pages to the preferred allocation list. If falling
 			 * back for a reclaimable kernel allocation, be more
-			 * aggressive about taking ownership of free pages
+			 * aggressive about taking ownership of free pages.
+			 * CMA blocks are never taken over, or cma_alloc()
+			 * could no longer get them back.
 			 */
-			if (unlikely(current_order >= (pageblock_order >> 1)) ||
+			if (!is_migrate_cma(migratetype) &&
+			    (unlikely(current_order >= (pageblock_order >> 1)) ||
 					start_migratetype == MIGRATE_RECLAIMABLE ||
-					page_group_by_mobility_disabled) {
+					page_group_by_mobility_disabled)) {
 				unsigned long pages;
 				pages = move_freepages_block(zone, page,
 								start_migratetype);
@@ -983,7 +1004,8 @@ __rmqueue_fallback(struct zone *zone, int order, int start_migratetype)
 			rmv_page_order(page);
 
 			/* Take ownership for orders >= pageblock_order */
-			if (current_order >= pageblock_order)
+			if (current_order >= pageblock_order &&
+			    !is_migrate_cma(migratetype))
 				change_pageblock_range(page, current_order,
 							start_migratetype);
 
@@ -1059,7 +1081,11 @@ static int rmqueue_bulk(struct zone *zone, unsigned int order,
 			list_add(&page->lru, list);
 		else
 			list_add_tail(&page->lru, list);
-		set_page_private(page, migratetype);
+		/* Remember CMA pages so they go back to their own list */
+		if (is_migrate_cma(get_pageblock_migratetype(page)))
+			set_page_private(page, MIGRATE_CMA);
+		else
+			set_page_private(page, migratetype);
 		list = &page->lru;
 	}
 	__mod_zone_page_state(zone, NR_FREE_PAGES, -(i << order));
@@ -1197,9 +1223,10 @@ void free_hot_cold_page(struct page *page, int cold)
 	/*
 	 * We only track unmovable, reclaimable and movable on pcp lists.
 	 * Free ISOLATE pages back to the allocator because they are being
-	 * offlined but treat RESERVE as movable pages so we can get those
-	 * areas back if necessary. Otherwise, we may have to free
-	 * excessively into the page allocator
+	 * offlined but treat RESERVE and CMA as movable pages so we can get
+	 * those areas back if necessary. Otherwise, we may have to free
+	 * excessively into the page allocator. page_private() keeps the
+	 * real type for free_pcppages_bulk().
 	 */
 	if (migratetype >= MIGRATE_PCPTYPES) {
 		if (unlikely(migratetype == MIGRATE_ISOLATE)) {
@@ -1290,8 +1317,14 @@ int split_free_page(struct page *page)
 
 	if (order >= pageblock_order - 1) {
 		struct page *endpage = page + (1 << order) - 1;
-		for (; page < endpage; page += pageblock_nr_pages)
-			set_pageblock_migratetype(page, MIGRATE_MOVABLE);
+		for (; page < endpage; page += pageblock_nr_pages) {
+			int mt = get_pageblock_migratetype(page);
+
+			/* Leave CMA pageblocks to CMA */
+			if (!is_migrate_cma(mt))
+				set_pageblock_migratetype(page,
+							  MIGRATE_MOVABLE);
+		}
 	}
 
 	return 1 << order;
@@ -5551,6 +5584,14 @@ __count_immobile_pages(struct zone *zone, struct page *page, int count)
 	if (get_pageblock_migratetype(page) == MIGRATE_MOVABLE)
 		return true;
 
+	/*
+	 * CMA blocks hold nothing but movable pages and chunks already
+	 * handed out by cma_alloc(), which alloc_contig_range() steers
+	 * around.
+	 */
+	if (is_migrate_cma(get_pageblock_migratetype(page)))
+		return true;
+
 	pfn = page_to_pfn(page);
 	for (found = 0, iter = 0; iter < pageblock_nr_pages; iter++) {
 		unsigned long check = pfn + iter;
@@ -5647,7 +5688,7 @@ out:
 	return ret;
 }
 
-void unset_migratetype_isolate(struct page *page)
+void unset_migratetype_isolate(struct page *page, int migratetype)
 {
 	struct zone *zone;
 	unsigned long flags;
@@ -5655,8 +5696,8 @@ void unset_migratetype_isolate(struct page *page)
 	spin_lock_irqsave(&zone->lock, flags);
 	if (get_pageblock_migratetype(page) != MIGRATE_ISOLATE)
 		goto out;
-	set_pageblock_migratetype(page, MIGRATE_MOVABLE);
-	move_freepages_block(zone, page, MIGRATE_MOVABLE);
+	set_pageblock_migratetype(page, migratetype);
+	move_freepages_block(zone, page, migratetype);
 out:
 	spin_unlock_irqrestore(&zone->lock, flags);
 }
@@ -5708,6 +5749,209 @@ __offline_isolated_pages(unsigned long start_pfn, unsigned long end_pfn)
 }
 #endif
 
+#ifdef CONFIG_CMA_MIGRATE
+/*
+ * Hand a pageblock reserved at boot for CMA over to the page allocator.
+ * It then serves movable allocations until alloc_contig_range() takes
+ * its pages back.
+ */
+void __init init_cma_reserved_pageblock(struct page *page)
+{
+	unsigned long i = pageblock_nr_pages;
+	struct page *p = page;
+
+	do {
+		__ClearPageReserved(p);
+		set_page_count(p, 0);
+	} while (++p, --i);
+
+	set_page_refcounted(page);
+	set_pageblock_migratetype(page, MIGRATE_CMA);
+	__free_pages(page, pageblock_order);
+	totalram_pages += pageblock_nr_pages;
+}
+
+#define CONTIG_MIGRATE_BATCH	256
+#define CONTIG_RETRIES		5
+
+static struct page *
+contig_migrate_alloc(struct page *page, unsigned long private, int **x)
+{
+	return alloc_page(GFP_HIGHUSER_MOVABLE);
+}
+
+/*
+ * Migrate whatever sits on the LRU in [start, end) elsewhere.  Pages
+ * that can not be isolated right now are left alone; the caller finds
+ * them when it collects the free pages and tries again.
+ */
+static int __alloc_contig_migrate_range(unsigned long start,
+					unsigned long end,
+					unsigned long *migrated)
+{
+	unsigned long pfn = start;
+	LIST_HEAD(source);
+	int nr, ret;
+
+	while (pfn < end) {
+		for (nr = 0; pfn < end && nr < CONTIG_MIGRATE_BATCH; pfn++) {
+			struct page *page;
+
+			if (!pfn_valid_within(pfn))
+				continue;
+			page = pfn_to_page(pfn);
+			if (!get_page_unless_zero(page))
+				continue;
+			if (!isolate_lru_page(page)) {
+				list_add_tail(&page->lru, &source);
+				inc_zone_page_state(page, NR_ISOLATED_ANON +
+						    page_is_file_cache(page));
+				nr++;
+			}
+			put_page(page);
+		}
+		if (!nr)
+			continue;
+
+		/* this function returns # of failed pages */
+		ret = migrate_pages(&source, contig_migrate_alloc, 0,
+				    false, true);
+		if (ret)
+			putback_lru_pages(&source);
+		if (ret < 0)
+			return ret;
+		*migrated += nr - ret;
+	}
+	return 0;
+}
+
+/*
+ * Pull the free pages covering [start, end) off the buddy lists and
+ * split them to order 0.  A buddy may straddle either end of the range:
+ * *outer_start is set to where the first one begins and the return
+ * value is where the last one ends.  Returns 0, with nothing taken, if
+ * some page in the range is not free.
+ */
+static unsigned long
+__alloc_contig_take_free(struct zone *zone, unsigned long start,
+			 unsigned long end, unsigned long *outer_start)
+{
+	unsigned long flags, pfn = start;
+	unsigned int order;
+
+	spin_lock_irqsave(&zone->lock, flags);
+
+	for (order = 0; order < MAX_ORDER && order <= pageblock_order;
+	     order++) {
+		unsigned long head = start & (~0UL << order);
+		struct page *page = pfn_to_page(head);
+
+		if (PageBuddy(page) && page_order(page) >= order) {
+			pfn = head;
+			break;
+		}
+	}
+	*outer_start = pfn;
+
+	while (pfn < end) {
+		struct page *page = pfn_to_page(pfn);
+
+		if (!pfn_valid_within(pfn) || !PageBuddy(page))
+			break;
+
+		order = page_order(page);
+		list_del(&page->lru);
+		rmv_page_order(page);
+		zone->free_area[order].nr_free--;
+		__mod_zone_page_state(zone, NR_FREE_PAGES, -(1UL << order));
+		set_page_refcounted(page);
+		split_page(page, order);
+		pfn += 1UL << order;
+	}
+
+	spin_unlock_irqrestore(&zone->lock, flags);
+
+	if (pfn < end) {
+		free_contig_range(*outer_start, pfn - *outer_start);
+		return 0;
+	}
+	return pfn;
+}
+
+/**
+ * alloc_contig_range() -- take a range of pages away from the allocator
+ * @start:	first PFN of the range.
+ * @end:	one past the last PFN of the range.
+ * @migratetype:	migrate type of the pageblocks around the range, put
+ *		back once the pages are taken (MIGRATE_CMA in practice).
+ * @migrated:	if not NULL, the number of pages migrated out of the
+ *		range is added to it.
+ *
+ * The pageblocks covering the range are isolated so nothing new is
+ * allocated from them, pages in use are migrated away and the free
+ * pages are then pulled off the buddy lists.  Pages of the pageblocks
+ * outside of [start, end) are left alone, so that chunks of a pageblock
+ * can be allocated independently.
+ *
+ * On success every page in the range has a reference count of one and
+ * must be given back with free_contig_range().  Returns -EBUSY if some
+ * page could not be migrated.
+ */
+int alloc_contig_range(unsigned long start, unsigned long end,
+		       int migratetype, unsigned long *migrated)
+{
+	unsigned long block_start = start & ~(pageblock_nr_pages - 1);
+	unsigned long block_end = ALIGN(end, pageblock_nr_pages);
+	struct zone *zone = page_zone(pfn_to_page(start));
+	unsigned long outer_start, outer_end, nr = 0;
+	int tries = 0;
+	int ret;
+
+	ret = start_isolate_page_range(block_start, block_end, migratetype);
+	if (ret)
+		return ret;
+
+	for (;;) {
+		lru_add_drain_all();
+		ret = __alloc_contig_migrate_range(start, end, &nr);
+		if (ret)
+			goto done;
+
+		/* Pages freed by migration may still sit on pcp lists */
+		drain_all_pages();
+
+		outer_end = __alloc_contig_take_free(zone, start, end,
+						     &outer_start);
+		if (outer_end)
+			break;
+
+		if (++tries == CONTIG_RETRIES ||
+		    fatal_signal_pending(current)) {
+			ret = -EBUSY;
+			goto done;
+		}
+		yield();
+	}
+
+	if (start != outer_start)
+		free_contig_range(outer_start, start - outer_start);
+	if (end != outer_end)
+		free_contig_range(end, outer_end - end);
+
+done:
+	undo_isolate_page_range(block_start, block_end, migratetype);
+	if (migrated)
+		*migrated += nr;
+	return ret;
+}
+
+void free_contig_range(unsigned long pfn, unsigned long nr_pages)
+{
+	for (; nr_pages--; pfn++)
+		__free_page(pfn_to_page(pfn));
+}
+#endif /* CONFIG_CMA_MIGRATE */
+
 #ifdef CONFIG_MEMORY_FAILURE
 bool is_free_buddy_page(struct page *page)
 {
@@ -0,0 +1,82 @@
+/*
+ * linux/mm/vmpressure.c
+ *
+ * Global memory pressure estimate from the reclaim efficiency: the share of
+ * scanned pages that reclaim failed to free over a fixed window of scanned
+ * pages. Consumers such as the Android low memory killer use it to act
+ * before allocations start stalling in direct reclaim.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/spinlock.h>
+#include <linux/swap.h>
+#include <linux/vmpressure.h>
+
+/* pages to scan before the pressure is evaluated */
+#define VMPRESSURE_WIN	(SWAP_CLUSTER_MAX * 16)
+
+static DEFINE_SPINLOCK(vmpressure_lock);
+static unsigned long vmpressure_scanned;
+static unsigned long vmpressure_reclaimed;
+static ATOMIC_NOTIFIER_HEAD(vmpressure_notifier);
+
+int vmpressure_register(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_register(&vmpressure_notifier, nb);
+}
+EXPORT_SYMBOL_GPL(vmpressure_register);
+
+int vmpressure_unregister(struct notifier_block *nb)
+{
+	return atomic_notifier_chain_unregister(&vmpressure_notifier, nb);
+}
+EXPORT_SYMBOL_GPL(vmpressure_unregister);
+
+/**
+ * vmpressure() - account reclaim efficiency
+ * @gfp:	reclaimer's gfp mask
+ * @scanned:	number of pages scanned
+ * @reclaimed:	number of pages reclaimed
+ *
+ * Called from the global reclaim path after each zone has been shrunk.
+ */
+void vmpressure(gfp_t gfp, unsigned long scanned, unsigned long reclaimed)
+{
+	unsigned long pressure;
+
+	/*
+	 * Only allocations that could have used any page count: a failure to
+	 * find, say, lowmem pages for a GFP_DMA request says little about the
+	 * memory available to applications.
+	 */
+	if (!(gfp & (__GFP_HIGHMEM | __GFP_MOVABLE | __GFP_IO | __GFP_FS)))
+		return;
+	if (!scanned)
+		return;
+
+	spin_lock(&vmpressure_lock);
+	vmpressure_scanned += scanned;
+	vmpressure_reclaimed += reclaimed;
+	if (vmpressure_scanned < VMPRESSURE_WIN) {
+		spin_unlock(&vmpressure_lock);
+		return;
+	}
+	scanned = vmpressure_scanned;
+	reclaimed = vmpressure_reclaimed;
+	vmpressure_scanned = 0;
+	vmpressure_reclaimed = 0;
+	spin_unlock(&vmpressure_lock);
+
+	/* slab and writeback completions can reclaim more than was scanned */
+	if (reclaimed >= scanned)
+		pressure = 0;
+	else
+		pressure = 100 - reclaimed * 100 / scanned;
+
+	atomic_notifier_call_chain(&vmpressure_notifier, pressure, NULL);
+}
@@ -0,0 +1,288 @@
+/*
+ * hotplug-replay - record CPU load traces and replay them through the
+ * EXYNOS hotplug policy
+ *
+ * The decision code is arch/arm/mach-exynos/include/mach/hotplug-policy.h,
+ * the very header dynamic-nr_running-hotplug.c builds, so a trace
+ * recorded on a board can be replayed on the host with any set of
+ * tunables to compare latency and energy without flashing anything.
+ *
+ *   hotplug-replay record [-i ms] [-n samples] > trace
+ *	On the board, with all CPUs online and hotplug disabled.  Writes
+ *	one line per sample: "<ms> <nr_running> <load0> ... <load3>".
+ *
+ *   hotplug-replay replay [tunables] [power model] [-v] < trace
+ *	Feeds the trace to the policy.  The work recorded in a sample
+ *	is spread over the CPUs the policy keeps online; what does not
+ *	fit is carried over to the next sample and reported as delayed.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <mach/hotplug-policy.h>
+
+#define NCPU	HOTPLUG_MAX_CPUS
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: hotplug-replay record [-i ms] [-n samples]\n"
+		"       hotplug-replay replay [-v] [options] < trace\n"
+		"tunables (defaults are the kernel's):\n"
+		"  -u N,N,N,N   up_nr_running, x100, per number of online CPUs\n"
+		"  -d N,N,N,N   down_nr_running, x100\n"
+		"  -l PCT       up_load          -L PCT  down_load\n"
+		"  -t MS        up_dwell_ms      -T MS   down_dwell_ms\n"
+		"  -w W         avg_weight       -m N    min_cpus  -M N  max_cpus\n"
+		"power model:\n"
+		"  -b MW        busy CPU power   (default 450)\n"
+		"  -s MW        idle CPU power   (default 40)\n"
+		"  -e UJ        energy per plug  (default 2000)\n");
+	exit(1);
+}
+
+/* ------------------------------------------------------------------ */
+
+struct cpu_stat {
+	unsigned long long busy, total;
+};
+
+static int read_cpu_stats(struct cpu_stat *st)
+{
+	char line[256];
+	FILE *f = fopen("/proc/stat", "r");
+	int n = 0;
+
+	if (!f)
+		return -1;
+
+	memset(st, 0, sizeof(*st) * NCPU);
+	while (fgets(line, sizeof(line), f)) {
+		unsigned long long v[8] = { 0 };
+		int cpu;
+
+		if (sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu %llu",
+			   &cpu, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5],
+			   &v[6], &v[7]) < 5 || cpu < 0 || cpu >= NCPU)
+			continue;
+		/* user nice system idle iowait irq softirq steal */
+		st[cpu].total = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] +
+				v[6] + v[7];
+		st[cpu].busy = st[cpu].total - v[3] - v[4];
+		n++;
+	}
+	fclose(f);
+	return n;
+}
+
+static int read_nr_running(void)
+{
+	FILE *f = fopen("/proc/loadavg", "r");
+	int running = 1, total;
+
+	if (!f)
+		return -1;
+	if (fscanf(f, "%*s %*s %*s %d/%d", &running, &total) != 2)
+		running = 1;
+	fclose(f);
+
+	/* do not count ourselves */
+	return running > 0 ? running - 1 : 0;
+}
+
+static int record(int argc, char **argv)
+{
+	struct cpu_stat prev[NCPU], cur[NCPU];
+	unsigned int interval = 100, samples = 0, i, t = 0;
+	int opt, cpu;
+
+	while ((opt = getopt(argc, argv, "i:n:")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		case 'n':
+			samples = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (!interval)
+		usage();
+
+	if (read_cpu_stats(prev) < 0) {
+		perror("/proc/stat");
+		return 1;
+	}
+
+	for (i = 0; !samples || i < samples; i++) {
+		usleep(interval * 1000);
+		t += interval;
+
+		read_cpu_stats(cur);
+		printf("%u %d", t, read_nr_running());
+		for (cpu = 0; cpu < NCPU; cpu++) {
+			unsigned long long dt = cur[cpu].total - prev[cpu].total;
+			unsigned long long db = cur[cpu].busy - prev[cpu].busy;
+
+			printf(" %llu", dt ? 100 * db / dt : 0);
+		}
+		putchar('\n');
+		fflush(stdout);
+		memcpy(prev, cur, sizeof(prev));
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------ */
+
+static void parse_table(unsigned int *table, char *arg)
+{
+	char *tok;
+	int i = 1;
+
+	for (tok = strtok(arg, ","); tok && i <= NCPU; tok = strtok(NULL, ","))
+		table[i++] = strtoul(tok, NULL, 0);
+	if (tok || i <= NCPU)
+		usage();
+}
+
+static int replay(int argc, char **argv)
+{
+	struct hotplug_tunables t = HOTPLUG_DEFAULT_TUNABLES;
+	struct hotplug_state st = { 0 };
+	unsigned int busy_mw = 450, idle_mw = 40, plug_uj = 2000;
+	unsigned long long energy_uj = 0, online_ms = 0;
+	unsigned long long delayed = 0, delayed_ms = 0;
+	unsigned int ups = 0, downs = 0, max_backlog = 0;
+	unsigned int online = (1U << NCPU) - 1, backlog = 0;
+	unsigned int prev_ms = 0, total_ms = 0, samples = 0;
+	int verbose = 0, opt;
+	char line[256];
+
+	while ((opt = getopt(argc, argv, "u:d:l:L:t:T:w:m:M:b:s:e:v")) != -1) {
+		switch (opt) {
+		case 'u': parse_table(t.up_nr, optarg); break;
+		case 'd': parse_table(t.down_nr, optarg); break;
+		case 'l': t.up_load = atoi(optarg); break;
+		case 'L': t.down_load = atoi(optarg); break;
+		case 't': t.up_dwell_ms = atoi(optarg); break;
+		case 'T': t.down_dwell_ms = atoi(optarg); break;
+		case 'w': t.avg_weight = atoi(optarg); break;
+		case 'm': t.min_cpus = atoi(optarg); break;
+		case 'M': t.max_cpus = atoi(optarg); break;
+		case 'b': busy_mw = atoi(optarg); break;
+		case 's': idle_mw = atoi(optarg); break;
+		case 'e': plug_uj = atoi(optarg); break;
+		case 'v': verbose = 1; break;
+		default: usage();
+		}
+	}
+	if (t.avg_weight < 1 || t.avg_weight > (1U << HOTPLUG_AVG_SHIFT) ||
+	    t.min_cpus < 1 || t.max_cpus > NCPU || t.min_cpus > t.max_cpus)
+		usage();
+
+	while (fgets(line, sizeof(line), stdin)) {
+		struct hotplug_sample s;
+		unsigned int ms, nr, load[NCPU], demand = 0, n = 0, share;
+		unsigned int cpu, dt;
+		enum hotplug_action action;
+		int target;
+
+		if (sscanf(line, "%u %u %u %u %u %u", &ms, &nr, &load[0],
+			   &load[1], &load[2], &load[3]) != 2 + NCPU)
+			continue;
+		dt = ms > prev_ms ? ms - prev_ms : 0;
+		prev_ms = ms;
+		if (!dt)
+			continue;
+
+		/* Work of this sample plus what earlier ones left over */
+		for (cpu = 0; cpu < NCPU; cpu++)
+			demand += load[cpu];
+		demand += backlog;
+
+		for (cpu = 0; cpu < NCPU; cpu++)
+			n += !!(online & (1U << cpu));
+		share = demand / n;
+		if (share > 100)
+			share = 100;
+		backlog = demand - share * n;
+		if (backlog > max_backlog)
+			max_backlog = backlog;
+		if (backlog) {
+			delayed += (unsigned long long)backlog * dt / 100;
+			delayed_ms += dt;
+		}
+
+		memset(&s, 0, sizeof(s));
+		s.elapsed_ms = dt;
+		s.nr_running = nr;
+		s.online = online;
+		for (cpu = 0; cpu < NCPU; cpu++)
+			if (online & (1U << cpu))
+				s.load[cpu] = share;
+
+		energy_uj += (unsigned long long)n * dt *
+			     (share * busy_mw + (100 - share) * idle_mw) / 100;
+		online_ms += (unsigned long long)n * dt;
+		total_ms += dt;
+		samples++;
+
+		action = hotplug_policy_decide(&t, &st, &s, &target);
+		if (action == HOTPLUG_UP) {
+			online |= 1U << target;
+			energy_uj += plug_uj;
+			ups++;
+		} else if (action == HOTPLUG_DOWN) {
+			online &= ~(1U << target);
+			energy_uj += plug_uj;
+			downs++;
+		}
+
+		if (verbose)
+			printf("%8u nr %2u avg %4u load %3u online %u backlog %4u%s\n",
+			       ms, nr, st.avg_nr, st.avg_load, n, backlog,
+			       action == HOTPLUG_UP ? " up" :
+			       action == HOTPLUG_DOWN ? " down" : "");
+	}
+
+	if (!total_ms) {
+		fprintf(stderr, "no samples\n");
+		return 1;
+	}
+
+	printf("samples          %u\n", samples);
+	printf("duration         %.1f s\n", total_ms / 1000.0);
+	printf("avg online CPUs  %.2f\n", (double)online_ms / total_ms);
+	printf("plug events      %u up, %u down\n", ups, downs);
+	printf("energy           %.1f mJ (%.1f mW avg)\n",
+	       energy_uj / 1000.0, (double)energy_uj / total_ms);
+	printf("delayed work     %llu CPU-ms, max backlog %u%%\n",
+	       delayed, max_backlog);
+	printf("time delayed     %llu ms (%.1f%%)\n",
+	       delayed_ms, 100.0 * delayed_ms / total_ms);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+		usage();
+
+	if (!strcmp(argv[1], "record"))
+		return record(argc - 1, argv + 1);
+	if (!strcmp(argv[1], "replay"))
+		return replay(argc - 1, argv + 1);
+
+	usage();
+	return 1;
+}
@@ -0,0 +1,412 @@
+/*
+ * tmu-sim - record thermal traces and replay them through the EXYNOS
+ * TMU throttling policies
+ *
+ * The controller is arch/arm/mach-exynos/include/mach/tmu-pid.h, the
+ * very header tmu-exynos.c builds, so its gains can be tuned on the host
+ * against traces recorded on a board.
+ *
+ *   tmu-sim record [-i ms] [-n samples] [-t path] > trace
+ *	On the board.  Writes one line per sample:
+ *	"<ms> <temperature> <cpu0 scaling_cur_freq in kHz>".
+ *
+ *   tmu-sim replay [tunables] [-v] < trace
+ *	Open loop: feeds the recorded temperatures to the PID and prints
+ *	every cap it would have set.  The recorded temperatures do not
+ *	react to the caps, so this only shows how the controller moves.
+ *
+ *   tmu-sim model [tunables] [thermal model] [-v] < trace
+ *	Closed loop: the recorded frequency is taken as the demand, the
+ *	delivered frequency is the demand limited by the cap, and a single
+ *	RC stage turns the resulting power into temperature.  Runs both the
+ *	PID and the old trip policy (throttle_freq as soon as start_throttle
+ *	is crossed, released at stop_throttle) and compares them.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include <mach/tmu-pid.h>
+
+#define TEMP_PATH	"/sys/devices/platform/tmu/temperature"
+#define FREQ_PATH	"/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq"
+
+/* EXYNOS4412 cpufreq levels, L0 first, in MHz */
+static const unsigned int levels[] = {
+	1400, 1300, 1200, 1100, 1000, 900, 800, 700, 600, 500, 400, 300, 200,
+};
+#define NR_LEVELS	(sizeof(levels) / sizeof(levels[0]))
+
+/* Defaults of the 4412 boards */
+static int start_throttle = 85;
+static int stop_throttle = 82;
+static unsigned int throttle_mhz = 800;
+static unsigned int interval_ms = 200;
+
+static struct tmu_pid_tunables tunables = TMU_PID_DEFAULT_TUNABLES;
+
+/* Thermal model */
+static double ambient = 35.0;		/* C */
+static double r_th = 22.0;		/* C/W */
+static double tau = 8.0;		/* s */
+static double p_static = 150.0;		/* mW */
+static double p_max = 2500.0;		/* dynamic mW at levels[0] */
+
+static int verbose;
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: tmu-sim record [-i ms] [-n samples] [-t path]\n"
+		"       tmu-sim replay [-v] [options] < trace\n"
+		"       tmu-sim model [-v] [options] < trace\n"
+		"policy (defaults are the 4412 boards' and the kernel's):\n"
+		"  -s C         start_throttle   -S C    stop_throttle\n"
+		"  -f MHZ       throttle_freq    -i MS   TMU sampling rate\n"
+		"  -p KP,KI,KD  PID gains        -w N    integral_max\n"
+		"  -d N         step_down        -u N    step_up\n"
+		"thermal model:\n"
+		"  -a C         ambient     (default 35)\n"
+		"  -r C/W       resistance  (default 22)\n"
+		"  -c S         time const  (default 8)\n"
+		"  -P MW        dynamic power at %u MHz (default 2500)\n",
+		levels[0]);
+	exit(1);
+}
+
+static unsigned int mhz_to_level(unsigned int mhz)
+{
+	unsigned int i;
+
+	for (i = 0; i < NR_LEVELS - 1; i++)
+		if (levels[i] <= mhz)
+			break;
+	return i;
+}
+
+/* ------------------------------------------------------------------ */
+
+static int read_int(const char *path, int *val)
+{
+	FILE *f = fopen(path, "r");
+	int ret;
+
+	if (!f)
+		return -1;
+	ret = fscanf(f, "%d", val) == 1 ? 0 : -1;
+	fclose(f);
+	return ret;
+}
+
+static int record(int argc, char **argv)
+{
+	const char *temp_path = TEMP_PATH;
+	unsigned int interval = 200, samples = 0, i, t = 0;
+	int opt, temp, freq;
+
+	while ((opt = getopt(argc, argv, "i:n:t:")) != -1) {
+		switch (opt) {
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		case 'n':
+			samples = atoi(optarg);
+			break;
+		case 't':
+			temp_path = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (!interval)
+		usage();
+
+	for (i = 0; !samples || i < samples; i++) {
+		if (read_int(temp_path, &temp) < 0) {
+			perror(temp_path);
+			return 1;
+		}
+		if (read_int(FREQ_PATH, &freq) < 0) {
+			perror(FREQ_PATH);
+			return 1;
+		}
+		printf("%u %d %d\n", t, temp, freq);
+		fflush(stdout);
+
+		usleep(interval * 1000);
+		t += interval;
+	}
+	return 0;
+}
+
+/* ------------------------------------------------------------------ */
+
+struct sample {
+	unsigned int ms;
+	int temp;
+	unsigned int mhz;
+};
+
+static struct sample *trace;
+static unsigned int nr_samples;
+
+static void read_trace(void)
+{
+	unsigned int size = 0, ms, khz;
+	char line[128];
+	int temp;
+
+	while (fgets(line, sizeof(line), stdin)) {
+		if (sscanf(line, "%u %d %u", &ms, &temp, &khz) != 3)
+			continue;
+		if (nr_samples == size) {
+			size = size ? size * 2 : 1024;
+			trace = realloc(trace, size * sizeof(*trace));
+			if (!trace) {
+				perror("realloc");
+				exit(1);
+			}
+		}
+		trace[nr_samples].ms = ms;
+		trace[nr_samples].temp = temp;
+		trace[nr_samples].mhz = khz / 1000;
+		nr_samples++;
+	}
+	if (nr_samples < 2) {
+		fprintf(stderr, "tmu-sim: trace too short\n");
+		exit(1);
+	}
+}
+
+/* Demand of the recorded trace at time ms */
+static unsigned int demand_at(unsigned int ms)
+{
+	static unsigned int i;
+
+	if (ms < trace[i].ms)
+		i = 0;
+	while (i + 1 < nr_samples && trace[i + 1].ms <= ms)
+		i++;
+	return trace[i].mhz;
+}
+
+/* ------------------------------------------------------------------ */
+
+/*
+ * A throttling policy sees a temperature every interval_ms and returns
+ * the cap, in levels below L0.  Both follow tmu_monitor(): nothing is
+ * capped until start_throttle is crossed, and everything is released
+ * at stop_throttle.
+ */
+struct policy {
+	const char *name;
+	unsigned int (*decide)(struct policy *p, int temp);
+	struct tmu_pid_state pid;
+	int throttled;
+};
+
+static unsigned int range(void)
+{
+	return mhz_to_level(throttle_mhz);
+}
+
+static unsigned int trip_decide(struct policy *p, int temp)
+{
+	if (!p->throttled && temp >= start_throttle)
+		p->throttled = 1;
+	else if (p->throttled && temp <= stop_throttle)
+		p->throttled = 0;
+
+	return p->throttled ? range() : 0;
+}
+
+static unsigned int pid_decide(struct policy *p, int temp)
+{
+	if (!p->throttled && temp >= start_throttle) {
+		p->throttled = 1;
+		tmu_pid_reset(&p->pid, 0);
+	} else if (p->throttled && temp <= stop_throttle) {
+		p->throttled = 0;
+	}
+
+	if (!p->throttled)
+		return 0;
+	return tmu_pid_decide(&tunables, &p->pid, temp, start_throttle,
+			      interval_ms, range());
+}
+
+struct result {
+	unsigned int changes;
+	double peak, above_ms, work, demand, throttle_sum;
+	unsigned int decisions;
+};
+
+static void report(const char *name, struct result *r)
+{
+	printf("%-6s peak %5.1fC  above %3d C for %7.1fs  cap changes %4u"
+	       "  avg throttle %4.2f levels  work delivered %5.1f%%\n",
+	       name, r->peak, start_throttle, r->above_ms / 1000, r->changes,
+	       r->decisions ? r->throttle_sum / r->decisions : 0,
+	       r->demand ? 100 * r->work / r->demand : 100);
+}
+
+static void account(struct policy *p, struct result *r, unsigned int ms,
+		    double temp, unsigned int *cap, unsigned int throttle)
+{
+	if (throttle != *cap) {
+		r->changes++;
+		if (verbose)
+			printf("%-6s %8u ms %5.1fC cap %u MHz\n", p->name, ms,
+			       temp, levels[throttle]);
+		*cap = throttle;
+	}
+	r->throttle_sum += throttle;
+	r->decisions++;
+}
+
+static void replay(struct policy *p)
+{
+	struct result r = { 0 };
+	unsigned int i, cap = 0, next = trace[0].ms;
+
+	for (i = 0; i < nr_samples; i++) {
+		if (trace[i].temp > r.peak)
+			r.peak = trace[i].temp;
+		if (i && trace[i].temp > start_throttle)
+			r.above_ms += trace[i].ms - trace[i - 1].ms;
+		if (trace[i].ms < next)
+			continue;
+		account(p, &r, trace[i].ms, trace[i].temp, &cap,
+			p->decide(p, trace[i].temp));
+		next = trace[i].ms + interval_ms;
+	}
+	report(p->name, &r);
+}
+
+static double power_mw(unsigned int mhz)
+{
+	double x = (double)mhz / levels[0];
+
+	return p_static + p_max * x * x * x;
+}
+
+static void model(struct policy *p)
+{
+	struct result r = { 0 };
+	unsigned int ms, cap = 0, end = trace[nr_samples - 1].ms;
+	const unsigned int dt = 10;
+	double temp = trace[0].temp;
+
+	r.peak = temp;
+	for (ms = trace[0].ms; ms <= end; ms += dt) {
+		unsigned int want = demand_at(ms), got;
+
+		/* The TMU reports whole degrees */
+		if (!(ms % interval_ms))
+			account(p, &r, ms, temp, &cap,
+				p->decide(p, (int)floor(temp)));
+
+		got = want < levels[cap] ? want : levels[cap];
+		r.demand += want;
+		r.work += got;
+
+		temp += (ambient + r_th * power_mw(got) / 1000 - temp) *
+			dt / 1000.0 / tau;
+		if (temp > r.peak)
+			r.peak = temp;
+		if (temp > start_throttle)
+			r.above_ms += dt;
+	}
+	report(p->name, &r);
+}
+
+/* ------------------------------------------------------------------ */
+
+int main(int argc, char **argv)
+{
+	struct policy trip = { .name = "trip", .decide = trip_decide };
+	struct policy pid = { .name = "pid", .decide = pid_decide };
+	int closed, opt;
+
+	if (argc < 2)
+		usage();
+	if (!strcmp(argv[1], "record"))
+		return record(argc - 1, argv + 1);
+	if (!strcmp(argv[1], "replay"))
+		closed = 0;
+	else if (!strcmp(argv[1], "model"))
+		closed = 1;
+	else
+		usage();
+
+	argc--;
+	argv++;
+	while ((opt = getopt(argc, argv, "vs:S:f:i:p:w:d:u:a:r:c:P:")) != -1) {
+		switch (opt) {
+		case 'v':
+			verbose = 1;
+			break;
+		case 's':
+			start_throttle = atoi(optarg);
+			break;
+		case 'S':
+			stop_throttle = atoi(optarg);
+			break;
+		case 'f':
+			throttle_mhz = atoi(optarg);
+			break;
+		case 'i':
+			interval_ms = atoi(optarg);
+			break;
+		case 'p':
+			if (sscanf(optarg, "%d,%d,%d", &tunables.kp,
+				   &tunables.ki, &tunables.kd) != 3)
+				usage();
+			break;
+		case 'w':
+			tunables.integral_max = atoi(optarg);
+			break;
+		case 'd':
+			tunables.step_down = atoi(optarg);
+			break;
+		case 'u':
+			tunables.step_up = atoi(optarg);
+			break;
+		case 'a':
+			ambient = atof(optarg);
+			break;
+		case 'r':
+			r_th = atof(optarg);
+			break;
+		case 'c':
+			tau = atof(optarg);
+			break;
+		case 'P':
+			p_max = atof(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (!interval_ms || stop_throttle >= start_throttle)
+		usage();
+
+	read_trace();
+
+	if (closed) {
+		model(&trip);
+		model(&pid);
+	} else {
+		replay(&trip);
+		replay(&pid);
+	}
+	return 0;
+}
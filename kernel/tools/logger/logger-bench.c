@@ -0,0 +1,173 @@
+/*
+ * logger-bench: measure Android logger write throughput with concurrent
+ * writers
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * Compile by:
+ *
+ * $(CROSS_COMPILE)gcc -Wall -O2 -o logger-bench logger-bench.c -lpthread
+ *
+ * Each writer thread opens the log device itself and writes entries the
+ * way liblog does: a single writev() of priority, tag and message. The run
+ * is repeated for 1 .. N writers and writes/sec is reported for each,
+ * which shows how well the write path scales across CPUs.
+ *
+ * Usage: logger-bench [-t max_threads] [-s seconds] [-l msg_len] [device]
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define LOG_PRIO_INFO	4
+
+struct writer {
+	pthread_t thread;
+	const char *device;
+	size_t msg_len;
+	unsigned long written;	/* no. of entries written during the run */
+};
+
+static volatile int stop;
+
+static void *writer_fn(void *arg)
+{
+	struct writer *w = arg;
+	unsigned char prio = LOG_PRIO_INFO;
+	char tag[] = "logger-bench";
+	struct iovec vec[3];
+	unsigned long n = 0;
+	char *msg;
+	int fd;
+
+	fd = open(w->device, O_WRONLY);
+	if (fd < 0) {
+		perror(w->device);
+		return NULL;
+	}
+
+	msg = malloc(w->msg_len + 1);
+	if (!msg) {
+		close(fd);
+		return NULL;
+	}
+	memset(msg, 'x', w->msg_len);
+	msg[w->msg_len] = '\0';
+
+	vec[0].iov_base = &prio;
+	vec[0].iov_len = 1;
+	vec[1].iov_base = tag;
+	vec[1].iov_len = sizeof(tag);
+	vec[2].iov_base = msg;
+	vec[2].iov_len = w->msg_len + 1;
+
+	while (!stop) {
+		if (writev(fd, vec, 3) < 0) {
+			perror("writev");
+			break;
+		}
+		n++;
+	}
+
+	w->written = n;
+	free(msg);
+	close(fd);
+	return NULL;
+}
+
+static double run(const char *device, int nr_threads, int seconds,
+		  size_t msg_len)
+{
+	struct writer *w;
+	unsigned long total = 0;
+	int i;
+
+	w = calloc(nr_threads, sizeof(*w));
+	if (!w)
+		return -1;
+
+	stop = 0;
+	for (i = 0; i < nr_threads; i++) {
+		w[i].device = device;
+		w[i].msg_len = msg_len;
+		if (pthread_create(&w[i].thread, NULL, writer_fn, &w[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(w[i].thread, NULL);
+		total += w[i].written;
+	}
+
+	free(w);
+	return (double)total / seconds;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-t max_threads] [-s seconds] [-l msg_len] [device]\n"
+		"  -t  run with 1 .. max_threads writers (default: 4)\n"
+		"  -s  duration of each run in seconds (default: 5)\n"
+		"  -l  message length in bytes (default: 64)\n"
+		"  device defaults to /dev/log/main\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int max_threads = 4, seconds = 5;
+	const char *device = "/dev/log/main";
+	size_t msg_len = 64;
+	double base = 0, wps;
+	int c, n;
+
+	while ((c = getopt(argc, argv, "t:s:l:")) != -1) {
+		switch (c) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'l':
+			msg_len = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind < argc - 1 || max_threads < 1 || seconds < 1)
+		usage(argv[0]);
+	if (optind == argc - 1)
+		device = argv[optind];
+
+	printf("%8s %14s %8s\n", "writers", "writes/sec", "scaling");
+	for (n = 1; n <= max_threads; n++) {
+		wps = run(device, n, seconds, msg_len);
+		if (wps < 0)
+			return 1;
+		if (n == 1)
+			base = wps;
+		printf("%8d %14.0f %7.2fx\n", n, wps, base ? wps / base : 0);
+	}
+
+	return 0;
+}
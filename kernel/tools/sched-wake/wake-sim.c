@@ -0,0 +1,291 @@
+/*
+ * wake-sim - compare the default wakeup placement with ENERGY_AWARE_WAKE
+ *
+ * The ranking is kernel/sched_wake.h, the very header sched_fair.c
+ * builds.  Periodic tasks sleep and wake up on a small SMP system whose
+ * cpus are hotplugged, change frequency and sink into deeper idle
+ * states the longer they stay idle.  Each wakeup is placed twice, by
+ * the default idle sibling search and by the energy aware ranking, on
+ * the same system state, and the placements are compared.
+ *
+ *   wake-sim [-c cpus] [-t tasks] [-r run_ms] [-s sleep_ms]
+ *            [-p plug_ms] [-f freq_ms] [-d ms] [-l us] [-n seconds]
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sched_wake.h>
+
+#define MAX_CPUS		8
+#define MAX_TASKS		64
+#define SCHED_POWER_SCALE	1024
+#define ONLINE_SETTLE_MS	20
+
+struct cpu {
+	int online;
+	long online_at;		/* ms */
+	long idle_since;	/* ms, -1 while busy */
+	unsigned long freq_scale;
+};
+
+struct task {
+	int cpu;
+	long wake_at;		/* ms, -1 while running */
+	long run_left;		/* ms */
+};
+
+static struct cpu cpus[MAX_CPUS];
+static struct task tasks[MAX_TASKS];
+static int nr_cpus = 4, nr_tasks = 3;
+static long run_ms = 3, sleep_ms = 12;
+static long plug_ms = 200;		/* hotplug churn period */
+static long freq_ms = 0;		/* per-cpu frequency change period */
+static long deep_ms = 10;		/* idle time before the deep state */
+static unsigned int deep_us = 300;	/* exit latency of the deep state */
+static long seconds = 60;
+
+static const char * const reason_name[NR_WAKE_PLACE] = {
+	[WAKE_PLACE_DEFAULT]	= "default",
+	[WAKE_PLACE_NO_IDLE]	= "no_idle",
+	[WAKE_PLACE_SETTLED]	= "settled",
+	[WAKE_PLACE_CAPACITY]	= "capacity",
+	[WAKE_PLACE_SHALLOW]	= "shallow",
+};
+
+struct result {
+	unsigned long wakeups, idle, unsettled, deep;
+	unsigned long long exit_us, capacity;
+};
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: wake-sim [options]\n"
+		"  -c N    cpus (default 4)       -t N    tasks (default 3)\n"
+		"  -r MS   mean run time (3)      -s MS   mean sleep time (12)\n"
+		"  -p MS   hotplug period (200)   -f MS   per-cpu freq change\n"
+		"                                         period (0: one domain)\n"
+		"  -d MS   idle time before the deep state (10)\n"
+		"  -l US   deep state exit latency (300)\n"
+		"  -n S    simulated seconds (60)\n");
+	exit(1);
+}
+
+static long rnd(long mean)
+{
+	return mean / 2 + rand() % (mean + 1);
+}
+
+static int cpu_idle(int c, long now)
+{
+	return cpus[c].online && cpus[c].idle_since >= 0 &&
+	       cpus[c].idle_since <= now;
+}
+
+static void cand_init(struct wake_cand *w, int c, long now)
+{
+	w->settled = now - cpus[c].online_at >= ONLINE_SETTLE_MS;
+	w->capacity = cpus[c].freq_scale;
+	w->exit_latency = now - cpus[c].idle_since >= deep_ms ? deep_us : 1;
+}
+
+/* __select_idle_sibling(): target if idle, else the first idle cpu */
+static int place_default(int target, long now)
+{
+	int c;
+
+	if (cpu_idle(target, now))
+		return target;
+	for (c = 0; c < nr_cpus; c++)
+		if (cpu_idle(c, now))
+			return c;
+	return target;
+}
+
+/* select_idle_cpu_energy() */
+static int place_energy(int target, long now, enum wake_place *reason)
+{
+	struct wake_cand def, best, cand;
+	int c, best_cpu;
+
+	target = place_default(target, now);
+	*reason = WAKE_PLACE_DEFAULT;
+	if (!cpu_idle(target, now)) {
+		*reason = WAKE_PLACE_NO_IDLE;
+		return target;
+	}
+
+	cand_init(&def, target, now);
+	best = def;
+	best_cpu = target;
+	for (c = 0; c < nr_cpus; c++) {
+		if (c == best_cpu || !cpu_idle(c, now))
+			continue;
+		cand_init(&cand, c, now);
+		if (wake_place_better(&cand, &best) == WAKE_PLACE_DEFAULT)
+			continue;
+		best = cand;
+		best_cpu = c;
+	}
+	if (best_cpu != target)
+		*reason = wake_place_better(&best, &def);
+	return best_cpu;
+}
+
+static void account(struct result *r, int c, long now)
+{
+	struct wake_cand w;
+
+	r->wakeups++;
+	if (!cpu_idle(c, now))
+		return;
+	cand_init(&w, c, now);
+	r->idle++;
+	r->unsettled += !w.settled;
+	r->deep += w.exit_latency == deep_us;
+	r->exit_us += w.exit_latency;
+	r->capacity += w.capacity;
+}
+
+static void report(const char *name, struct result *r)
+{
+	/* Ratios are over the wakeups that found an idle cpu */
+	printf("%-8s %8lu wakeups  %5.1f%% on unsettled cpus  %5.1f%% from "
+	       "deep idle  avg exit %6.1f us  avg capacity %4llu\n",
+	       name, r->wakeups,
+	       r->idle ? 100.0 * r->unsettled / r->idle : 0,
+	       r->idle ? 100.0 * r->deep / r->idle : 0,
+	       r->idle ? (double)r->exit_us / r->idle : 0,
+	       r->idle ? r->capacity / r->idle : 0);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long reasons[NR_WAKE_PLACE] = { 0 };
+	struct result def = { 0 }, energy = { 0 };
+	enum wake_place reason;
+	long now, end;
+	int opt, c, t;
+
+	while ((opt = getopt(argc, argv, "c:t:r:s:p:f:d:l:n:")) != -1) {
+		switch (opt) {
+		case 'c':
+			nr_cpus = atoi(optarg);
+			break;
+		case 't':
+			nr_tasks = atoi(optarg);
+			break;
+		case 'r':
+			run_ms = atol(optarg);
+			break;
+		case 's':
+			sleep_ms = atol(optarg);
+			break;
+		case 'p':
+			plug_ms = atol(optarg);
+			break;
+		case 'f':
+			freq_ms = atol(optarg);
+			break;
+		case 'd':
+			deep_ms = atol(optarg);
+			break;
+		case 'l':
+			deep_us = atoi(optarg);
+			break;
+		case 'n':
+			seconds = atol(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (nr_cpus < 1 || nr_cpus > MAX_CPUS || nr_tasks < 1 ||
+	    nr_tasks > MAX_TASKS || run_ms < 1 || sleep_ms < 1)
+		usage();
+
+	srand(1);
+	for (c = 0; c < nr_cpus; c++) {
+		cpus[c].online = 1;
+		cpus[c].online_at = -ONLINE_SETTLE_MS;
+		cpus[c].idle_since = 0;
+		cpus[c].freq_scale = SCHED_POWER_SCALE;
+	}
+	for (t = 0; t < nr_tasks; t++) {
+		tasks[t].cpu = 0;
+		tasks[t].wake_at = rnd(sleep_ms);
+	}
+
+	end = seconds * 1000;
+	for (now = 0; now < end; now++) {
+		/* The hotplug governor takes the last cpu out and back in */
+		if (plug_ms && nr_cpus > 1 && !(now % plug_ms)) {
+			c = nr_cpus - 1;
+			cpus[c].online = !cpus[c].online;
+			if (cpus[c].online) {
+				cpus[c].online_at = now;
+				cpus[c].idle_since = now;
+			}
+		}
+
+		/* Separate frequency domains, if any, move one step */
+		if (freq_ms && !(now % freq_ms)) {
+			c = rand() % nr_cpus;
+			cpus[c].freq_scale = SCHED_POWER_SCALE *
+					     (4 + rand() % 5) / 8;
+		}
+
+		/* Running tasks use up their slice and go to sleep */
+		for (t = 0; t < nr_tasks; t++) {
+			if (tasks[t].wake_at >= 0 || --tasks[t].run_left > 0)
+				continue;
+			tasks[t].wake_at = now + rnd(sleep_ms);
+			cpus[tasks[t].cpu].idle_since = now;
+		}
+
+		/* Tasks whose cpu was unplugged move to cpu 0 */
+		for (t = 0; t < nr_tasks; t++)
+			if (tasks[t].wake_at < 0 && !cpus[tasks[t].cpu].online) {
+				tasks[t].cpu = 0;
+				cpus[0].idle_since = -1;
+			}
+
+		/* Wakeups */
+		for (t = 0; t < nr_tasks; t++) {
+			int prev = tasks[t].cpu;
+
+			if (tasks[t].wake_at != now)
+				continue;
+			if (!cpus[prev].online)
+				prev = 0;
+
+			account(&def, place_default(prev, now), now);
+
+			c = place_energy(prev, now, &reason);
+			reasons[reason]++;
+			account(&energy, c, now);
+
+			/* The system follows the energy aware placement */
+			tasks[t].cpu = c;
+			tasks[t].wake_at = -1;
+			tasks[t].run_left = rnd(run_ms);
+			cpus[c].idle_since = -1;
+		}
+	}
+
+	report("default", &def);
+	report("energy", &energy);
+	printf("energy placements:");
+	for (c = 0; c < NR_WAKE_PLACE; c++)
+		printf(" %s %lu", reason_name[c], reasons[c]);
+	printf("\n");
+
+	return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * zram-bench: measure zram write throughput with concurrent writers
+ *
+ * Copyright (C) 2012 Samsung Electronics
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ *
+ * Compile by:
+ *
+ * $(CROSS_COMPILE)gcc -Wall -O2 -o zram-bench zram-bench.c -lpthread
+ *
+ * Each writer thread owns a disjoint range of the device and repeatedly
+ * writes pages of moderately compressible data to it with O_DIRECT, so
+ * that every write goes through the zram compression path. The run is
+ * repeated for 1 .. N writers and pages/sec is reported for each, which
+ * shows how well compression scales with max_comp_streams.
+ *
+ * Usage: zram-bench [-t max_threads] [-s seconds] [-p pages] /dev/zramX
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define PAGE_SZ		4096
+
+struct writer {
+	pthread_t thread;
+	int fd;
+	off_t start;		/* first byte owned by this writer */
+	unsigned long pages;	/* no. of pages owned by this writer */
+	unsigned long written;	/* no. of pages written during the run */
+	unsigned int seed;
+};
+
+static volatile int stop;
+
+/*
+ * Fill a page with data that compresses to roughly half its size:
+ * runs of repeated bytes interleaved with pseudo-random bytes.
+ */
+static void fill_page(unsigned char *buf, unsigned int *seed)
+{
+	int i;
+
+	for (i = 0; i < PAGE_SZ; i += 16) {
+		memset(buf + i, rand_r(seed) & 0xff, 8);
+		*(unsigned int *)(buf + i + 8) = rand_r(seed);
+		*(unsigned int *)(buf + i + 12) = rand_r(seed);
+	}
+}
+
+static void *writer_fn(void *arg)
+{
+	struct writer *w = arg;
+	unsigned char *buf;
+	unsigned long n = 0;
+
+	if (posix_memalign((void **)&buf, PAGE_SZ, PAGE_SZ))
+		return NULL;
+
+	while (!stop) {
+		fill_page(buf, &w->seed);
+		if (pwrite(w->fd, buf, PAGE_SZ,
+			   w->start + (off_t)(n % w->pages) * PAGE_SZ)
+				!= PAGE_SZ) {
+			perror("pwrite");
+			break;
+		}
+		n++;
+	}
+
+	w->written = n;
+	free(buf);
+	return NULL;
+}
+
+static double run(int fd, int nr_threads, int seconds,
+		  unsigned long dev_pages)
+{
+	struct writer *w;
+	unsigned long total = 0;
+	int i;
+
+	w = calloc(nr_threads, sizeof(*w));
+	if (!w)
+		return -1;
+
+	stop = 0;
+	for (i = 0; i < nr_threads; i++) {
+		w[i].fd = fd;
+		w[i].pages = dev_pages / nr_threads;
+		w[i].start = (off_t)i * w[i].pages * PAGE_SZ;
+		w[i].seed = i + 1;
+		if (pthread_create(&w[i].thread, NULL, writer_fn, &w[i])) {
+			perror("pthread_create");
+			exit(1);
+		}
+	}
+
+	sleep(seconds);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(w[i].thread, NULL);
+		total += w[i].written;
+	}
+
+	free(w);
+	return (double)total / seconds;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-t max_threads] [-s seconds] [-p pages] device\n"
+		"  -t  run with 1 .. max_threads writers (default: 4)\n"
+		"  -s  duration of each run in seconds (default: 5)\n"
+		"  -p  no. of device pages to write over (default: 16384)\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int max_threads = 4, seconds = 5;
+	unsigned long dev_pages = 16384;
+	double base = 0, pps;
+	int fd, c, n;
+
+	while ((c = getopt(argc, argv, "t:s:p:")) != -1) {
+		switch (c) {
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 's':
+			seconds = atoi(optarg);
+			break;
+		case 'p':
+			dev_pages = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 1 || max_threads < 1 || seconds < 1 ||
+	    dev_pages < (unsigned long)max_threads)
+		usage(argv[0]);
+
+	fd = open(argv[optind], O_WRONLY | O_DIRECT);
+	if (fd < 0) {
+		perror(argv[optind]);
+		return 1;
+	}
+
+	printf("%8s %14s %8s\n", "writers", "pages/sec", "scaling");
+	for (n = 1; n <= max_threads; n++) {
+		pps = run(fd, n, seconds, dev_pages);
+		if (pps < 0)
+			return 1;
+		if (n == 1)
+			base = pps;
+		printf("%8d %14.0f %7.2fx\n", n, pps, base ? pps / base : 0);
+	}
+
+	close(fd);
+	return 0;
+}